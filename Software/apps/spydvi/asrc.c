@@ -0,0 +1,263 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file asrc.c
+ * @brief Asynchronous sample rate converter, see asrc.h.
+ */
+
+#include "asrc.h"
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+#define INPUT_MASK (ASRC_INPUT_SIZE - 1)
+
+// Longest time between two calls before the input ring may have wrapped, 20 ms is 960 frames at 48 kHz
+#define MAX_GAP_US 20000
+
+// Input rates below this are taken as no input at all
+#define MIN_INPUT_RATE 4000
+
+// Cutoff of the filter as a share of the input rate
+#define CUTOFF 0.45f
+
+// Coefficients for every phase and the next input frame, unity gain is 1 << 15
+static int16_t coefs[ASRC_PHASES + 1][ASRC_TAPS];
+
+static struct {
+    const audio_sample_t *input;
+    audio_ring_t *output;
+    uint32_t output_rate;
+    bool running;
+    // Input frame of the first tap, the output is between the middle two taps
+    uint32_t read;
+    // Position between those two frames, 32 bit fraction
+    uint32_t frac;
+    // Input frames not yet read, from the first tap on
+    int32_t avail;
+    // Input frames per output sample, 32.32 fixed point
+    uint64_t step;
+    uint32_t last_write;
+    uint32_t last_time;
+    uint32_t window_frames;
+    uint32_t window_us;
+    // Input frames and time since the rate was found, halved every ASRC_RATE_HISTORY_US
+    uint64_t total_frames;
+    uint64_t total_us;
+    uint32_t max;
+    asrc_stats_t stats;
+} state;
+
+static void build_coefs(void)
+{
+    const float pi = 3.14159265f;
+    const float half = ASRC_TAPS / 2;
+
+    for (int phase = 0; phase <= ASRC_PHASES; phase++) {
+        float h[ASRC_TAPS];
+        float sum = 0;
+        for (int tap = 0; tap < ASRC_TAPS; tap++) {
+            // Distance of the input frame from the output sample, in input frames
+            float t = tap - (half - 1) - (float) phase / ASRC_PHASES;
+            float x = 2 * CUTOFF * t;
+            float sinc = (x == 0) ? 1.0f : sinf(pi * x) / (pi * x);
+            // Blackman window over all taps
+            float window = 0.42f + 0.5f * cosf(pi * t / half) + 0.08f * cosf(2 * pi * t / half);
+            h[tap] = sinc * window;
+            sum += h[tap];
+        }
+
+        // Unity gain for every phase, the rounding goes to the largest tap
+        int32_t total = 0;
+        int largest = 0;
+        for (int tap = 0; tap < ASRC_TAPS; tap++) {
+            float c = h[tap] / sum * (1 << 15);
+            coefs[phase][tap] = (c < 0) ? -(int32_t) (0.5f - c) : (int32_t) (c + 0.5f);
+            total += coefs[phase][tap];
+            if (coefs[phase][tap] > coefs[phase][largest]) {
+                largest = tap;
+            }
+        }
+        coefs[phase][largest] += (1 << 15) - total;
+    }
+}
+
+// Start again a quarter of the input ring behind the DMA, plus what it takes to fill the audio ring
+static void resync(uint32_t input_write)
+{
+    audio_ring_t *ring = state.output;
+    uint32_t fill = (ring->write - ring->read) & (ring->size - 1);
+    uint32_t missing = (fill < ASRC_OUTPUT_FILL) ? ASRC_OUTPUT_FILL - fill : 0;
+
+    state.avail = ASRC_INPUT_SIZE / 4 + ((missing * state.step) >> 32);
+    state.read = (input_write - state.avail) & INPUT_MASK;
+    state.frac = 0;
+    state.stats.resyncs++;
+}
+
+static void restart_window(void)
+{
+    state.window_frames = 0;
+    state.window_us = 0;
+}
+
+// Input frames per output sample, 32.32 fixed point
+static uint64_t step_from(uint64_t frames, uint64_t us)
+{
+    // Keep the products within 64 bits
+    while (frames >= (1ull << 31)) {
+        frames >>= 1;
+        us >>= 1;
+    }
+    // Input rate in Hz, 20.12 fixed point
+    uint64_t rate = (frames * 1000000ull << 12) / us;
+    return (rate << 20) / state.output_rate;
+}
+
+static void measure_rate(uint32_t input_write)
+{
+    uint32_t frames = state.window_frames;
+    uint32_t us = state.window_us;
+    restart_window();
+
+    state.stats.input_rate = ((uint64_t) frames * 1000000 + us / 2) / us;
+    if (state.stats.input_rate < MIN_INPUT_RATE) {
+        state.stats.input_rate = 0;
+        state.running = false;
+        return;
+    }
+
+    // A window is only counted to the frame, so the step comes from all of
+    // them, but a rate off by more than 1.5% is a new one
+    uint64_t step = step_from(frames, us);
+    int64_t error = (int64_t) (step - state.step);
+    if (!state.running || error > (int64_t) (state.step >> 6) || -error > (int64_t) (state.step >> 6)) {
+        state.total_frames = 0;
+        state.total_us = 0;
+        state.step = step;
+        state.running = true;
+        resync(input_write);
+    }
+    state.total_frames += frames;
+    state.total_us += us;
+    if (state.total_us >= ASRC_RATE_HISTORY_US) {
+        state.total_frames /= 2;
+        state.total_us /= 2;
+    }
+    state.step = step_from(state.total_frames, state.total_us);
+}
+
+void asrc_init(const audio_sample_t *input, audio_ring_t *output, uint32_t output_rate)
+{
+    state.input = input;
+    state.output = output;
+    build_coefs();
+    asrc_set_output_rate(output_rate);
+}
+
+void asrc_set_output_rate(uint32_t output_rate)
+{
+    state.output_rate = output_rate;
+    state.running = false;
+    state.stats.input_rate = 0;
+    restart_window();
+}
+
+static inline audio_sample_t filter(const audio_sample_t *input, uint32_t read, uint32_t frac)
+{
+    // The coefficients of the two nearest phases, weighted by the next 16 bits
+    const int16_t *c0 = coefs[frac >> (32 - ASRC_PHASE_BITS)];
+    const int16_t *c1 = c0 + ASRC_TAPS;
+    int32_t weight = (frac >> (16 - ASRC_PHASE_BITS)) & 0xffff;
+
+    int32_t left = 1 << 14;
+    int32_t right = 1 << 14;
+    for (int tap = 0; tap < ASRC_TAPS; tap++) {
+        int32_t c = c0[tap] + (((c1[tap] - c0[tap]) * weight) >> 16);
+        const audio_sample_t *s = &input[(read + tap) & INPUT_MASK];
+        left += c * s->channels[0];
+        right += c * s->channels[1];
+    }
+
+    audio_sample_t out;
+    out.channels[0] = MAX(INT16_MIN, MIN(INT16_MAX, left >> 15));
+    out.channels[1] = MAX(INT16_MIN, MIN(INT16_MAX, right >> 15));
+    return out;
+}
+
+uint32_t __not_in_flash_func(asrc_process)(uint32_t input_write, uint32_t time_us)
+{
+    uint32_t t0 = cycles_now();
+
+    uint32_t frames = (input_write - state.last_write) & INPUT_MASK;
+    uint32_t us = time_us - state.last_time;
+    state.last_write = input_write;
+    state.last_time = time_us;
+
+    if (us > MAX_GAP_US) {
+        // The DMA may have gone around the ring, frames are unknown
+        restart_window();
+        if (state.running) {
+            resync(input_write);
+        }
+        return 0;
+    }
+
+    state.window_frames += frames;
+    state.window_us += us;
+    state.avail += frames;
+    if (state.window_us >= ASRC_RATE_WINDOW_US) {
+        measure_rate(input_write);
+        state.stats.cycles = state.max;
+        state.max = 0;
+    }
+    if (!state.running) {
+        return 0;
+    }
+    if (state.avail > ASRC_INPUT_SIZE - ASRC_TAPS) {
+        // The DMA overwrote frames not yet read
+        resync(input_write);
+    }
+
+    audio_ring_t *ring = state.output;
+    uint32_t ring_mask = ring->size - 1;
+    uint32_t write = ring->write;
+    uint32_t fill = (write - ring->read) & ring_mask;
+
+    uint32_t n = 0;
+    while (n < ASRC_BLOCK && fill + n < ASRC_OUTPUT_FILL) {
+        if (state.avail < ASRC_TAPS) {
+            // Reading faster than the DMA writes
+            resync(input_write);
+            break;
+        }
+
+        ring->buffer[(write + n) & ring_mask] = filter(state.input, state.read, state.frac);
+        n++;
+
+        uint64_t pos = (uint64_t) state.frac + state.step;
+        uint32_t frames_read = pos >> 32;
+        state.frac = pos;
+        state.read = (state.read + frames_read) & INPUT_MASK;
+        state.avail -= frames_read;
+    }
+    if (n) {
+        increase_write_pointer(ring, n);
+    }
+
+    uint32_t cycles = cycles_since(t0);
+    state.max = MAX(state.max, cycles);
+    state.stats.max_cycles = MAX(state.stats.max_cycles, cycles);
+
+    return n;
+}
+
+const asrc_stats_t *asrc_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,104 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file asrc.h
+ * @brief Asynchronous sample rate converter for the N64 audio.
+ *
+ * Without AUDIO_ASRC a timer paced DMA copies the latest I2S frame into the
+ * audio ring at the output rate, so frames are repeated or dropped whenever
+ * the N64's AI rate isn't the output rate. With AUDIO_ASRC every I2S frame is
+ * written to an input ring by DMA instead, and core 0 resamples them into the
+ * audio ring on the rows the capture skips, see asrc_process().
+ *
+ * The input rate is measured from the DMA write position against the
+ * microsecond timer, every ASRC_RATE_WINDOW_US and averaged over the last
+ * ASRC_RATE_HISTORY_US. Each output sample is a
+ * windowed sinc of ASRC_TAPS input frames, with the coefficients of the two
+ * nearest of ASRC_PHASES phases interpolated, all in fixed point. The cutoff
+ * is just below the input Nyquist frequency, so the output rate should not be
+ * below the AI rate.
+ *
+ * The audio ring is kept ASRC_OUTPUT_FILL samples ahead of libdvi, which sets
+ * the pace. When the input ring runs empty or overflows, which happens if the
+ * measured rate is off or core 0 doesn't get to run, the converter restarts
+ * ASRC_INPUT_SIZE / 4 frames behind the DMA.
+ *
+ * asrc.c has no hardware dependencies, the DMA and timer are read in main.c,
+ * and it is built whether AUDIO_ASRC is set or not. host/asrcbench.c runs it
+ * against the nearest frame picking and measures the THD+N of both.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "audio_ring.h"
+
+/// Frames in the input ring, a power of two, 43 ms at 48 kHz.
+#define ASRC_INPUT_SIZE 2048
+
+/// Input frames each output sample is filtered from, even.
+#define ASRC_TAPS 16
+
+/// Filter phases between two input frames, 1 << ASRC_PHASE_BITS.
+#define ASRC_PHASE_BITS 7
+#define ASRC_PHASES (1 << ASRC_PHASE_BITS)
+
+/// Samples kept in the audio ring ahead of libdvi, covering the captured rows of a frame at 96 kHz.
+#define ASRC_OUTPUT_FILL (AUDIO_BUFFER_SIZE / 4)
+
+/// Longest run of output samples per call, about 3000 cycles.
+#define ASRC_BLOCK 8
+
+/// Time each measurement of the input rate takes.
+#define ASRC_RATE_WINDOW_US 250000
+
+/// Time the measurements are averaged over, at least half of it.
+#define ASRC_RATE_HISTORY_US 16000000
+
+/**
+ * @struct asrc_stats
+ * @brief Input rate and converter load.
+ */
+typedef struct asrc_stats {
+    uint32_t input_rate;  ///< Measured input rate in Hz, 0 while there is no input.
+    uint32_t resyncs;     ///< Restarts after the input ring ran empty or overflowed, or the rate changed.
+    uint32_t cycles;      ///< Cycles of the longest call in the last rate window.
+    uint32_t max_cycles;  ///< Cycles of the longest call since boot.
+} asrc_stats_t;
+
+/**
+ * @brief Initialize the converter, silent until the input rate is measured.
+ * @param input The input ring, ASRC_INPUT_SIZE frames written by DMA.
+ * @param output The audio ring read by libdvi, a power of two in size.
+ * @param output_rate The output rate in Hz.
+ */
+void asrc_init(const audio_sample_t *input, audio_ring_t *output, uint32_t output_rate);
+
+/**
+ * @brief Set the output rate, and measure the input rate again.
+ * @param output_rate The output rate in Hz.
+ */
+void asrc_set_output_rate(uint32_t output_rate);
+
+/**
+ * @brief Resample the input written so far (core 0).
+ *
+ * Produces up to ASRC_BLOCK samples, fewer if the audio ring is
+ * ASRC_OUTPUT_FILL ahead or the input runs out. Has to be called at least
+ * every 20 ms, longer gaps restart the converter.
+ * @param input_write Input frames written, the index in the input ring the DMA writes next.
+ * @param time_us The microsecond timer, read with input_write.
+ * @return Samples written to the audio ring.
+ */
+uint32_t asrc_process(uint32_t input_write, uint32_t time_us);
+
+/**
+ * @brief Get the converter counters.
+ * @return A pointer to the counters.
+ */
+const asrc_stats_t *asrc_get_stats(void);
@@ -0,0 +1,154 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "audio_drift.h"
+
+#include <stdlib.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+
+// Controller gains in 1/256 ppm of the DMA timer rate, per sample of gap error.
+// A little under critically damped at 48 kHz, settling in about five seconds.
+// A 0.3% step, like GENLOCK switching on for NTSC, moves the gap by about 120
+// samples.
+#define AUDIO_DRIFT_KP (16 * 256)
+#define AUDIO_DRIFT_KI (256 / 8)
+
+#define AUDIO_DRIFT_MAX (AUDIO_DRIFT_MAX_PPM * 256)
+
+static struct {
+    struct dvi_inst *inst;
+    uint timer;
+    uint16_t numerator;
+    uint16_t denominator;
+    int32_t integral; // 1/256 ppm
+    int32_t residue;  // 1/65536 denominator steps, dither accumulator
+    uint32_t frames;
+    int32_t min_gap;
+    int32_t max_gap;
+    audio_drift_stats_t stats;
+} state;
+
+void audio_drift_init(struct dvi_inst *inst, uint dma_timer)
+{
+    state.inst = inst;
+    state.timer = dma_timer;
+    state.integral = 0;
+    state.residue = 0;
+    state.frames = 0;
+    state.min_gap = INT32_MAX;
+    state.max_gap = INT32_MIN;
+}
+
+// Where the audio DMA writes the ring next
+static uint32_t dma_write(const struct dvi_inst *inst)
+{
+    return ((uint32_t) dma_hw->ch[inst->dma_chan_a].write_addr - (uint32_t) inst->dma_buf_a) / sizeof(audio_sample_t);
+}
+
+// Put libdvi's read position half the ring behind the DMA
+static void recenter(struct dvi_inst *inst)
+{
+    uint32_t size = inst->dma_size;
+    set_read_offset(&inst->audio_ring, (dma_write(inst) - size / 2) & (size - 1));
+}
+
+void audio_drift_restart(void)
+{
+    // A new clock or rate has a new rate difference
+    state.integral = 0;
+    state.residue = 0;
+#if AUDIO_DIRECT_DMA
+    if (state.inst && state.inst->dma_size) {
+        // libdvi read at the old rate until now, the gap has moved with it
+        state.inst->samples_per_line16_adjust = 0;
+        recenter(state.inst);
+    }
+#endif
+}
+
+void audio_drift_set_fraction(uint16_t numerator, uint16_t denominator)
+{
+    state.numerator = numerator;
+    state.denominator = denominator;
+    audio_drift_restart();
+    dma_timer_set_fraction(state.timer, numerator, denominator);
+}
+
+int __not_in_flash_func(audio_drift_update)(void)
+{
+    struct dvi_inst *inst = state.inst;
+    audio_ring_t *ring = &inst->audio_ring;
+    uint32_t size = inst->dma_size;
+    if (size == 0) {
+        return 0;
+    }
+
+    int32_t gap = (dma_write(inst) - ring->read) & (size - 1);
+    int32_t error = gap - (int32_t) size / 2;
+
+    if (abs(error) > (int32_t) size * 3 / 8) {
+        // About to overtake, start again from the middle. Racing libdvi's
+        // update on core 1 only loses the reset, and it's done next frame.
+        recenter(inst);
+        state.stats.recenters++;
+        error = 0;
+    }
+
+    // Positive speeds the DMA up against libdvi, when libdvi is catching up
+    state.integral -= error * AUDIO_DRIFT_KI;
+    state.integral = MAX(state.integral, -AUDIO_DRIFT_MAX);
+    state.integral = MIN(state.integral, AUDIO_DRIFT_MAX);
+    int32_t correction = state.integral - error * AUDIO_DRIFT_KP;
+    correction = MAX(correction, -AUDIO_DRIFT_MAX);
+    correction = MIN(correction, AUDIO_DRIFT_MAX);
+
+#if AUDIO_DIRECT_DMA
+    // The DMA runs at the N64's rate, so libdvi steps through the ring more
+    // slowly instead, a smaller samples_per_line16. First order sigma-delta,
+    // so the average is fractional.
+    state.residue -= (int64_t) inst->samples_per_line16 * correction * 65536 / (256 * 1000000);
+    int32_t adjust = state.residue >> 16;
+    state.residue -= adjust * 65536;
+    inst->samples_per_line16_adjust = adjust;
+#else
+    // The timer runs at numerator / denominator of clk_sys, so faster is a
+    // smaller denominator. First order sigma-delta, so the average is fractional.
+    state.residue -= (int64_t) state.denominator * correction * 65536 / (256 * 1000000);
+    int32_t adjust = state.residue >> 16;
+    state.residue -= adjust * 65536;
+    uint32_t denominator = state.denominator + adjust;
+    denominator = MAX(denominator, state.numerator);
+    denominator = MIN(denominator, 0xffff);
+    dma_timer_set_fraction(state.timer, state.numerator, denominator);
+    adjust = (int32_t) denominator - state.denominator;
+#endif
+
+    if (adjust < 0) {
+        state.stats.speedups++;
+    } else if (adjust > 0) {
+        state.stats.slowdowns++;
+    }
+
+    state.min_gap = MIN(state.min_gap, gap);
+    state.max_gap = MAX(state.max_gap, gap);
+    if (++state.frames == AUDIO_DRIFT_WINDOW_FRAMES) {
+        state.stats.min_gap = state.min_gap;
+        state.stats.max_gap = state.max_gap;
+        state.frames = 0;
+        state.min_gap = INT32_MAX;
+        state.max_gap = INT32_MIN;
+    }
+    state.stats.gap = gap;
+    state.stats.rate = state.integral;
+
+    return error;
+}
+
+const audio_drift_stats_t *audio_drift_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,107 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file audio_drift.h
+ * @brief Hold the gap between the audio DMA and libdvi constant.
+ *
+ * The timer paced DMA writes the audio ring at the rate of DMA timer 0, and
+ * libdvi reads it at samples_per_line16 per DVI line. The two rates come from
+ * different fractions of the system clock and don't quite match, and with
+ * GENLOCK every stretched frame reads a little more slowly. Left alone, the
+ * gap between the two, which starts at half the ring, drifts until one
+ * overtakes the other.
+ *
+ * Once per captured frame the gap is measured, and its distance from half the
+ * ring is fed through a PI controller. Its output is a rate correction for the
+ * DMA timer in ppm, which is dithered to whole steps of the timer's
+ * denominator like genlock.c dithers lines. Once locked, the integral term is
+ * the rate difference. The HDMI stream keeps the rate its CTS and N announce,
+ * only the sampling of the N64 audio moves.
+ *
+ * With AUDIO_DIRECT_DMA there is no timer, the audio PIO DMA writes every
+ * I2S frame into the ring and libdvi reads it at the N64's rate measured by
+ * audio_rate.c. That rate is only good to the Hz, so the same correction
+ * goes to libdvi instead, as samples_per_line16_adjust, and it is libdvi
+ * that slows down when it is catching up.
+ *
+ * If the gap leaves the middle three quarters of the ring anyway, libdvi's
+ * read position is put back in the middle. With AUDIO_DIRECT_DMA that is
+ * also done when libdvi's rate changes, see audio_drift_restart().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+#if AUDIO_DRIFT_CONTROL && AUDIO_ASRC
+#error "AUDIO_DRIFT_CONTROL is for the timer paced copy, AUDIO_ASRC keeps the audio ring filled itself"
+#endif
+
+#if AUDIO_DIRECT_DMA && !(AUDIO_DRIFT_CONTROL && AUDIO_RATE_DETECT)
+#error "AUDIO_DIRECT_DMA reads at the rate AUDIO_RATE_DETECT measures, and needs AUDIO_DRIFT_CONTROL to hold it there"
+#endif
+
+/// Frames the smallest and largest gap are taken over, about a second.
+#define AUDIO_DRIFT_WINDOW_FRAMES 64
+
+/**
+ * @struct audio_drift_stats
+ * @brief Gap and controller telemetry, updated every captured frame.
+ */
+typedef struct audio_drift_stats {
+    int32_t gap;        ///< Samples the DMA is ahead of libdvi, last frame.
+    int32_t min_gap;    ///< Smallest gap of the last AUDIO_DRIFT_WINDOW_FRAMES frames.
+    int32_t max_gap;    ///< Largest gap of the last AUDIO_DRIFT_WINDOW_FRAMES frames.
+    int32_t rate;       ///< Integral term, the DMA rate correction against libdvi in 1/256 ppm.
+    uint32_t speedups;  ///< Frames the DMA timer ran faster, or libdvi slower, than nominal, since boot.
+    uint32_t slowdowns; ///< Frames the DMA timer ran slower, or libdvi faster, than nominal, since boot.
+    uint32_t recenters; ///< Times libdvi's read position was put back in the middle, since boot.
+} audio_drift_stats_t;
+
+/**
+ * @brief Initialize the controller.
+ *
+ * The audio ring and the DMA channel writing it are the ones given to
+ * dvi_audio_sample_dma_set_chan().
+ * @param inst The DVI instance reading the audio ring.
+ * @param dma_timer The DMA timer pacing the copy, unused with AUDIO_DIRECT_DMA.
+ */
+void audio_drift_init(struct dvi_inst *inst, uint dma_timer);
+
+/**
+ * @brief Start from the nominal rates again.
+ *
+ * Called when clk_sys or the audio rate changes, audio_drift_set_fraction()
+ * does it too. With AUDIO_DIRECT_DMA libdvi's read position is put back in
+ * the middle of the ring as well.
+ */
+void audio_drift_restart(void);
+
+/**
+ * @brief Set the nominal fraction of the DMA timer, and start from it.
+ *
+ * Replaces dma_timer_set_fraction(), and is called again when clk_sys changes.
+ * @param numerator The numerator of the fraction of clk_sys.
+ * @param denominator The denominator of the fraction of clk_sys.
+ */
+void audio_drift_set_fraction(uint16_t numerator, uint16_t denominator);
+
+/**
+ * @brief Measure the gap and steer the DMA timer, or libdvi (core 0).
+ *
+ * Called once per captured frame.
+ * @return The gap error in samples, positive when the DMA is further ahead than half the ring.
+ */
+int audio_drift_update(void);
+
+/**
+ * @brief Get the gap and controller telemetry.
+ * @return A pointer to the telemetry.
+ */
+const audio_drift_stats_t *audio_drift_get_stats(void);
@@ -0,0 +1,262 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "audio_rate.h"
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+
+// CTS and N are 20 bit fields of the Audio Clock Regeneration packet
+#define ACR_MAX 0xfffff
+
+static struct {
+    uint dma_chan;
+    uint32_t default_rate;
+    uint32_t last_frames;
+    uint32_t last_time;
+    uint32_t window_frames;
+    uint32_t window_us;
+    // A window that asked for a new rate, waiting for the next one to agree
+    uint32_t pending_frames;
+    uint32_t pending_us;
+    uint32_t pending_rate;
+    // Short windows until the first rate, and whether the last one had audio
+    bool first;
+    bool first_audio;
+    audio_rate_stats_t stats;
+} state;
+
+static uint32_t frames_now(void)
+{
+    return ~dma_hw->ch[state.dma_chan].transfer_count;
+}
+
+void audio_rate_init(uint dma_chan, uint32_t default_rate)
+{
+    state.dma_chan = dma_chan;
+    state.default_rate = default_rate;
+    state.last_frames = frames_now();
+    state.last_time = time_us_32();
+    state.window_frames = 0;
+    state.window_us = 0;
+    state.pending_rate = 0;
+    state.first = true;
+    state.first_audio = false;
+    state.stats.measured = 0;
+    state.stats.rate = default_rate;
+    state.stats.repeat = 1;
+}
+
+static uint32_t rate_of(uint32_t frames, uint32_t us)
+{
+    return ((uint64_t) frames * 1000000 + us / 2) / us;
+}
+
+// The output rate for a measured one, and the times each frame is sent at it
+static uint32_t target_of(uint32_t measured, uint32_t *repeat)
+{
+    *repeat = 1;
+#if AUDIO_DIRECT_DMA
+    if (measured && measured < AUDIO_RATE_MIN_HZ) {
+        // The smallest multiple HDMI takes, or the current one while it still
+        // fits, so a rate on the edge doesn't flip between two
+        uint32_t current = state.stats.repeat;
+        if (current > 1 && measured * current >= AUDIO_RATE_MIN_HZ && measured * current <= AUDIO_RATE_MAX_HZ) {
+            *repeat = current;
+        } else {
+            *repeat = (AUDIO_RATE_MIN_HZ + measured - 1) / measured;
+        }
+        measured *= *repeat;
+    }
+#endif
+    if (measured < AUDIO_RATE_MIN_HZ || measured > AUDIO_RATE_MAX_HZ) {
+        *repeat = 1;
+        return state.default_rate;
+    }
+    return measured;
+}
+
+static bool set_rate(uint32_t rate, uint32_t repeat)
+{
+    if (rate == state.stats.rate && repeat == state.stats.repeat) {
+        return false;
+    }
+    state.stats.rate = rate;
+    state.stats.repeat = repeat;
+    state.stats.changes++;
+    return true;
+}
+
+// Rates within AUDIO_RATE_TOLERANCE_PPM are taken as the same
+static bool same_rate(uint32_t a, uint32_t b)
+{
+    uint32_t diff = (a > b) ? a - b : b - a;
+    return (uint64_t) diff * 1000000 <= (uint64_t) b * AUDIO_RATE_TOLERANCE_PPM;
+}
+
+bool __not_in_flash_func(audio_rate_update)(void)
+{
+    uint32_t frames = frames_now();
+    uint32_t time = time_us_32();
+    state.window_frames += frames - state.last_frames;
+    state.window_us += time - state.last_time;
+    state.last_frames = frames;
+    state.last_time = time;
+
+    if (state.window_us < (state.first ? AUDIO_RATE_FIRST_WINDOW_US : AUDIO_RATE_WINDOW_US)) {
+        return false;
+    }
+    frames = state.window_frames;
+    uint32_t us = state.window_us;
+    state.window_frames = 0;
+    state.window_us = 0;
+
+    uint32_t measured = rate_of(frames, us);
+    state.stats.measured = measured;
+    if (measured == 0) {
+        // No audio, like a reset, keep the rate for when it comes back
+        state.pending_rate = 0;
+        state.first_audio = false;
+        return false;
+    }
+
+    uint32_t repeat;
+    uint32_t target = target_of(measured, &repeat);
+    if (state.first) {
+        // The window before had audio too, so this one had it throughout
+        if (!state.first_audio) {
+            state.first_audio = true;
+            return false;
+        }
+        state.first = false;
+        return set_rate(target, repeat);
+    }
+    if (same_rate(target, state.stats.rate) && repeat == state.stats.repeat) {
+        state.pending_rate = 0;
+        return false;
+    }
+    if (state.pending_rate == 0 || !same_rate(target, state.pending_rate)) {
+        // A new rate has to hold for two windows
+        state.pending_frames = frames;
+        state.pending_us = us;
+        state.pending_rate = target;
+        return false;
+    }
+
+    // Both windows together are good to half a Hz
+    target = target_of(rate_of(frames + state.pending_frames, us + state.pending_us), &repeat);
+    state.pending_rate = 0;
+    return set_rate(target, repeat);
+}
+
+uint32_t audio_rate_get(void)
+{
+    return state.stats.rate;
+}
+
+uint32_t audio_rate_get_repeat(void)
+{
+    return state.stats.repeat;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// The fraction closest to p / q with a denominator of at most max_den, from
+// its continued fraction, written to *num / *den
+static void best_fraction(uint64_t p, uint64_t q, uint64_t max_den, uint64_t *num, uint64_t *den)
+{
+    // Last two convergents, p0 / q0 and p1 / q1
+    uint64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+    uint64_t n = p, d = q;
+
+    while (d) {
+        uint64_t a = n / d;
+        uint64_t q2 = q0 + a * q1;
+        if (q2 > max_den) {
+            // The largest semiconvergent still in range may be closer than p1 / q1
+            uint64_t k = (max_den - q0) / q1;
+            uint64_t ps = p0 + k * p1;
+            uint64_t qs = q0 + k * q1;
+            // |ps / qs - p / q| < |p1 / q1 - p / q|, multiplied by q * qs * q1
+            uint64_t es = (ps * q > p * qs) ? ps * q - p * qs : p * qs - ps * q;
+            uint64_t e1 = (p1 * q > p * q1) ? p1 * q - p * q1 : p * q1 - p1 * q;
+            if (es * q1 < e1 * qs) {
+                p1 = ps;
+                q1 = qs;
+            }
+            break;
+        }
+        uint64_t p2 = p0 + a * p1;
+        p0 = p1;
+        q0 = q1;
+        p1 = p2;
+        q1 = q2;
+        uint64_t t = n - a * d;
+        n = d;
+        d = t;
+    }
+
+    *num = p1;
+    *den = q1;
+}
+
+void audio_rate_cts_n(uint32_t pixel_clock, uint32_t rate, uint32_t *cts, uint32_t *n)
+{
+    // 128 * rate = pixel_clock * N / CTS, so N / CTS is p / q
+    uint64_t p = 128ull * rate;
+    uint64_t q = pixel_clock;
+    uint64_t g = gcd(p, q);
+    p /= g;
+    q /= g;
+
+    uint32_t n_min = (128ull * rate + 1499) / 1500;
+    uint32_t n_max = (128ull * rate) / 300;
+    uint32_t n_ideal = (128ull * rate) / 1000;
+
+    uint64_t best_n;
+    uint64_t best_cts;
+    if (p <= n_max && q <= ACR_MAX) {
+        // Exact, as close to the recommended N as the multiples go
+        uint64_t k = (n_ideal + p / 2) / p;
+        k = MAX(k, 1);
+        while (k > 1 && (k * p > n_max || k * q > ACR_MAX)) {
+            k--;
+        }
+        best_n = k * p;
+        best_cts = k * q;
+    } else {
+        // As close as a CTS that keeps N below n_max gets
+        uint64_t max_cts = MIN((uint64_t) n_max * q / p, ACR_MAX);
+        best_fraction(p, q, max_cts, &best_n, &best_cts);
+    }
+
+    // Too small an N, same fraction with larger numbers
+    if (best_n < n_min) {
+        uint64_t k = (n_min + best_n - 1) / best_n;
+        if (k * best_cts <= ACR_MAX) {
+            best_n *= k;
+            best_cts *= k;
+        }
+    }
+
+    *cts = best_cts;
+    *n = best_n;
+    state.stats.cts = best_cts;
+    state.stats.n = best_n;
+}
+
+const audio_rate_stats_t *audio_rate_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,122 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file audio_rate.h
+ * @brief Follow the N64's audio rate, and the HDMI audio clock for it.
+ *
+ * The N64's AI runs at the VI clock divided by the game's dacrate, 32006 Hz
+ * for a game asking for 32 kHz on NTSC, and games change it between scenes.
+ * The output rate is g_config.audio_out_sample_rate otherwise, and frames
+ * are repeated or dropped to make up the difference.
+ *
+ * The audio PIO DMA counts down from 0xffffffff, one per I2S frame, instead
+ * of restarting every frame. Once per captured frame its count is read with
+ * the microsecond timer, and every AUDIO_RATE_WINDOW_US the rate is worked
+ * out to the Hz. When it is more than AUDIO_RATE_TOLERANCE_PPM away from the
+ * output rate for two windows in a row, the output rate follows it. Rates
+ * outside AUDIO_RATE_MIN_HZ to AUDIO_RATE_MAX_HZ, which an HDMI sink won't
+ * take, go back to the configured rate.
+ *
+ * With AUDIO_DIRECT_DMA libdvi sends every frame the DMA writes, and at the
+ * configured rate it would read them too fast. A rate below
+ * AUDIO_RATE_MIN_HZ is sent with every frame repeated instead, at the
+ * smallest multiple of the rate that HDMI takes, see audio_rate_get_repeat().
+ *
+ * Until the first rate is known, the windows are AUDIO_RATE_FIRST_WINDOW_US
+ * long. The first one with audio may have started part way in, so the one
+ * after it sets the output rate straight away, without a second window to
+ * agree.
+ *
+ * audio_rate_cts_n() gives the Audio Clock Regeneration values for any rate
+ * in Hz, N / CTS being 128 * rate / pixel clock exactly, or as close as 20
+ * bit values with N in the range HDMI allows get.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "pico/types.h"
+
+#if AUDIO_RATE_DETECT && AUDIO_ASRC
+#error "AUDIO_RATE_DETECT is for the timer paced copy, AUDIO_ASRC resamples to audio_out_sample_rate"
+#endif
+
+/// Time each measurement of the N64's rate takes, good to about 1 Hz.
+#define AUDIO_RATE_WINDOW_US 1000000
+
+/// Time of the measurements until the first rate is known, good to about 4 Hz.
+#define AUDIO_RATE_FIRST_WINDOW_US 250000
+
+/// Smallest difference from the output rate that is followed, 4.8 Hz at 32 kHz.
+#define AUDIO_RATE_TOLERANCE_PPM 150
+
+/// Rates sent, just below the N64's 32 kHz up to 96 kHz.
+#define AUDIO_RATE_MIN_HZ 31000
+#define AUDIO_RATE_MAX_HZ 97000
+
+/**
+ * @struct audio_rate_stats
+ * @brief Measured and followed rates.
+ */
+typedef struct audio_rate_stats {
+    uint32_t measured; ///< The N64's rate in Hz, last window, 0 while there is no audio.
+    uint32_t rate;     ///< The output rate in Hz.
+    uint32_t changes;  ///< Times the output rate changed, since boot.
+    uint32_t cts;      ///< CTS of the last audio_rate_cts_n().
+    uint32_t n;        ///< N of the last audio_rate_cts_n().
+    uint32_t repeat;   ///< Times each N64 frame is sent, see audio_rate_get_repeat().
+} audio_rate_stats_t;
+
+/**
+ * @brief Initialize the rate detection.
+ * @param dma_chan The DMA channel reading the audio PIO, counting down from 0xffffffff.
+ * @param default_rate The output rate in Hz until the N64's is known, and outside the followed rates.
+ */
+void audio_rate_init(uint dma_chan, uint32_t default_rate);
+
+/**
+ * @brief Measure the N64's rate (core 0).
+ *
+ * Called once per captured frame.
+ * @return True when the output rate has changed, see audio_rate_get().
+ */
+bool audio_rate_update(void);
+
+/**
+ * @brief Get the output rate.
+ * @return The rate in Hz, 0 before audio_rate_init().
+ */
+uint32_t audio_rate_get(void);
+
+/**
+ * @brief Get how many times each N64 frame is sent at the output rate.
+ *
+ * More than 1 only with AUDIO_DIRECT_DMA, for N64 rates below
+ * AUDIO_RATE_MIN_HZ, the output rate being that many times the N64's.
+ * @return The repeat count, 1 or more.
+ */
+uint32_t audio_rate_get_repeat(void);
+
+/**
+ * @brief Get the Audio Clock Regeneration values for a rate.
+ *
+ * N is near the recommended 128 * rate / 1000, and between 128 * rate / 1500
+ * and 128 * rate / 300.
+ * @param pixel_clock The TMDS character rate in Hz.
+ * @param rate The audio rate in Hz.
+ * @param cts The CTS, out.
+ * @param n The N, out.
+ */
+void audio_rate_cts_n(uint32_t pixel_clock, uint32_t rate, uint32_t *cts, uint32_t *n);
+
+/**
+ * @brief Get the measured and followed rates.
+ * @return A pointer to the rates.
+ */
+const audio_rate_stats_t *audio_rate_get_stats(void);
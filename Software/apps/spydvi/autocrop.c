@@ -0,0 +1,196 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "autocrop.h"
+#include "framebuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+// Every AUTOCROP_ROW_STEP-th skipped row is scanned, starting at a different one each frame
+#define AUTOCROP_ROW_STEP 4
+
+// Histogram bins, in VI pixels and VI rows
+#define AUTOCROP_X_BIN  4
+#define AUTOCROP_X_BINS 256
+#define AUTOCROP_Y_BIN  2
+#define AUTOCROP_Y_BINS 352
+
+// VI pixels captured per line
+#define AUTOCROP_WIDTH (FRAME_WIDTH * FRAME_HORIZONTAL_REPEAT)
+
+static_assert(AUTOCROP_WINDOW_FRAMES <= UINT8_MAX, "Histogram counts are 8 bit");
+
+autocrop_stats_t g_autocrop;
+
+static struct {
+    bool pal;
+    uint32_t phase;
+    uint32_t frames;
+    uint32_t frames_with_content;
+
+    // Edges of the current frame
+    uint32_t left;
+    uint32_t right;
+    uint32_t top;
+    uint32_t bottom;
+
+    uint8_t hist_left[AUTOCROP_X_BINS];
+    uint8_t hist_right[AUTOCROP_X_BINS];
+    uint8_t hist_top[AUTOCROP_Y_BINS];
+    uint8_t hist_bottom[AUTOCROP_Y_BINS];
+
+    bool candidate_valid;
+    int32_t candidate_x;
+    int32_t candidate_y;
+
+    bool crop_valid;
+    uint32_t crop_x;
+    uint32_t crop_y;
+} state = {
+    .left = UINT32_MAX,
+    .top = UINT32_MAX,
+};
+
+static void reset_frame(void)
+{
+    state.left = UINT32_MAX;
+    state.right = 0;
+    state.top = UINT32_MAX;
+    state.bottom = 0;
+}
+
+static void reset_window(void)
+{
+    state.frames = 0;
+    state.frames_with_content = 0;
+    memset(state.hist_left, 0, sizeof(state.hist_left));
+    memset(state.hist_right, 0, sizeof(state.hist_right));
+    memset(state.hist_top, 0, sizeof(state.hist_top));
+    memset(state.hist_bottom, 0, sizeof(state.hist_bottom));
+}
+
+// First and last bins that at least min_count frames fell into
+static bool hist_range(const uint8_t *hist, uint32_t bins, uint32_t min_count, uint32_t *first, uint32_t *last)
+{
+    uint32_t i = 0;
+    while (i < bins && hist[i] < min_count) {
+        i++;
+    }
+    if (i == bins) {
+        return false;
+    }
+    *first = i;
+
+    i = bins - 1;
+    while (hist[i] < min_count) {
+        i--;
+    }
+    *last = i;
+
+    return true;
+}
+
+static void update_crop(uint32_t frame_height)
+{
+    // Edges that at least 1/8 of the frames with a picture agree on,
+    // so a few frames with a stray pixel don't count
+    uint32_t min_count = MAX(state.frames_with_content / 8, 1);
+    uint32_t unused;
+    uint32_t left, right, top, bottom;
+    if (!hist_range(state.hist_left, AUTOCROP_X_BINS, min_count, &left, &unused) ||
+        !hist_range(state.hist_right, AUTOCROP_X_BINS, min_count, &unused, &right) ||
+        !hist_range(state.hist_top, AUTOCROP_Y_BINS, min_count, &top, &unused) ||
+        !hist_range(state.hist_bottom, AUTOCROP_Y_BINS, min_count, &unused, &bottom)) {
+        return;
+    }
+
+    g_autocrop.left = left * AUTOCROP_X_BIN;
+    g_autocrop.right = (right + 1) * AUTOCROP_X_BIN;
+    g_autocrop.top = top * AUTOCROP_Y_BIN;
+    g_autocrop.bottom = bottom * AUTOCROP_Y_BIN + (AUTOCROP_Y_BIN - 1);
+    if (g_autocrop.right <= g_autocrop.left || g_autocrop.bottom <= g_autocrop.top) {
+        return;
+    }
+
+    // Center the picture, each captured line takes two VI rows
+    int32_t x = (int32_t) (g_autocrop.left + g_autocrop.right - AUTOCROP_WIDTH) / 2;
+    int32_t y = (int32_t) (g_autocrop.top + g_autocrop.bottom + 1) / 2 - (int32_t) frame_height;
+    x = MAX(x, 0);
+    y = MAX(y, 0);
+
+    // Two windows in a row have to agree
+    bool confirmed = state.candidate_valid &&
+                     abs(x - state.candidate_x) <= AUTOCROP_HYSTERESIS &&
+                     abs(y - state.candidate_y) <= AUTOCROP_HYSTERESIS;
+    state.candidate_valid = true;
+    state.candidate_x = x;
+    state.candidate_y = y;
+
+    bool changed = !state.crop_valid ||
+                   abs(x - (int32_t) state.crop_x) > AUTOCROP_HYSTERESIS ||
+                   abs(y - (int32_t) state.crop_y) > AUTOCROP_HYSTERESIS;
+    if (confirmed && changed) {
+        state.crop_valid = true;
+        state.crop_x = x;
+        state.crop_y = y;
+        g_autocrop.updates++;
+    }
+}
+
+bool __not_in_flash_func(autocrop_probe)(uint32_t row)
+{
+    return g_config.autocrop && (row % 2 != 0) && ((row / 2) % AUTOCROP_ROW_STEP == state.phase);
+}
+
+void __not_in_flash_func(autocrop_row)(uint32_t row, uint32_t left, uint32_t right)
+{
+    state.left = MIN(state.left, left);
+    state.right = MAX(state.right, right);
+    state.top = MIN(state.top, row);
+    state.bottom = MAX(state.bottom, row);
+}
+
+void autocrop_frame_end(bool pal, uint32_t frame_height, uint32_t *crop_x, uint32_t *crop_y)
+{
+    if (pal != state.pal) {
+        // Different crop defaults and picture, start over
+        state.pal = pal;
+        state.candidate_valid = false;
+        state.crop_valid = false;
+        reset_window();
+        reset_frame();
+    }
+
+    if (g_config.autocrop) {
+        if (state.top != UINT32_MAX) {
+            state.hist_left[MIN(state.left / AUTOCROP_X_BIN, AUTOCROP_X_BINS - 1)]++;
+            state.hist_right[MIN((state.right - 1) / AUTOCROP_X_BIN, AUTOCROP_X_BINS - 1)]++;
+            state.hist_top[MIN(state.top / AUTOCROP_Y_BIN, AUTOCROP_Y_BINS - 1)]++;
+            state.hist_bottom[MIN(state.bottom / AUTOCROP_Y_BIN, AUTOCROP_Y_BINS - 1)]++;
+            state.frames_with_content++;
+        }
+        reset_frame();
+        state.phase = (state.phase + 1) % AUTOCROP_ROW_STEP;
+
+        if (++state.frames >= AUTOCROP_WINDOW_FRAMES) {
+            // Mostly black frames, e.g. while loading, say nothing about the picture
+            if (state.frames_with_content >= AUTOCROP_WINDOW_FRAMES / 4) {
+                update_crop(frame_height);
+            }
+            reset_window();
+        }
+
+        if (state.crop_valid) {
+            *crop_x = state.crop_x;
+            *crop_y = state.crop_y;
+        }
+    }
+
+    g_autocrop.crop_x = *crop_x;
+    g_autocrop.crop_y = *crop_y;
+}
@@ -0,0 +1,70 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file autocrop.h
+ * @brief Find the active picture area and crop around it.
+ *
+ * Some of the rows that capture skips anyway are scanned for the first and
+ * last pixel that isn't black, a different subset every frame. Each frame
+ * adds its left, right, top and bottom edges to histograms, and every
+ * AUTOCROP_WINDOW_FRAMES frames the edges most frames agree on give a crop
+ * that centers the picture. A new crop is applied once two windows in a row
+ * agree on it, and it is more than AUTOCROP_HYSTERESIS off the current one.
+ *
+ * With LINE_BLEND the rows inside the picture are blended rather than
+ * skipped, so only the rows above and below it are scanned.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * @struct autocrop_stats
+ * @brief The crop in use and the last measured picture area.
+ */
+typedef struct autocrop_stats {
+    uint32_t crop_x;  ///< VI pixels cropped on the left, in use.
+    uint32_t crop_y;  ///< VI rows cropped on the top, in use.
+    uint32_t left;    ///< First VI pixel of the picture, last window.
+    uint32_t right;   ///< VI pixel after the picture, last window.
+    uint32_t top;     ///< First VI row of the picture, last window.
+    uint32_t bottom;  ///< Last VI row of the picture, last window.
+    uint32_t updates; ///< Number of times a measured crop was applied, since boot.
+} autocrop_stats_t;
+
+/// The crop in use and the last measured area, shown in the OSD.
+extern autocrop_stats_t g_autocrop;
+
+/**
+ * @brief Check if a skipped row should be scanned (core 0).
+ * @param row The VI row.
+ * @return true if the row should be scanned and passed to autocrop_row().
+ */
+bool autocrop_probe(uint32_t row);
+
+/**
+ * @brief Add a scanned row that isn't all black (core 0).
+ * @param row The VI row.
+ * @param left The first VI pixel that isn't black, counting like crop_x.
+ * @param right The VI pixel after the last one that isn't black.
+ */
+void autocrop_row(uint32_t row, uint32_t left, uint32_t right);
+
+/**
+ * @brief Update the measurement and the crop (core 0).
+ *
+ * Called once per captured frame, with the default crop of the video
+ * standard. Starts over when the standard changes.
+ * @param pal true if the frame was PAL.
+ * @param frame_height The number of lines captured per frame.
+ * @param crop_x The default crop, replaced by the measured one once there is one.
+ * @param crop_y The default crop, replaced by the measured one once there is one.
+ */
+void autocrop_frame_end(bool pal, uint32_t frame_height, uint32_t *crop_x, uint32_t *crop_y);
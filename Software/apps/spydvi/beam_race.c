@@ -0,0 +1,64 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "beam_race.h"
+#include "genlock.h"
+
+#include "pico/stdlib.h"
+
+// Frame buffer lines are handed to core 1 this many lines before they are shown,
+// see core1_scanline_callback
+#define BEAM_RACE_PIPELINE_LINES 2
+
+static struct {
+    volatile uint32_t captured;
+    uint32_t late_lines;
+    beam_race_stats_t stats;
+} state;
+
+void beam_race_init(struct dvi_inst *inst)
+{
+    genlock_init(inst);
+    state.captured = 0;
+}
+
+void __not_in_flash_func(beam_race_capture_start)(void)
+{
+    // DVI line where frame buffer line 0 is handed to the encoder
+    int handover = -BEAM_RACE_PIPELINE_LINES * DVI_VERTICAL_REPEAT;
+
+    // Lock the output so that happens BEAM_RACE_LAG_LINES from now
+    int lag = BEAM_RACE_LAG_LINES * DVI_VERTICAL_REPEAT;
+    lag -= genlock_update(handover - lag);
+
+    state.captured = 0;
+    state.stats.lag = lag / DVI_VERTICAL_REPEAT;
+}
+
+void __not_in_flash_func(beam_race_capture_line)(uint32_t lines)
+{
+    state.captured = lines;
+}
+
+void __not_in_flash_func(beam_race_scanline)(uint32_t y)
+{
+    if (y == 0) {
+        state.stats.late_lines = state.late_lines;
+        state.late_lines = 0;
+    }
+
+    // Like late_scanline_ctr in libdvi: the output is ahead of the capture and
+    // this line will show the previous frame
+    if (y >= state.captured) {
+        state.late_lines++;
+        state.stats.late_total++;
+    }
+}
+
+const beam_race_stats_t *beam_race_get_stats(void)
+{
+    return &state.stats;
+}
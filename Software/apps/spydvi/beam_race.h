@@ -0,0 +1,75 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file beam_race.h
+ * @brief Low latency output by racing the capture beam.
+ *
+ * With a single frame buffer, a line is sent out some time after it has been
+ * captured, anywhere between no time at all and a full frame depending on
+ * the phase of the DVI output. This keeps the DVI output a fixed number of
+ * lines behind the capture, using the genlock with a target phase just ahead
+ * of the first captured line.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+#if BEAM_RACE && (FRAMEBUF_COUNT != 1)
+#error "BEAM_RACE requires FRAMEBUF_COUNT 1"
+#endif
+
+#if BEAM_RACE && LINE_BLEND
+#error "BEAM_RACE sends lines out before LINE_BLEND has blended them, disable LINE_BLEND"
+#endif
+
+#if BEAM_RACE && GENLOCK
+#error "BEAM_RACE locks the output with its own target phase, disable GENLOCK"
+#endif
+
+/**
+ * @struct beam_race_stats
+ * @brief Beam racing state, updated every frame.
+ */
+typedef struct beam_race_stats {
+    int32_t lag;         ///< Lines from capturing the first line until it was handed to the DVI encoder, last frame.
+    uint32_t late_lines; ///< Lines handed to the DVI encoder before they were captured, last DVI frame.
+    uint32_t late_total; ///< Lines handed to the DVI encoder before they were captured, since boot.
+} beam_race_stats_t;
+
+/**
+ * @brief Initialize beam racing, and the genlock it uses.
+ * @param inst The DVI instance whose timing is adjusted.
+ */
+void beam_race_init(struct dvi_inst *inst);
+
+/**
+ * @brief Measure the lag and steer the DVI output (core 0).
+ *
+ * Called right before the first line of a frame is captured.
+ */
+void beam_race_capture_start(void);
+
+/**
+ * @brief Mark lines as captured (core 0).
+ * @param lines Number of frame buffer lines captured so far in this frame.
+ */
+void beam_race_capture_line(uint32_t lines);
+
+/**
+ * @brief Account a line handed to the DVI encoder (core 1).
+ * @param y The frame buffer line.
+ */
+void beam_race_scanline(uint32_t y);
+
+/**
+ * @brief Get the beam racing state.
+ * @return A pointer to the state.
+ */
+const beam_race_stats_t *beam_race_get_stats(void);
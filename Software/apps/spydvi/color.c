@@ -0,0 +1,97 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "color.h"
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "tmds_encode.h"
+#include "rgb888.h"
+#include "palette.h"
+#include "line_cache.h"
+
+#if FRAMEBUF_BPP == 32
+#define COLOR_TABLE_LEVELS RGB888_TABLE_LEVELS
+#elif FRAMEBUF_PALETTE
+#define COLOR_TABLE_LEVELS 128
+#else
+#define COLOR_TABLE_LEVELS 64
+
+#if !TMDS_TABLE_PER_CHANNEL
+#error "Colour correction needs TMDS_TABLE_PER_CHANNEL, see CMakeLists.txt"
+#endif
+#endif
+
+// Limited range RGB, as expected by most TVs for the CEA video modes
+#define LIMITED_BLACK 16
+#define LIMITED_WHITE 235
+
+const char *const color_gamma_names[COLOR_GAMMA_COUNT] = {
+    "0.5", "0.6", "0.7", "0.8", "0.9", "1.0", "1.1", "1.2",
+    "1.3", "1.4", "1.5", "1.6", "1.7", "1.8", "1.9", "2.0",
+};
+
+const char *const color_range_names[COLOR_RANGE_COUNT] = {
+    [COLOR_RANGE_FULL] = "Full",
+    [COLOR_RANGE_LIMITED] = "Limited",
+};
+
+#if !FULLRES
+// Output level of each table index, index i being input level i * 4 like
+// the table generated by tmds_table_gen.py, or i * 2 with 7 bit channels
+// and palette colours. With the default settings every level comes out
+// unchanged.
+static void color_levels(uint8_t *levels, uint32_t gain)
+{
+    uint32_t gamma = MIN(g_config.color_gamma, COLOR_GAMMA_COUNT - 1);
+    uint32_t black = MIN(g_config.color_black_level, COLOR_BLACK_LEVEL_MAX);
+
+    for (int i = 0; i < COLOR_TABLE_LEVELS; i++) {
+        float x = (i * (256 / COLOR_TABLE_LEVELS)) / 255.0f;
+        if (gamma != COLOR_GAMMA_DEFAULT) {
+            x = powf(x, 10.0f / (gamma + 5));
+        }
+        x = MIN(x * gain / 100.0f, 1.0f);
+
+        float level = black + x * (255 - black);
+        if (g_config.color_range == COLOR_RANGE_LIMITED) {
+            level = LIMITED_BLACK + level * (LIMITED_WHITE - LIMITED_BLACK) / 255.0f;
+        }
+        levels[i] = lroundf(level);
+    }
+}
+#endif
+
+void color_apply(void)
+{
+    // With FULLRES there are no pixel doubled tables to rebuild, linking them
+    // in would overflow scratch X, see TMDS_TABLE_PER_CHANNEL
+#if !FULLRES
+    // Gains in the order of the TMDS channels
+    const uint32_t gains[3] = {
+        g_config.color_gain_blue,
+        g_config.color_gain_green,
+        g_config.color_gain_red,
+    };
+
+    for (uint channel = 0; channel < 3; channel++) {
+        uint8_t levels[COLOR_TABLE_LEVELS];
+        color_levels(levels, gains[channel]);
+#if FRAMEBUF_BPP == 32
+        rgb888_set_levels(channel, levels);
+#elif FRAMEBUF_PALETTE
+        palette_encode_set_levels(channel, levels);
+#else
+        tmds_table_set_levels(channel, levels);
+#endif
+    }
+
+#if TMDS_LINE_CACHE
+    // Lines encoded with the old tables
+    line_cache_invalidate();
+#endif
+#endif
+}
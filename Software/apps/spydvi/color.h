@@ -0,0 +1,53 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file color.h
+ * @brief Colour correction in the TMDS tables.
+ *
+ * The pixel doubled TMDS encode looks each colour channel up in a table of
+ * 64 symbol pairs, or 128 with FRAMEBUF_BPP 32. Gamma, black level, per
+ * channel gain and the output range are applied by rebuilding those tables,
+ * one per channel, so the frame buffer keeps the captured colours and the
+ * encode costs the same. With FRAMEBUF_PALETTE the 128 levels of the palette
+ * colours are corrected the same way, and every palette is rebuilt from
+ * them. Only the top 7 bits of each output level make it through, see
+ * tmds_table_from_levels(). Not applied with FULLRES, which has its own
+ * tables. With FRAMEBUF_BPP 32 the OSD is not shown, so the settings keep
+ * their defaults.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+/// Number of gamma settings, 0.5 to 2.0 in steps of 0.1.
+#define COLOR_GAMMA_COUNT 16
+
+/// Gamma setting of 1.0, the identity.
+#define COLOR_GAMMA_DEFAULT 5
+
+/// Largest black level, in 8 bit output levels.
+#define COLOR_BLACK_LEVEL_MAX 32
+
+/// Largest gain of a channel, in percent.
+#define COLOR_GAIN_MAX 200
+
+/// Names of the gamma settings.
+extern const char *const color_gamma_names[COLOR_GAMMA_COUNT];
+
+/// Names of the output ranges, indexed by @ref color_range_t.
+extern const char *const color_range_names[COLOR_RANGE_COUNT];
+
+/**
+ * @brief Rebuild the TMDS tables from the color settings in g_config.
+ *
+ * Called at boot and from the OSD when a setting changes. Can be called
+ * while core 1 is encoding, a line may then come out half corrected. Does
+ * nothing with FULLRES, where the OSD has no Color menu.
+ */
+void color_apply(void);
@@ -5,6 +5,7 @@
  */
 
 #include "config.h"
+#include "color.h"
 #include <string.h>
 
 config_t g_config;
@@ -14,16 +15,49 @@ config_t g_config;
 #define CONFIG_DEFAULT_SAMPLE_RATE_HZ SAMPLE_RATE_96000_HZ
 #endif
 
-// Allow for compile-time configuration of default color depth
-#ifndef CONFIG_DEFAULT_COLOR_DEPTH
+// Allow for compile-time configuration of default color depth, the 32 bpp
+// frame buffer only has one
+#if FRAMEBUF_BPP == 32
+#undef CONFIG_DEFAULT_COLOR_DEPTH
+#define CONFIG_DEFAULT_COLOR_DEPTH DVI_RGB_888
+#elif !defined(CONFIG_DEFAULT_COLOR_DEPTH)
 #define CONFIG_DEFAULT_COLOR_DEPTH DVI_RGB_555
 #endif
 
+// Allow for compile-time configuration of default video modes
+#ifndef CONFIG_DEFAULT_VIDEO_MODE
+#define CONFIG_DEFAULT_VIDEO_MODE VIDEO_MODE_640x480P60
+#endif
+
+#ifndef CONFIG_DEFAULT_VIDEO_MODE_PAL
+#define CONFIG_DEFAULT_VIDEO_MODE_PAL VIDEO_MODE_640x576P50
+#endif
+
+// Allow for compile-time configuration of the dither filter
+#ifndef CONFIG_DEFAULT_DEDITHER
+#define CONFIG_DEFAULT_DEDITHER 0
+#endif
+
+// Allow for compile-time configuration of the auto crop
+#ifndef CONFIG_DEFAULT_AUTOCROP
+#define CONFIG_DEFAULT_AUTOCROP 0
+#endif
+
 static config_t default_config = {
     .magic1 = CONFIG_MAGIC1,
 
     .audio_out_sample_rate = CONFIG_DEFAULT_SAMPLE_RATE_HZ,
     .dvi_color_mode = CONFIG_DEFAULT_COLOR_DEPTH,
+    .video_mode = CONFIG_DEFAULT_VIDEO_MODE,
+    .video_mode_pal = CONFIG_DEFAULT_VIDEO_MODE_PAL,
+    .dedither = CONFIG_DEFAULT_DEDITHER,
+    .autocrop = CONFIG_DEFAULT_AUTOCROP,
+    .color_gamma = COLOR_GAMMA_DEFAULT,
+    .color_black_level = 0,
+    .color_gain_red = 100,
+    .color_gain_green = 100,
+    .color_gain_blue = 100,
+    .color_range = COLOR_RANGE_FULL,
 
     .magic2 = CONFIG_MAGIC2,
 };
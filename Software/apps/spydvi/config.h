@@ -22,9 +22,182 @@
 /// Default crop Y parameter for PAL.
 #define DEFAULT_CROP_Y_PAL  (90)
 
+/// Default crop Y parameter for PAL, with 288 lines output (see PAL_50HZ).
+#define DEFAULT_CROP_Y_PAL_50HZ (42)
+
 /// Default crop Y parameter for NTSC.
 #define DEFAULT_CROP_Y_NTSC (25)
 
+/**
+ * @brief Capture the VI bus with the packed PIO program.
+ *
+ * When set to 1, the n64_packed program drops every second pixel and packs
+ * two RGB555 pixels per FIFO word, so core 0 handles 1/4 of the words. The
+ * crop X parameters are then rounded down to multiples of 4 VI pixels, and
+ * green only has 5 bits in both color modes.
+ * When set to 0, the n64 program captures every VI word unchanged.
+ */
+#define VIDEO_CAPTURE_PACKED 0
+
+/**
+ * @brief Convert captured pixels with the help of interp1 on core 0.
+ *
+ * When set to 1, interp1 extracts two of the three color channels of a VI
+ * word and combines them, so only one channel is shifted and masked in
+ * software. The capture loop owns interp1 on core 0, anything else using it
+ * there has to save and restore it. Off until convert_cycles under
+ * DIAGNOSTICS shows it is faster than the plain shifts and masks on the
+ * RP2040; host/interpcheck checks that both give the same pixels.
+ * Not used with VIDEO_CAPTURE_PACKED.
+ */
+#define VIDEO_CONVERT_INTERP 0
+
+/**
+ * @brief Blend the skipped odd rows into the captured ones.
+ *
+ * Every second VI row is dropped by default. When set to 1, it is captured as
+ * well and averaged with the row above, which removes shimmer on thin
+ * horizontal lines, at the cost of converting twice the rows. Not used while
+ * interlaced fields are woven. Can't be combined with BEAM_RACE or FULLRES,
+ * where a line is sent out as soon as its first row is in.
+ */
+#define LINE_BLEND 0
+
+/**
+ * @brief Number of frame buffers.
+ *
+ * 1 captures straight into the buffer being shown, which may tear. With 2 or
+ * more, frames are page flipped on VSYNC. Together they have to fit in the
+ * RAM of one 16 bpp buffer, so more than one requires FRAMEBUF_BPP 8.
+ */
+#define FRAMEBUF_COUNT 1
+
+/**
+ * @brief Bits per pixel of the frame buffers, 16 (RGB565), 8 (RGB332) or 32.
+ *
+ * 32 keeps all 7 bits of each VI color channel for DVI_RGB_888 output, in
+ * two 16 bit planes per line: red and green, then blue. A frame doesn't fit
+ * in RAM, so like FULLRES only a ring of RGB888_RING_LINES lines is kept and
+ * the output races the capture. Requires BEAM_RACE 1, VIDEO_CAPTURE_PACKED 0,
+ * FULLRES 0 and DEINTERLACE 0. The OSD is not shown in this mode.
+ */
+#define FRAMEBUF_BPP 16
+
+/// Number of captured lines kept with FRAMEBUF_BPP 32, a power of two larger than the beam racing lag.
+#define RGB888_RING_LINES 16
+
+/**
+ * @brief Use 8 bpp pixels as indices into a palette built for each frame.
+ *
+ * When set to 1 with FRAMEBUF_BPP 8, the colors of every second frame are
+ * counted, and a palette of the most used ones is built while the next frame
+ * is captured, see palette.h. The buffers take half the RAM of RGB565, with
+ * much less banding than RGB332, plus about 30 KB for the histogram, the
+ * lookups and the TMDS tables of each palette. Requires FRAMEBUF_COUNT 2 or
+ * more, VIDEO_CAPTURE_PACKED 0, LINE_BLEND 0 and DEINTERLACE 0.
+ */
+#define FRAMEBUF_PALETTE 0
+
+/**
+ * @brief Reuse the TMDS symbols of lines that repeat.
+ *
+ * When set to 1, core 1 keeps the last few encoded lines, and sends a line
+ * that matches one of them without encoding it again, see line_cache.h.
+ * Looking a line up costs a fraction of encoding it. For FRAMEBUF_BPP 8 and
+ * 16, without FULLRES and FRAMEBUF_PALETTE.
+ */
+#define TMDS_LINE_CACHE 0
+
+/// Encoded lines kept besides the ones being sent, 3.75 KB of TMDS symbols each plus the line.
+#define LINE_CACHE_LINES 4
+
+/**
+ * @brief Let core 1 walk whole frames instead of being handed each line.
+ *
+ * When set to 1, the DMA IRQ queues one frame buffer per frame, and
+ * dvi_framebuf_main_16bpp or _8bpp find its lines by pointer arithmetic,
+ * which takes the queue round trips out of the IRQ on every other line.
+ * A video mode switch waits for the frame being encoded to end. Not with
+ * BEAM_RACE, which follows each line, or with the other encoders
+ * (FRAMEBUF_PALETTE, TMDS_LINE_CACHE).
+ */
+#define DVI_FRAMEBUF_WORKER 0
+
+/**
+ * @brief Race the beam for the lowest possible latency.
+ *
+ * When set to 1, the DVI output is genlocked to the capture so that each
+ * line is sent out BEAM_RACE_LAG_LINES lines after being captured. Requires
+ * FRAMEBUF_COUNT 1, and replaces GENLOCK.
+ */
+#define BEAM_RACE 0
+
+/// Target lag in frame buffer lines between capturing a line and sending it out.
+#define BEAM_RACE_LAG_LINES 8
+
+/**
+ * @brief Capture and output every VI pixel, 640 pixels per line.
+ *
+ * When set to 1, lines are TMDS encoded at full resolution with the lanes
+ * split between the cores: core 1 encodes blue and green, core 0 encodes red
+ * right after capturing the line. A full resolution frame doesn't fit in RAM,
+ * so only a ring of FULLRES_RING_LINES lines is kept and the output races the
+ * capture. Requires BEAM_RACE 1, VIDEO_CAPTURE_PACKED 0 and FRAMEBUF_BPP 16.
+ * The OSD is not shown in this mode.
+ */
+#define FULLRES 0
+
+/// Number of captured lines kept with FULLRES, a power of two larger than the beam racing lag.
+#define FULLRES_RING_LINES 16
+
+/**
+ * @brief Weave interlaced (480i) fields into full height frames.
+ *
+ * When set to 1, interlaced video is detected from the row counts of
+ * consecutive fields alternating by one. The two fields are then captured into
+ * alternate lines of the frame buffer, and every line is shown once instead of
+ * twice. Progressive video is unaffected. Both fields together take twice the
+ * lines, so this requires FRAMEBUF_BPP 8 and FRAMEBUF_COUNT 1, and it can't be
+ * combined with BEAM_RACE or FULLRES.
+ */
+#define DEINTERLACE 0
+
+/// Fields in a row that have to agree before switching between woven and progressive.
+#define DEINTERLACE_DETECT_FIELDS 4
+
+/// Set to 1 if the woven lines are in the wrong order, i.e. the longer field is the top one.
+#define DEINTERLACE_SWAP_FIELDS 0
+
+/**
+ * @brief Genlock the DVI output to the captured frames.
+ *
+ * When set to 1, the DVI vertical front porch is trimmed every frame so the
+ * output runs at the N64 frame rate, with a fixed phase. This avoids dropped
+ * and repeated frames. Only locks when the frame rates are within
+ * GENLOCK_MAX_ADJUST lines per frame of each other, i.e. NTSC.
+ */
+#define GENLOCK 0
+
+/**
+ * @brief Output line at the captured VSYNC, relative to the first active line.
+ *
+ * Frame buffer line 0 is handed to the DVI encoder at line -4, so a flipped
+ * frame is picked up right away.
+ */
+#define GENLOCK_TARGET_LINE (-8)
+
+/// Maximum number of lines the DVI vertical front porch is stretched by per frame.
+#define GENLOCK_MAX_ADJUST 8
+
+/// Phase error in lines that is considered locked.
+#define GENLOCK_LOCK_LINES 2
+
+/// Frames per auto crop measurement window, about a second.
+#define AUTOCROP_WINDOW_FRAMES (64)
+
+/// Auto crop changes of up to this many VI pixels or rows are ignored.
+#define AUTOCROP_HYSTERESIS (4)
+
 /// Number of rows for PAL.
 #define ROWS_PAL            (615)
 
@@ -45,8 +218,26 @@
 /// Voltage regulator selection.
 #define VREG_VSEL VREG_VOLTAGE_1_20
 
-/// DVI timing configuration.
-#define DVI_TIMING dvi_timing_640x480p_60hz
+/**
+ * @brief Output PAL at 50 Hz.
+ *
+ * When set to 1, the output switches to the video_mode_pal mode while a PAL
+ * console is detected, so 50 Hz games don't judder on a 60 Hz output and all
+ * 288 lines are shown. The frame buffers grow to 288 lines.
+ * When set to 0, PAL is output in the video_mode mode, cropped to 240 lines.
+ */
+#define PAL_50HZ 1
+
+/// Number of frames the other video standard has to be detected before the output switches.
+#define DVI_TIMING_SWITCH_FRAMES (8)
+
+/**
+ * @brief Maximum flash clock in kHz.
+ *
+ * The flash runs at clk_sys divided by an even number. When a video mode
+ * changes clk_sys, the divider is adjusted to stay below this.
+ */
+#define FLASH_MAX_KHZ (133000)
 
 /// UART config on the last GPIOs
 /// UART transmission pin.
@@ -117,6 +308,56 @@
 #define AUDIO_ENABLED 1
 // #define AUDIO_ENABLED 0
 
+/**
+ * @brief Resample the N64 audio instead of picking the latest frame.
+ *
+ * When set to 1, every I2S frame is captured into a ring and resampled to
+ * audio_out_sample_rate with a windowed sinc filter on core 0, see asrc.h.
+ * This takes about 8% of core 0 at 48 kHz, on the rows the capture skips,
+ * and frees the DMA timer. The output rate should be at least the N64's,
+ * like the default 48 kHz.
+ * When set to 0, a timer paced DMA copies the latest frame at the output
+ * rate, repeating or dropping frames.
+ */
+#define AUDIO_ASRC 0
+
+/**
+ * @brief Steer the audio DMA timer to keep libdvi half a ring behind it.
+ *
+ * When set to 1, the gap between the timer paced copy and libdvi's read
+ * position is measured every captured frame, and the DMA timer is sped up or
+ * slowed down by a few ppm to hold it at half the audio buffer, see
+ * audio_drift.h. Needed with GENLOCK, which slows the output down by up to
+ * GENLOCK_MAX_ADJUST lines per frame. Not with AUDIO_ASRC.
+ */
+#define AUDIO_DRIFT_CONTROL 0
+
+/// Largest correction of the DMA timer rate, 2%.
+#define AUDIO_DRIFT_MAX_PPM 20000
+
+/**
+ * @brief Follow the N64's audio rate instead of audio_out_sample_rate.
+ *
+ * When set to 1, the rate of the I2S frames is measured every second, and
+ * when a game sets a new AI rate the DMA timer and the HDMI audio clock are
+ * switched to it, with the closest CTS and N, see audio_rate.h.
+ * audio_out_sample_rate is used until then, and for rates below 31 kHz
+ * unless AUDIO_DIRECT_DMA is set. Not with AUDIO_ASRC.
+ */
+#define AUDIO_RATE_DETECT 0
+
+/**
+ * @brief DMA the N64 audio straight into the audio ring, every frame of it.
+ *
+ * When set to 1, the audio PIO's frames are written into the audio ring by
+ * one DMA channel, wrapping around, and libdvi reads them at the N64's own
+ * rate, so no frame is dropped. Below the 31 kHz HDMI takes, every frame is
+ * sent the same number of times instead. The DMA timer and the two DMA
+ * channels of the timer paced copy are left free. Needs AUDIO_RATE_DETECT
+ * and AUDIO_DRIFT_CONTROL, see audio_drift.h.
+ */
+#define AUDIO_DIRECT_DMA 0
+
 /**
  * @def DIAGNOSTICS
  * @brief A macro to control the display of diagnostic data.
@@ -169,9 +410,32 @@
 typedef enum dvi_color_mode {
     DVI_RGB_555 = 0, ///< 15-bit color mode (5 bits each for red, green, and blue).
     DVI_RGB_565,     ///< 16-bit color mode (5 bits for red and blue, 6 bits for green).
-    DVI_RGB_888,     ///< 24-bit color mode (8 bits each for red, green, and blue).
+    DVI_RGB_888,     ///< 24-bit color mode, 7 bits each from the VI. The only mode with FRAMEBUF_BPP 32, where it's the default.
 } dvi_color_mode_t;
 
+/**
+ * @enum color_range
+ * @brief Enumerates the output RGB ranges.
+ */
+typedef enum color_range {
+    COLOR_RANGE_FULL = 0, ///< Black at 0 and white at 255.
+    COLOR_RANGE_LIMITED,  ///< Black at 16 and white at 235, for TVs that expect it and ignore the AVI InfoFrame.
+    COLOR_RANGE_COUNT,    ///< Number of output ranges.
+} color_range_t;
+
+/**
+ * @enum video_mode
+ * @brief Enumerates the supported DVI output modes.
+ *
+ * All of them are 640 pixels wide, the frame buffer is pixel doubled.
+ */
+typedef enum video_mode {
+    VIDEO_MODE_640x480P60 = 0, ///< 640x480 at 60 Hz, 252 MHz system clock.
+    VIDEO_MODE_640x480P72,     ///< 640x480 at 72 Hz, 315 MHz system clock.
+    VIDEO_MODE_640x576P50,     ///< 640x576 at 50 Hz, 252 MHz system clock. Needs PAL_50HZ.
+    VIDEO_MODE_COUNT,          ///< Number of video modes.
+} video_mode_t;
+
 /**
  * @enum sample_rate_hz
  * @brief Enumerates the supported output audio sample rates in Hertz.
@@ -191,6 +455,16 @@ typedef struct config {
     uint32_t magic1;                ///< The first magic number used for configuration validation.
     uint32_t audio_out_sample_rate; ///< The audio output sample rate in Hertz (see @ref sample_rate_hz_t).
     uint32_t dvi_color_mode;        ///< The DVI color mode (see @ref dvi_color_mode_t).
+    uint32_t video_mode;            ///< The DVI output mode (see @ref video_mode_t).
+    uint32_t video_mode_pal;        ///< The DVI output mode for PAL consoles, with PAL_50HZ (see @ref video_mode_t).
+    uint32_t dedither;              ///< Non-zero to remove the N64 dither pattern, with FRAMEBUF_BPP 16.
+    uint32_t autocrop;              ///< Non-zero to crop around the measured picture instead of the defaults.
+    uint32_t color_gamma;           ///< Gamma of the output, 0.5 to 2.0 in steps of 0.1 (see color.h).
+    uint32_t color_black_level;     ///< Output level of black, 0 to COLOR_BLACK_LEVEL_MAX.
+    uint32_t color_gain_red;        ///< Gain of the red channel in percent, up to COLOR_GAIN_MAX.
+    uint32_t color_gain_green;      ///< Gain of the green channel in percent, up to COLOR_GAIN_MAX.
+    uint32_t color_gain_blue;       ///< Gain of the blue channel in percent, up to COLOR_GAIN_MAX.
+    uint32_t color_range;           ///< The output RGB range (see @ref color_range_t).
     uint32_t magic2;                ///< The second magic number used for configuration validation.
 } config_t;
 
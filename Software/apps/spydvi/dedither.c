@@ -0,0 +1,141 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "dedither.h"
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+// Red and blue of an RGB565 pixel, and green
+#define DEDITHER_RB (0xf81f)
+#define DEDITHER_G  (0x07e0)
+
+// A pixel spread out by spread() has blue at bit 0, red at 11 and green at
+// 21, with four or more free bits above each channel. A step of the RGB555
+// the RDP renders is two steps of green, which is compared from bit 22 on.
+// These are the lowest and two lowest bits of each compared channel, and an
+// offset above each, larger than any difference, so none of them borrows.
+#define SPREAD_G_LSB (1 << 21)
+#define SPREAD_LSB   ((1 << 0) | (1 << 11) | (1 << 22))
+#define SPREAD_LOW2  ((3 << 0) | (3 << 11) | (3 << 22))
+#define SPREAD_HALF  ((64 << 0) | (64 << 11) | (64 << 22))
+
+// Half a step of each channel of a sum of four pixels, see dedither_word()
+#define SPREAD_ROUND ((2 << 0) | (2 << 11) | (2 << 21))
+
+#define DEDITHER_WORDS (FRAME_WIDTH / 2)
+
+static dedither_stats_t stats;
+
+#if FRAMEBUF_BPP == 16
+
+// The previous line as it was captured, before it was filtered
+static uint32_t above_line[DEDITHER_WORDS];
+
+// When the previous line was started
+static uint32_t above_start;
+
+// The low pixel of x with room for sums and differences in each channel
+static inline uint32_t spread(uint32_t x)
+{
+    return (x & DEDITHER_RB) | ((x & DEDITHER_G) << 16);
+}
+
+// Bits set where a channel of the spread out pixels x and y is more than one
+// step apart, with the lowest bit of green cleared in both
+static inline uint32_t far_bits(uint32_t x, uint32_t y)
+{
+    // Per channel x - y + 1, offset by the bit above it so it can't borrow.
+    // With that bit flipped, it's 0, 1 or 2 where they are at most one step
+    // apart, anything else has bits set above the lowest two or is 3.
+    uint32_t d = ((x + SPREAD_HALF + SPREAD_LSB) - y) ^ SPREAD_HALF;
+    return (d & ~SPREAD_LOW2) | (d & (d >> 1) & SPREAD_LSB);
+}
+
+// Filter the two pixels of cur, below the two pixels of above. The words
+// before and after, on both lines, tell whether the pattern repeats.
+static inline uint32_t dedither_word(uint32_t cur, uint32_t above,
+                                     uint32_t cur_prev, uint32_t above_prev,
+                                     uint32_t cur_next, uint32_t above_next)
+{
+    // Dither repeats every two pixels on both lines, a gradient or an edge
+    // doesn't. Two flat lines are a vertical step, not dither.
+    bool repeats = (cur == cur_next && above == above_next) ||
+                   (cur == cur_prev && above == above_prev);
+    bool flat = (((cur ^ (cur >> 16)) | (above ^ (above >> 16))) & 0xffff) == 0;
+    if (!repeats || flat) {
+        return cur;
+    }
+
+    // All four pixels within one step of each other in every channel
+    uint32_t c0 = spread(cur);
+    uint32_t c1 = spread(cur >> 16);
+    uint32_t a0 = spread(above);
+    uint32_t a1 = spread(above >> 16);
+    uint32_t c0_step = c0 & ~SPREAD_G_LSB;
+    uint32_t c1_step = c1 & ~SPREAD_G_LSB;
+    uint32_t a0_step = a0 & ~SPREAD_G_LSB;
+    uint32_t a1_step = a1 & ~SPREAD_G_LSB;
+    uint32_t far = far_bits(c0_step, c1_step) | far_bits(a0_step, a1_step) |
+                   far_bits(c0_step, a0_step) | far_bits(c0_step, a1_step) |
+                   far_bits(c1_step, a0_step) | far_bits(c1_step, a1_step);
+    if (far != 0) {
+        return cur;
+    }
+
+    // Both pixels become the mean of the four, rounded
+    uint32_t mean = (c0 + c1 + a0 + a1 + SPREAD_ROUND) >> 2;
+    uint32_t pixel = (mean & DEDITHER_RB) | ((mean >> 16) & DEDITHER_G);
+    return pixel | (pixel << 16);
+}
+
+void __not_in_flash_func(dedither_line)(framebuf_pixel_t *line, bool has_above)
+{
+    uint32_t *words = (uint32_t *) line;
+    uint32_t t0 = cycles_now();
+
+    if (!has_above) {
+        // First line of a frame, only kept for the next one
+        memcpy(above_line, words, sizeof(above_line));
+    } else {
+        // From the start of the line above to this one is the time per line
+        stats.budget_cycles = cycles_since(above_start);
+
+        uint32_t *above = above_line;
+        uint32_t *last = words + DEDITHER_WORDS - 1;
+
+        // No word repeats the one before the first or after the last
+        uint32_t cur = words[0];
+        uint32_t up = above[0];
+        uint32_t cur_prev = ~cur;
+        uint32_t up_prev = ~up;
+        while (words != last) {
+            uint32_t cur_next = words[1];
+            uint32_t up_next = above[1];
+            *above++ = cur;
+            *words++ = dedither_word(cur, up, cur_prev, up_prev, cur_next, up_next);
+            cur_prev = cur;
+            up_prev = up;
+            cur = cur_next;
+            up = up_next;
+        }
+        *above = cur;
+        *words = dedither_word(cur, up, cur_prev, up_prev, ~cur, ~up);
+    }
+    above_start = t0;
+
+    // SysTick on core 0 is already running, see main()
+    stats.cycles = cycles_since(t0);
+    stats.max_cycles = MAX(stats.max_cycles, stats.cycles);
+}
+
+#endif
+
+const dedither_stats_t *dedither_get_stats(void)
+{
+    return &stats;
+}
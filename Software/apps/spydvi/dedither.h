@@ -0,0 +1,59 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file dedither.h
+ * @brief Remove the N64 dither pattern from captured lines.
+ *
+ * The RDP renders to RGB555 with an ordered dither. The capture keeps every
+ * second VI pixel and row, so what is left of it is a 2x2 pattern of pixels
+ * one step apart, which repeats every two pixels and rows.
+ *
+ * Each pair of pixels of a line is compared with the pair above it, on the
+ * previous captured line. Where the pairs before or after are the same on
+ * both lines, the four pixels are within one RGB555 step of each other in
+ * every channel and they aren't just two flat lines, it's dither and the pair
+ * is replaced by the mean of the four. Anything else is kept: edges,
+ * gradients, which don't repeat, and one step vertical changes.
+ *
+ * The previous line is kept as it was captured, before it was filtered. The
+ * first line of a frame has nothing above it and is left as it is.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "framebuf.h"
+
+/**
+ * @struct dedither_stats
+ * @brief Filter cost on core 0.
+ */
+typedef struct dedither_stats {
+    uint32_t cycles;        ///< Cycles spent on the last line.
+    uint32_t max_cycles;    ///< Cycles spent on the slowest line, since boot.
+    uint32_t budget_cycles; ///< Cycles from the previous line to the last, the time there is per line.
+} dedither_stats_t;
+
+#if FRAMEBUF_BPP == 16
+
+/**
+ * @brief Filter a captured line in place (core 0).
+ * @param line The first pixel of the line, FRAME_WIDTH pixels.
+ * @param has_above Whether the previous call was for the line right above,
+ *                  false for the first line of a frame.
+ */
+void dedither_line(framebuf_pixel_t *line, bool has_above);
+
+#endif
+
+/**
+ * @brief Get the filter cost.
+ * @return A pointer to the counters.
+ */
+const dedither_stats_t *dedither_get_stats(void);
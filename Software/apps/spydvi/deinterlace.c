@@ -0,0 +1,72 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "deinterlace.h"
+
+#include <stdlib.h>
+#include "pico/stdlib.h"
+
+static struct {
+    struct dvi_inst *inst;
+    uint32_t last_rows;
+    int32_t last_delta;
+    uint32_t votes; // Fields in a row that disagree with interlaced
+    bool interlaced;
+    uint32_t next_field;
+    deinterlace_stats_t stats;
+} state;
+
+void deinterlace_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+    state.interlaced = false;
+    state.votes = 0;
+}
+
+uint32_t deinterlace_begin_field(uint32_t *step)
+{
+    if (!state.interlaced) {
+        *step = 1;
+        return 0;
+    }
+
+    state.stats.fields++;
+    *step = 2;
+    return state.next_field;
+}
+
+void deinterlace_end_field(uint32_t rows)
+{
+    // One row more, then one row less, and so on
+    int32_t delta = rows - state.last_rows;
+    bool alternating = (abs(delta) == 1) && (delta == -state.last_delta);
+    state.last_rows = rows;
+    state.last_delta = delta;
+
+    if (alternating != state.interlaced) {
+        if (++state.votes >= DEINTERLACE_DETECT_FIELDS) {
+            state.votes = 0;
+            state.interlaced = alternating;
+
+            // Every line once while woven, from the next DVI frame on
+            dvi_set_vertical_repeat(state.inst, alternating ? 1 : DVI_VERTICAL_REPEAT);
+        }
+    } else {
+        state.votes = 0;
+    }
+
+    // The longer field is the bottom one, the next field is the other one
+    uint32_t field = (delta > 0) ^ DEINTERLACE_SWAP_FIELDS;
+    state.next_field = field ^ 1;
+
+    state.stats.interlaced = state.interlaced;
+    state.stats.field = field;
+}
+
+const deinterlace_stats_t *deinterlace_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,70 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file deinterlace.h
+ * @brief Weave interlaced fields into full height frames.
+ *
+ * Interlaced fields start half a line apart, so counting whole rows from one
+ * VSYNC to the next alternately gives one row more and one row less. Once
+ * that pattern is stable, each field is captured into every second frame
+ * buffer line, the longer field below the shorter one, and the DVI output
+ * shows every line once. The other field stays in place from the previous
+ * frame, so nothing is delayed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+#if DEINTERLACE && (FRAMEBUF_BPP != 8 || FRAMEBUF_COUNT != 1)
+#error "DEINTERLACE requires FRAMEBUF_BPP 8 and FRAMEBUF_COUNT 1"
+#endif
+
+#if DEINTERLACE && (BEAM_RACE || FULLRES)
+#error "DEINTERLACE can't be combined with BEAM_RACE or FULLRES"
+#endif
+
+/**
+ * @struct deinterlace_stats
+ * @brief Deinterlacer state, updated every field.
+ */
+typedef struct deinterlace_stats {
+    uint32_t interlaced; ///< Non-zero while fields are being woven.
+    uint32_t field;      ///< Parity of the last field, 0 for the top field.
+    uint32_t fields;     ///< Number of fields woven, since boot.
+} deinterlace_stats_t;
+
+/**
+ * @brief Initialize the deinterlacer.
+ * @param inst The DVI instance whose vertical repeat is switched.
+ */
+void deinterlace_init(struct dvi_inst *inst);
+
+/**
+ * @brief Get where the next field goes in the frame buffer (core 0).
+ *
+ * Called right before the first line of a field is captured.
+ * @param step Set to the number of frame buffer lines per captured line.
+ * @return The frame buffer line of the first captured line.
+ */
+uint32_t deinterlace_begin_field(uint32_t *step);
+
+/**
+ * @brief Detect interlacing and the field parity (core 0).
+ *
+ * Called on the captured VSYNC.
+ * @param rows The number of rows in the field.
+ */
+void deinterlace_end_field(uint32_t rows);
+
+/**
+ * @brief Get the deinterlacer state.
+ * @return A pointer to the state.
+ */
+const deinterlace_stats_t *deinterlace_get_stats(void);
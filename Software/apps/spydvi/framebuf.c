@@ -0,0 +1,140 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "framebuf.h"
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "sprite.h"
+
+#define FRAMEBUF_PIXELS (FRAMEBUF_PLANES * FRAME_WIDTH * FRAMEBUF_LINES)
+#define FRAMEBUF_NONE   (-1)
+
+// The single 320 pixel wide RGB565 buffer
+#define FRAMEBUF_MAX_BYTES (320 * FRAME_HEIGHT * sizeof(uint16_t))
+
+// The buffers may not take more RAM than the single RGB565 buffer they replace
+static_assert(FRAMEBUF_COUNT * FRAMEBUF_PIXELS * sizeof(framebuf_pixel_t) <= FRAMEBUF_MAX_BYTES,
+              "Frame buffers don't fit in RAM, use FRAMEBUF_BPP 8 for more than one buffer");
+
+// Word aligned, the capture loop writes pixel pairs
+static framebuf_pixel_t buffers[FRAMEBUF_COUNT][FRAMEBUF_PIXELS] __attribute__((aligned(4)));
+
+static struct {
+    spin_lock_t *lock;
+    volatile int8_t front;   // Shown by core 1
+    volatile int8_t ready;   // Finished, waiting for core 1
+    volatile int8_t writing; // Being captured into by core 0
+    framebuf_stats_t stats;
+} state = {
+    .front = 0,
+    .ready = FRAMEBUF_NONE,
+    .writing = FRAMEBUF_NONE,
+};
+
+void framebuf_init(void)
+{
+    state.lock = spin_lock_init(spin_lock_claim_unused(true));
+}
+
+void framebuf_fill(uint16_t rgb)
+{
+    for (int i = 0; i < FRAMEBUF_COUNT; i++) {
+#if FRAMEBUF_BPP == 8
+        sprite_fill8(buffers[i], framebuf_from_rgb565(rgb), FRAMEBUF_PIXELS);
+#elif FRAMEBUF_BPP == 32
+        for (int y = 0; y < FRAMEBUF_LINES; y++) {
+            framebuf_pixel_t *line = framebuf_line(buffers[i], y);
+            sprite_fill16(line, framebuf_from_rgb565(rgb), FRAME_WIDTH);
+            sprite_fill16(line + FRAMEBUF_PLANE_BLUE, framebuf_blue_from_rgb565(rgb), FRAME_WIDTH);
+        }
+#else
+        sprite_fill16(buffers[i], rgb, FRAMEBUF_PIXELS);
+#endif
+    }
+}
+
+framebuf_pixel_t *framebuf_begin(void)
+{
+    uint32_t irq = spin_lock_blocking(state.lock);
+
+    state.writing = FRAMEBUF_NONE;
+    if (FRAMEBUF_COUNT == 1) {
+        // Nothing to flip, capture into the buffer being shown
+        state.writing = 0;
+    } else {
+        for (int i = 0; i < FRAMEBUF_COUNT; i++) {
+            if (i != state.front && i != state.ready) {
+                state.writing = i;
+                break;
+            }
+        }
+    }
+
+    if (state.writing == FRAMEBUF_NONE) {
+        state.stats.drops++;
+    }
+
+    spin_unlock(state.lock, irq);
+
+    return (state.writing == FRAMEBUF_NONE) ? NULL : buffers[state.writing];
+}
+
+void framebuf_flip(void)
+{
+    uint32_t irq = spin_lock_blocking(state.lock);
+
+    if (state.writing != FRAMEBUF_NONE) {
+        if (state.ready != FRAMEBUF_NONE) {
+            // Core 1 didn't get to the previous one, it's free again
+            state.stats.drops++;
+        }
+        state.ready = state.writing;
+        state.writing = FRAMEBUF_NONE;
+        state.stats.flips++;
+    }
+
+    spin_unlock(state.lock, irq);
+}
+
+framebuf_pixel_t *framebuf_get_front(void)
+{
+    return buffers[state.front];
+}
+
+framebuf_pixel_t *framebuf_get_back(void)
+{
+    int8_t writing = state.writing;
+    return (writing == FRAMEBUF_NONE) ? NULL : buffers[writing];
+}
+
+uint32_t __not_in_flash_func(framebuf_index)(const framebuf_pixel_t *line)
+{
+    return (line - buffers[0]) / FRAMEBUF_PIXELS;
+}
+
+framebuf_pixel_t *__not_in_flash_func(framebuf_get_scanline)(uint32_t y)
+{
+    if (y == 0) {
+        uint32_t irq = spin_lock_blocking(state.lock);
+
+        if (state.ready != FRAMEBUF_NONE) {
+            state.front = state.ready;
+            state.ready = FRAMEBUF_NONE;
+        } else {
+            state.stats.repeats++;
+        }
+
+        spin_unlock(state.lock, irq);
+    }
+
+    return framebuf_line(buffers[state.front], y);
+}
+
+const framebuf_stats_t *framebuf_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,187 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file framebuf.h
+ * @brief Page flipped frame buffers shared between capture and DVI output.
+ *
+ * Core 0 captures into a buffer nobody is looking at, and hands it over on
+ * the captured VSYNC. Core 1 picks up the newest finished buffer at the start
+ * of the next DVI frame, so a frame is never shown half old and half new.
+ *
+ * With a single buffer (the default) capture writes straight into the buffer
+ * being shown, like before.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+#if FULLRES
+#define FRAME_WIDTH 640 ///< Width of the frame in pixels, one per VI pixel.
+#define FRAME_HORIZONTAL_REPEAT 1 ///< DVI pixels per frame pixel.
+#define FRAMEBUF_LINES FULLRES_RING_LINES ///< Lines kept in RAM, the line index wraps around.
+#define FRAMEBUF_RING 1 ///< Only a ring of lines is kept, there is no whole frame to draw on.
+#elif FRAMEBUF_BPP == 32
+#define FRAME_WIDTH 320 ///< Width of the frame in pixels.
+#define FRAME_HORIZONTAL_REPEAT 2 ///< DVI pixels per frame pixel.
+#define FRAMEBUF_LINES RGB888_RING_LINES ///< Lines kept in RAM, the line index wraps around.
+#define FRAMEBUF_RING 1 ///< Only a ring of lines is kept, there is no whole frame to draw on.
+#elif DEINTERLACE
+#define FRAME_WIDTH 320 ///< Width of the frame in pixels.
+#define FRAME_HORIZONTAL_REPEAT 2 ///< DVI pixels per frame pixel.
+#define FRAMEBUF_LINES (2 * FRAME_HEIGHT) ///< Lines kept in RAM, both fields of an interlaced frame.
+#define FRAMEBUF_RING 0 ///< Only a ring of lines is kept, there is no whole frame to draw on.
+#else
+#define FRAME_WIDTH 320 ///< Width of the frame in pixels.
+#define FRAME_HORIZONTAL_REPEAT 2 ///< DVI pixels per frame pixel.
+#define FRAMEBUF_LINES FRAME_HEIGHT ///< Lines kept in RAM.
+#define FRAMEBUF_RING 0 ///< Only a ring of lines is kept, there is no whole frame to draw on.
+#endif
+#if PAL_50HZ
+#define FRAME_HEIGHT 288 ///< Height of the frame in pixels, NTSC only shows the first 240.
+#else
+#define FRAME_HEIGHT 240 ///< Height of the frame in pixels.
+#endif
+
+#if FRAMEBUF_BPP == 8
+typedef uint8_t framebuf_pixel_t;  ///< RGB332 pixel, or palette index with FRAMEBUF_PALETTE.
+#define FRAMEBUF_PLANES 1          ///< Planes per line.
+#elif FRAMEBUF_BPP == 16
+typedef uint16_t framebuf_pixel_t; ///< RGB565 pixel.
+#define FRAMEBUF_PLANES 1          ///< Planes per line.
+#elif FRAMEBUF_BPP == 32
+typedef uint16_t framebuf_pixel_t; ///< Red and green (bits 15-9, 7-1) or blue (bits 15-9) of a pixel, see FRAMEBUF_PLANE_BLUE.
+#define FRAMEBUF_PLANES 2          ///< Planes per line.
+#define FRAMEBUF_PLANE_BLUE FRAME_WIDTH ///< Offset of the blue plane from the red and green plane of a line.
+#else
+#error "FRAMEBUF_BPP must be 8, 16 or 32"
+#endif
+
+#if DVI_FRAMEBUF_WORKER && (BEAM_RACE || FRAMEBUF_PALETTE || TMDS_LINE_CACHE)
+#error "DVI_FRAMEBUF_WORKER can't be combined with BEAM_RACE, FRAMEBUF_PALETTE or TMDS_LINE_CACHE"
+#endif
+
+/**
+ * @struct framebuf_stats
+ * @brief Page flip counters, since boot.
+ */
+typedef struct framebuf_stats {
+    uint32_t flips;   ///< Number of captured frames handed over to the output.
+    uint32_t drops;   ///< Number of captured frames that were never shown.
+    uint32_t repeats; ///< Number of output frames that showed an old frame again.
+} framebuf_stats_t;
+
+/**
+ * @brief Convert a color from RGB565 to the frame buffer format.
+ * @param rgb The color in RGB565 format.
+ * @return The color in frame buffer format.
+ */
+static inline framebuf_pixel_t framebuf_from_rgb565(uint16_t rgb)
+{
+#if FRAMEBUF_PALETTE
+    // One of the fixed colors at the start of the palette, from the MSB of each channel
+    return ((rgb >> 13) & 0x04) | ((rgb >> 9) & 0x02) | ((rgb >> 4) & 0x01);
+#elif FRAMEBUF_BPP == 8
+    return ((rgb >> 8) & 0xe0) | ((rgb >> 6) & 0x1c) | ((rgb >> 3) & 0x03);
+#elif FRAMEBUF_BPP == 32
+    // The red and green plane, see framebuf_blue_from_rgb565() for the other one
+    return (rgb & 0xf800) | ((rgb >> 5) & 0x0600) | ((rgb >> 3) & 0x00fc) | ((rgb >> 9) & 0x0002);
+#else
+    return rgb;
+#endif
+}
+
+#if FRAMEBUF_BPP == 32
+/**
+ * @brief Convert a color from RGB565 to the blue plane of the frame buffer.
+ * @param rgb The color in RGB565 format.
+ * @return The blue plane pixel.
+ */
+static inline framebuf_pixel_t framebuf_blue_from_rgb565(uint16_t rgb)
+{
+    return ((rgb << 11) & 0xf800) | ((rgb << 6) & 0x0600);
+}
+#endif
+
+/**
+ * @brief Get a line of a frame buffer.
+ * @param buf The frame buffer.
+ * @param y The line, wrapped around to the lines kept in RAM.
+ * @return A pointer to the first pixel of the line.
+ */
+static inline framebuf_pixel_t *framebuf_line(framebuf_pixel_t *buf, uint32_t y)
+{
+#if FRAMEBUF_RING
+    y &= FRAMEBUF_LINES - 1;
+#endif
+    return &buf[FRAMEBUF_PLANES * FRAME_WIDTH * y];
+}
+
+/**
+ * @brief Initialize the frame buffers.
+ */
+void framebuf_init(void);
+
+/**
+ * @brief Fill all frame buffers with one color.
+ * @param rgb The color in RGB565 format.
+ */
+void framebuf_fill(uint16_t rgb);
+
+/**
+ * @brief Get a free buffer to capture the next frame into (core 0).
+ *
+ * Should be called as late as possible before the first captured row, to give
+ * core 1 time to release a buffer.
+ * @return The buffer, or NULL if none is free and the frame has to be dropped.
+ */
+framebuf_pixel_t *framebuf_begin(void);
+
+/**
+ * @brief Hand the buffer from framebuf_begin() over to the output (core 0).
+ *
+ * Called on the captured VSYNC. Does nothing if framebuf_begin() had no buffer.
+ */
+void framebuf_flip(void);
+
+/**
+ * @brief Get the buffer that is being shown.
+ *
+ * Used for drawing the OSD, which has to be redrawn when this changes.
+ * @return The buffer being shown.
+ */
+framebuf_pixel_t *framebuf_get_front(void);
+
+/**
+ * @brief Get the buffer from framebuf_begin() (core 0).
+ * @return The buffer being captured into, or NULL if the frame is dropped.
+ */
+framebuf_pixel_t *framebuf_get_back(void);
+
+/**
+ * @brief Get which buffer a line belongs to.
+ * @param line A pointer into one of the buffers.
+ * @return The index of the buffer, below FRAMEBUF_COUNT.
+ */
+uint32_t framebuf_index(const framebuf_pixel_t *line);
+
+/**
+ * @brief Get a scanline for the output (core 1).
+ *
+ * Line 0 marks the start of a DVI frame, where the newest finished buffer is
+ * picked up.
+ * @param y The scanline.
+ * @return A pointer to the first pixel of the scanline.
+ */
+framebuf_pixel_t *framebuf_get_scanline(uint32_t y);
+
+/**
+ * @brief Get the page flip counters.
+ * @return A pointer to the counters.
+ */
+const framebuf_stats_t *framebuf_get_stats(void);
@@ -0,0 +1,98 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "fullres.h"
+#include "framebuf.h"
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "cycles.h"
+#include "tmds_encode.h"
+
+#if FULLRES
+
+#define FULLRES_LANE_WORDS (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD)
+
+// Red TMDS symbols of the lines in the frame buffer ring
+static uint32_t red_lanes[FRAMEBUF_LINES][FULLRES_LANE_WORDS];
+
+static struct {
+    struct dvi_inst *inst;
+    uint32_t core0_max;
+    uint32_t core1_max;
+    uint core1_frame;
+    fullres_stats_t stats;
+} state;
+
+void fullres_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+}
+
+void __not_in_flash_func(fullres_encode_line)(uint32_t y)
+{
+    const uint32_t *pixels = (const uint32_t *) framebuf_line(framebuf_get_front(), y);
+
+    // SysTick on core 0 is already running, see main()
+    uint32_t t0 = cycles_now();
+    tmds_encode_data_channel_fullres_16bpp(pixels, red_lanes[y & (FRAMEBUF_LINES - 1)], FRAME_WIDTH,
+                                           DVI_16BPP_RED_MSB, DVI_16BPP_RED_LSB);
+    uint32_t cycles = cycles_since(t0);
+
+    if (y == 0) {
+        state.stats.core0_cycles = state.core0_max;
+        state.core0_max = 0;
+    }
+    state.core0_max = MAX(state.core0_max, cycles);
+}
+
+void __not_in_flash_func(fullres_scanbuf_main)(void)
+{
+    struct dvi_inst *inst = state.inst;
+    const framebuf_pixel_t *base = framebuf_get_front();
+
+    while (1) {
+        uint32_t *scanbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            return;
+        }
+
+        uint32_t slot = ((const framebuf_pixel_t *) scanbuf - base) / FRAME_WIDTH;
+        uint32_t *tmdsbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+
+        uint32_t t0 = cycles_now();
+        tmds_encode_data_channel_fullres_16bpp(scanbuf, tmdsbuf + 0 * FULLRES_LANE_WORDS, FRAME_WIDTH,
+                                               DVI_16BPP_BLUE_MSB, DVI_16BPP_BLUE_LSB);
+        tmds_encode_data_channel_fullres_16bpp(scanbuf, tmdsbuf + 1 * FULLRES_LANE_WORDS, FRAME_WIDTH,
+                                               DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
+        memcpy(tmdsbuf + 2 * FULLRES_LANE_WORDS, red_lanes[slot], sizeof(red_lanes[slot]));
+        uint32_t cycles = cycles_since(t0);
+
+        queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
+        queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
+
+        if (inst->dvi_frame_count != state.core1_frame) {
+            state.core1_frame = inst->dvi_frame_count;
+            state.stats.core1_cycles = state.core1_max;
+            state.core1_max = 0;
+        }
+        state.core1_max = MAX(state.core1_max, cycles);
+    }
+}
+
+const fullres_stats_t *fullres_get_stats(void)
+{
+    // clk_sys is the TMDS bit clock, 10 cycles per pixel
+    const struct dvi_timing *t = state.inst->timing;
+    uint32_t h_total = t->h_front_porch + t->h_sync_width + t->h_back_porch + t->h_active_pixels;
+    state.stats.budget_cycles = DVI_VERTICAL_REPEAT * h_total * 10;
+
+    return &state.stats;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file fullres.h
+ * @brief Full resolution output, one DVI pixel per VI pixel.
+ *
+ * Without pixel doubling every TMDS symbol has to be encoded with running
+ * disparity, which takes too long for core 1 to do all three lanes on top of
+ * the DVI IRQ. Core 1 encodes blue and green, while core 0 encodes red right
+ * after capturing a line, into a ring next to the captured lines. Core 1 then
+ * only copies the red lane into the TMDS buffer. Each core uses its own copy
+ * of the encoder and its LUT, core 1 in scratch X and core 0 in scratch Y.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+#if FULLRES && !BEAM_RACE
+#error "FULLRES only keeps a few lines, it requires BEAM_RACE 1"
+#endif
+
+#if FULLRES && (VIDEO_CAPTURE_PACKED || FRAMEBUF_BPP != 16)
+#error "FULLRES requires VIDEO_CAPTURE_PACKED 0 and FRAMEBUF_BPP 16"
+#endif
+
+#if FULLRES && (FULLRES_RING_LINES & (FULLRES_RING_LINES - 1))
+#error "FULLRES_RING_LINES must be a power of two"
+#endif
+
+#if FULLRES && (FULLRES_RING_LINES <= BEAM_RACE_LAG_LINES + 2)
+#error "FULLRES_RING_LINES has to cover the beam racing lag and the encoder pipeline"
+#endif
+
+/**
+ * @struct fullres_stats
+ * @brief TMDS encode cost per line, the worst line of the last frame.
+ */
+typedef struct fullres_stats {
+    uint32_t core0_cycles;  ///< Cycles core 0 spent encoding red.
+    uint32_t core1_cycles;  ///< Cycles core 1 spent encoding blue and green and copying red, including DVI IRQs.
+    uint32_t budget_cycles; ///< Cycles available per line, every line is shown DVI_VERTICAL_REPEAT times.
+} fullres_stats_t;
+
+/**
+ * @brief Initialize full resolution output.
+ * @param inst The DVI instance.
+ */
+void fullres_init(struct dvi_inst *inst);
+
+/**
+ * @brief Encode the red lane of a captured line (core 0).
+ * @param y The frame buffer line, already captured.
+ */
+void fullres_encode_line(uint32_t y);
+
+/**
+ * @brief TMDS encode worker (core 1).
+ *
+ * Replaces dvi_scanbuf_main_16bpp, and like it returns when a NULL scanline
+ * is queued.
+ */
+void fullres_scanbuf_main(void);
+
+/**
+ * @brief Get the encode cost.
+ * @return A pointer to the counters.
+ */
+const fullres_stats_t *fullres_get_stats(void);
@@ -0,0 +1,89 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "genlock.h"
+
+#include <stdlib.h>
+#include "pico/stdlib.h"
+
+// Controller gains in 1/65536 lines per frame, per line of phase error.
+// Critically damped with a time constant of roughly 15 frames.
+#define GENLOCK_KP (65536 / 8)
+#define GENLOCK_KI (65536 / 256)
+
+// Beyond this, slew at the maximum rate instead of running the controller
+#define GENLOCK_ACQUIRE_LINES (16)
+
+static struct {
+    struct dvi_inst *inst;
+    int32_t integral; // 1/65536 lines per frame
+    int32_t residue;  // 1/65536 lines, dither accumulator
+    uint last_frame_count;
+    genlock_stats_t stats;
+} state;
+
+void genlock_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+    state.integral = 0;
+    state.residue = 0;
+    state.last_frame_count = inst->dvi_frame_count;
+}
+
+int __not_in_flash_func(genlock_update)(int target_line)
+{
+    const struct dvi_timing *t = state.inst->timing;
+    int total = t->v_front_porch + t->v_sync_width + t->v_back_porch + t->v_active_lines;
+    int min_adjust = 1 - (int) t->v_front_porch;
+
+    // Positive when the output is ahead, the shorter way around the frame
+    int error = dvi_get_line(state.inst) - target_line;
+    if (error >= total / 2) {
+        error -= total;
+    } else if (error < -total / 2) {
+        error += total;
+    }
+
+    uint frame_count = state.inst->dvi_frame_count;
+    if (frame_count - state.last_frame_count != 1) {
+        state.stats.slips++;
+    }
+    state.last_frame_count = frame_count;
+
+    int adjust;
+    if (abs(error) > GENLOCK_ACQUIRE_LINES) {
+        // Far off, slew without winding up the integral
+        adjust = (error > 0) ? GENLOCK_MAX_ADJUST : min_adjust;
+        state.residue = 0;
+    } else {
+        state.integral += error * GENLOCK_KI;
+        state.integral = MAX(state.integral, min_adjust * 65536);
+        state.integral = MIN(state.integral, GENLOCK_MAX_ADJUST * 65536);
+
+        // First order sigma-delta, so the average frame length is fractional
+        state.residue += error * GENLOCK_KP + state.integral;
+        adjust = state.residue >> 16;
+        adjust = MAX(adjust, min_adjust);
+        adjust = MIN(adjust, GENLOCK_MAX_ADJUST);
+        state.residue -= adjust * 65536;
+        state.residue = MAX(state.residue, -65536);
+        state.residue = MIN(state.residue, 65536);
+    }
+
+    dvi_set_front_porch_adjust(state.inst, adjust);
+
+    state.stats.phase_error = error;
+    state.stats.rate = state.integral;
+    state.stats.adjust = adjust;
+    state.stats.locked = abs(error) <= GENLOCK_LOCK_LINES;
+
+    return error;
+}
+
+const genlock_stats_t *genlock_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,57 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file genlock.h
+ * @brief Lock the DVI frame rate and phase to the captured N64 frames.
+ *
+ * The DVI output runs from the system clock, the N64 from its own crystal, so
+ * the two frame rates never quite match. Once per captured frame the phase
+ * error, i.e. how far the DVI output is from a target line, is fed through a
+ * PI controller. Its output is a fractional number of lines per frame, which is
+ * dithered to whole lines and added to the DVI vertical front porch. Once
+ * locked, the integral term is the frame rate difference in lines per frame.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+/**
+ * @struct genlock_stats
+ * @brief Genlock telemetry, updated every captured frame.
+ */
+typedef struct genlock_stats {
+    int32_t phase_error; ///< DVI lines from the target line, last frame.
+    int32_t rate;        ///< Integral term, in 1/65536 DVI lines per frame.
+    int32_t adjust;      ///< Lines added to the next DVI vertical front porch.
+    uint32_t locked;     ///< Non-zero while the phase error is within GENLOCK_LOCK_LINES.
+    uint32_t slips;      ///< Captured frames that didn't take exactly one DVI frame, since boot.
+} genlock_stats_t;
+
+/**
+ * @brief Initialize the genlock.
+ * @param inst The DVI instance whose timing is adjusted.
+ */
+void genlock_init(struct dvi_inst *inst);
+
+/**
+ * @brief Measure the phase error and steer the DVI output (core 0).
+ *
+ * Called once per captured frame, at the same point of the frame every time.
+ * @param target_line The DVI line (see dvi_get_line()) the output should be
+ * at when this is called.
+ * @return The phase error in DVI lines.
+ */
+int genlock_update(int target_line);
+
+/**
+ * @brief Get the genlock telemetry.
+ * @return A pointer to the telemetry.
+ */
+const genlock_stats_t *genlock_get_stats(void);
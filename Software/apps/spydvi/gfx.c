@@ -17,8 +17,6 @@
 #define FONT_FIRST_ASCII 32
 
 
-uint16_t g_framebuf[FRAME_WIDTH * FRAME_HEIGHT];
-
 void gfx_puttext(uint32_t x0, uint32_t y0, uint32_t bgcol, uint32_t fgcol, const char *text)
 {
     for (int y = y0; y < y0 + 8; ++y) {
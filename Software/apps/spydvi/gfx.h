@@ -8,8 +8,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 
-#define FRAME_WIDTH 320 ///< Width of the frame in pixels.
-#define FRAME_HEIGHT 240 ///< Height of the frame in pixels.
+#include "framebuf.h"
 
 /**
  * @brief Convert a color from RGB888 format to RGB565 format.
@@ -25,18 +24,23 @@
         (((_b))        >>  3)        \
     )
 
-extern uint16_t g_framebuf[FRAME_WIDTH * FRAME_HEIGHT]; ///< Frame buffer.
-
 /**
- * @brief Draw a pixel on the screen.
+ * @brief Draw a pixel on the buffer being shown.
  * @param x The x-coordinate of the pixel.
  * @param y The y-coordinate of the pixel.
  * @param rgb The color of the pixel in RGB565 format.
  */
 static inline void gfx_putpixel(uint32_t x, uint32_t y, uint16_t rgb)
 {
+#if FRAMEBUF_RING
+    // Only a few lines are kept, there is nowhere to draw
+    (void) x;
+    (void) y;
+    (void) rgb;
+#else
     uint32_t idx = x + y * FRAME_WIDTH;
-    g_framebuf[idx] = rgb;
+    framebuf_get_front()[idx] = framebuf_from_rgb565(rgb);
+#endif
 }
 
 /**
@@ -60,12 +64,6 @@ void gfx_puttext(uint32_t x0, uint32_t y0, uint32_t bgcol, uint32_t fgcol, const
  */
 void gfx_puttextf(uint32_t x0, uint32_t y0, uint32_t bgcol, uint32_t fgcol, const char *fmt, ...);
 
-/**
- * @brief Get the frame buffer.
- * @return A pointer to the frame buffer.
- */
-uint16_t *gfx_get_framebuf(void);
-
 /**
  * @brief Initialize the graphics system.
  */
@@ -0,0 +1,216 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "line_cache.h"
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "cycles.h"
+#include "tmds_encode.h"
+
+#if TMDS_LINE_CACHE
+
+#define LINE_CACHE_LANE_WORDS (FRAME_HORIZONTAL_REPEAT * FRAME_WIDTH / DVI_SYMBOLS_PER_WORD)
+#define LINE_CACHE_PIXEL_WORDS (FRAME_WIDTH * FRAMEBUF_BPP / 32)
+#define LINE_CACHE_ENTRIES (LINE_CACHE_LINES + DVI_N_TMDS_BUFFERS)
+
+typedef struct entry {
+    uint32_t *tmdsbuf;
+    uint32_t hash;
+    uint32_t queued;  // Times queued and not taken back off the free queue yet
+    uint32_t used;    // Line it was last queued for, the oldest is encoded into first
+    bool valid;       // Holds the line in pixels
+    bool libdvi;      // Allocated by libdvi, goes back to it
+} entry_t;
+
+static uint32_t tmds_buffers[LINE_CACHE_LINES][3 * LINE_CACHE_LANE_WORDS];
+
+// The scanline each entry was encoded from, to compare against on a hash match
+static uint32_t pixels[LINE_CACHE_ENTRIES][LINE_CACHE_PIXEL_WORDS];
+
+static entry_t entries[LINE_CACHE_ENTRIES];
+
+static struct {
+    struct dvi_inst *inst;
+    uint32_t count; // Entries, the libdvi buffers are added as they come around
+    uint32_t line;
+    volatile bool invalidate;
+    uint frame;
+    line_cache_stats_t frame_stats;
+    line_cache_stats_t stats;
+} state;
+
+void line_cache_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+}
+
+void line_cache_invalidate(void)
+{
+    state.invalidate = true;
+}
+
+static uint32_t __not_in_flash_func(line_hash)(const uint32_t *line)
+{
+    uint32_t hash = 0;
+    for (uint32_t i = 0; i < LINE_CACHE_PIXEL_WORDS; i += 4) {
+        hash = ((hash << 5) | (hash >> 27)) ^ line[i];
+        hash = ((hash << 5) | (hash >> 27)) ^ line[i + 1];
+        hash = ((hash << 5) | (hash >> 27)) ^ line[i + 2];
+        hash = ((hash << 5) | (hash >> 27)) ^ line[i + 3];
+    }
+    return hash;
+}
+
+// Compared here rather than with memcmp(), which runs from flash
+static bool __not_in_flash_func(line_equal)(const uint32_t *a, const uint32_t *b)
+{
+    for (uint32_t i = 0; i < LINE_CACHE_PIXEL_WORDS; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The entry of a buffer off the free queue, adding libdvi's buffers the first time
+static entry_t *__not_in_flash_func(entry_of)(uint32_t *tmdsbuf)
+{
+    for (uint32_t i = 0; i < state.count; i++) {
+        if (entries[i].tmdsbuf == tmdsbuf) {
+            return &entries[i];
+        }
+    }
+    entry_t *entry = &entries[state.count++];
+    *entry = (entry_t) {
+        .tmdsbuf = tmdsbuf,
+        .queued = 1,
+        .libdvi = true,
+    };
+    return entry;
+}
+
+static void reset(void)
+{
+    for (uint32_t i = 0; i < LINE_CACHE_LINES; i++) {
+        entries[i] = (entry_t) {
+            .tmdsbuf = tmds_buffers[i],
+        };
+    }
+    state.count = LINE_CACHE_LINES;
+    state.invalidate = false;
+}
+
+static void __not_in_flash_func(encode_line)(entry_t *entry, const uint32_t *scanbuf)
+{
+    uint32_t *tmdsbuf = entry->tmdsbuf;
+#if FRAMEBUF_BPP == 8
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 0 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB,  0);
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 1 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB, 1);
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 2 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB,   2);
+#else
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 0 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB,  0);
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 1 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB, 1);
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 2 * LINE_CACHE_LANE_WORDS, FRAME_WIDTH, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB,   2);
+#endif
+}
+
+// The entry to send a scanline from, encoding it if it isn't cached
+static entry_t *__not_in_flash_func(lookup)(const uint32_t *scanbuf)
+{
+    if (state.invalidate) {
+        state.invalidate = false;
+        for (uint32_t i = 0; i < state.count; i++) {
+            entries[i].valid = false;
+        }
+    }
+
+    uint32_t hash = line_hash(scanbuf);
+    entry_t *oldest = NULL;
+    for (uint32_t i = 0; i < state.count; i++) {
+        entry_t *entry = &entries[i];
+        if (entry->valid && entry->hash == hash && line_equal(pixels[i], scanbuf)) {
+            state.frame_stats.hits++;
+            return entry;
+        }
+        // There is always one that isn't queued: every queued entry holds
+        // one of the libdvi buffers' turns, and the one just taken off the
+        // free queue is in hand.
+        if (entry->queued == 0 && (oldest == NULL || (int32_t) (entry->used - oldest->used) < 0)) {
+            oldest = entry;
+        }
+    }
+
+    encode_line(oldest, scanbuf);
+    memcpy(pixels[oldest - entries], scanbuf, sizeof(pixels[0]));
+    oldest->hash = hash;
+    oldest->valid = true;
+    return oldest;
+}
+
+// Wait for every turn to come back, and leave only libdvi's buffers on the
+// free queue, once each, for dvi_set_timing()
+static void __not_in_flash_func(give_back)(struct dvi_inst *inst)
+{
+    for (uint32_t i = 0; i < DVI_N_TMDS_BUFFERS; i++) {
+        uint32_t *tmdsbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+        entry_of(tmdsbuf)->queued--;
+    }
+    for (uint32_t i = 0; i < state.count; i++) {
+        if (entries[i].libdvi) {
+            queue_add_blocking_u32(&inst->q_tmds_free, &entries[i].tmdsbuf);
+        }
+    }
+}
+
+void __not_in_flash_func(line_cache_scanbuf_main)(void)
+{
+    struct dvi_inst *inst = state.inst;
+
+    // The libdvi buffers are new after a restart
+    reset();
+
+    while (1) {
+        uint32_t *scanbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            give_back(inst);
+            return;
+        }
+
+        // A turn to queue a line, the buffer it comes with may be queued still
+        uint32_t *tmdsbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+        entry_of(tmdsbuf)->queued--;
+
+        if (inst->dvi_frame_count != state.frame) {
+            // clk_sys is the TMDS bit clock, 10 cycles per pixel
+            uint32_t frame_cycles = dvi_timing_get_pixels_per_frame(inst->timing) * 10;
+            uint32_t busy = MIN(state.frame_stats.busy_cycles, frame_cycles);
+            state.frame_stats.idle_percent = 100 - (uint64_t) busy * 100 / frame_cycles;
+            state.stats = state.frame_stats;
+            state.frame_stats = (line_cache_stats_t) {0};
+            state.frame = inst->dvi_frame_count;
+        }
+
+        uint32_t t0 = cycles_now();
+        entry_t *entry = lookup(scanbuf);
+        entry->queued++;
+        entry->used = ++state.line;
+        queue_add_blocking_u32(&inst->q_tmds_valid, &entry->tmdsbuf);
+        queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
+        state.frame_stats.lines++;
+        state.frame_stats.busy_cycles += cycles_since(t0);
+    }
+}
+
+const line_cache_stats_t *line_cache_get_stats(void)
+{
+    return &state.stats;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file line_cache.h
+ * @brief Cache of TMDS encoded lines, for lines that repeat.
+ *
+ * With TMDS_LINE_CACHE core 1 looks every scanline up by its pixels before
+ * encoding it. A line that matches one encoded recently is sent from the
+ * TMDS buffer it was encoded into, so runs of identical lines, like borders,
+ * flat backgrounds and menus, are only encoded once.
+ *
+ * The TMDS buffers are the cache. The DVI IRQ sends a buffer as many times
+ * as it is queued, and hands it back on the free queue each time, so a
+ * buffer can be queued again while it's still waiting to be sent. Only the
+ * DVI_N_TMDS_BUFFERS from libdvi go around the queues, each hand back allowing
+ * one more line to be queued. LINE_CACHE_LINES more buffers are kept here,
+ * and a line is only encoded into a buffer that isn't queued at all.
+ *
+ * A frame of encoded lines doesn't fit in RAM, so the lines of a still
+ * picture only hit when they repeat within the last few distinct lines.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "framebuf.h"
+#include "dvi.h"
+
+#if TMDS_LINE_CACHE && (FULLRES || FRAMEBUF_PALETTE || FRAMEBUF_BPP == 32)
+#error "TMDS_LINE_CACHE requires FRAMEBUF_BPP 8 or 16, FULLRES 0 and FRAMEBUF_PALETTE 0"
+#endif
+
+/**
+ * @struct line_cache_stats
+ * @brief Lines and core 1 load of the last DVI frame.
+ */
+typedef struct line_cache_stats {
+    uint32_t lines;        ///< Scanlines queued.
+    uint32_t hits;         ///< Scanlines sent from the cache without encoding.
+    uint32_t busy_cycles;  ///< Cycles core 1 spent looking up, encoding and queueing them, including DVI IRQs.
+    uint32_t idle_percent; ///< Share of the frame core 1 spent waiting for scanlines and TMDS buffers.
+} line_cache_stats_t;
+
+/**
+ * @brief Initialize the cache, empty.
+ * @param inst The DVI instance.
+ */
+void line_cache_init(struct dvi_inst *inst);
+
+/**
+ * @brief Forget every encoded line (core 0).
+ *
+ * Called when the TMDS tables change. Lines already queued are still sent.
+ */
+void line_cache_invalidate(void);
+
+/**
+ * @brief TMDS encode worker (core 1).
+ *
+ * Replaces dvi_scanbuf_main_16bpp and dvi_scanbuf_main_8bpp. Like them it
+ * returns when a NULL scanline is queued, once every TMDS buffer from
+ * libdvi is back on the free queue, and only those.
+ */
+void line_cache_scanbuf_main(void);
+
+/**
+ * @brief Get the counters.
+ * @return A pointer to the counters.
+ */
+const line_cache_stats_t *line_cache_get_stats(void);
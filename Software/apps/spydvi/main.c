@@ -17,6 +17,7 @@
 #include "hardware/vreg.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
 #include "hardware/dma.h"
 #include "hardware/uart.h"
 
@@ -32,6 +33,23 @@
 
 #include "gfx.h"
 #include "osd.h"
+#include "video_dma.h"
+#include "beam_race.h"
+#include "genlock.h"
+#include "video_mode.h"
+#include "fullres.h"
+#include "rgb888.h"
+#include "palette.h"
+#include "line_cache.h"
+#include "deinterlace.h"
+#include "dedither.h"
+#include "autocrop.h"
+#include "color.h"
+#include "n64_capture.h"
+#include "asrc.h"
+#include "audio_drift.h"
+#include "audio_rate.h"
+#include "cycles.h"
 
 // Enable to print debug/diagnostics
 //#define DIAGNOSTICS
@@ -55,28 +73,117 @@ struct dvi_inst dvi0;
 // __time_critical_func
 // __not_in_flash_func
 
+#if AUDIO_ASRC
+// Every I2S frame, the DMA wraps around at the end
+audio_sample_t      asrc_input[ASRC_INPUT_SIZE] __attribute__((aligned(ASRC_INPUT_SIZE * sizeof(audio_sample_t))));
+#elif !AUDIO_DIRECT_DMA
 audio_sample_t      last_audio_sample;
+#endif
+#if AUDIO_DIRECT_DMA
+// Written by the audio PIO DMA, which wraps around at the end
+audio_sample_t      audio_buffer[AUDIO_BUFFER_SIZE] __attribute__((aligned(AUDIO_BUFFER_SIZE * sizeof(audio_sample_t))));
+#else
 audio_sample_t      audio_buffer[AUDIO_BUFFER_SIZE];
+#endif
+static uint         dma_ch_audio_pio_data;
+
+#ifdef DIAGNOSTICS
+// Cycles of the slowest scanline callback in the last frame, and of the
+// average one, in the DMA IRQ. With DVI_FRAMEBUF_WORKER the slowest is the
+// one line a frame that queues the next frame.
+static uint32_t scanline_callback_cycles;
+static uint32_t scanline_callback_average;
+static uint32_t scanline_callback_max;
+static uint32_t scanline_callback_total;
+static uint32_t scanline_callback_count;
+#endif
 
 static void core1_main(void)
 {
+    cycles_start();
     dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
     dvi_start(&dvi0);
-    dvi_scanbuf_main_16bpp(&dvi0);
+    while (1) {
+        // Returns when the video mode has to be switched
+#if FULLRES
+        fullres_scanbuf_main();
+#elif FRAMEBUF_BPP == 32
+        rgb888_scanbuf_main();
+#elif FRAMEBUF_PALETTE
+        palette_scanbuf_main();
+#elif TMDS_LINE_CACHE
+        line_cache_scanbuf_main();
+#elif DVI_FRAMEBUF_WORKER && FRAMEBUF_BPP == 8
+        dvi_framebuf_main_8bpp(&dvi0);
+#elif DVI_FRAMEBUF_WORKER
+        dvi_framebuf_main_16bpp(&dvi0);
+#elif FRAMEBUF_BPP == 8
+        dvi_scanbuf_main_8bpp(&dvi0);
+#else
+        dvi_scanbuf_main_16bpp(&dvi0);
+#endif
+        video_mode_core1_restart(DMA_IRQ_0);
+    }
     __builtin_unreachable();
 }
 
-static void core1_scanline_callback(uint arg0)
+#if DVI_FRAMEBUF_WORKER
+static inline void core1_queue_lines(uint line)
+{
+    // Core 1 finds the lines of a frame itself, so only the next frame is
+    // queued, as its first line would be
+    uint height = dvi0.timing->v_active_lines / dvi0.vertical_repeat;
+    if (line + 2 != height) {
+        return;
+    }
+    framebuf_pixel_t *bufptr;
+    while (queue_try_remove_u32(&dvi0.q_colour_free, &bufptr))
+        ;
+    bufptr = framebuf_get_scanline(0);
+    queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
+}
+#else
+static inline void core1_queue_lines(uint line)
 {
     // Discard any scanline pointers passed back
-    uint16_t *bufptr;
+    framebuf_pixel_t *bufptr;
     while (queue_try_remove_u32(&dvi0.q_colour_free, &bufptr))
         ;
-    // Note first two scanlines are pushed before DVI start
-    static uint scanline = 2;
-    bufptr = &g_framebuf[FRAME_WIDTH * scanline];
+    // Note first two scanlines are pushed before DVI start, so stay two ahead.
+    // The height follows the DVI timing and vertical repeat, which only change
+    // between frames.
+    uint height = dvi0.timing->v_active_lines / dvi0.vertical_repeat;
+    uint scanline = line + 2;
+    if (scanline >= height) {
+        scanline -= height;
+    }
+    bufptr = framebuf_get_scanline(scanline);
+#if BEAM_RACE
+    beam_race_scanline(scanline);
+#endif
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
-    scanline = (scanline + 1) % FRAME_HEIGHT;
+}
+#endif
+
+static void core1_scanline_callback(uint line)
+{
+#ifdef DIAGNOSTICS
+    uint32_t t0 = cycles_now();
+    core1_queue_lines(line);
+    uint32_t cycles = cycles_since(t0);
+    if (line == 0) {
+        scanline_callback_cycles = scanline_callback_max;
+        scanline_callback_average = scanline_callback_count ? scanline_callback_total / scanline_callback_count : 0;
+        scanline_callback_max = 0;
+        scanline_callback_total = 0;
+        scanline_callback_count = 0;
+    }
+    scanline_callback_max = MAX(scanline_callback_max, cycles);
+    scanline_callback_total += cycles;
+    scanline_callback_count++;
+#else
+    core1_queue_lines(line);
+#endif
 }
 
 static void set_audio_dvi_parameters(sample_rate_hz_t samplerate, bool setup)
@@ -85,30 +192,33 @@ static void set_audio_dvi_parameters(sample_rate_hz_t samplerate, bool setup)
     uint32_t cts;
     uint32_t n;
 
+    // The recommended N for each rate, CTS follows from the pixel clock
     switch (samplerate) {
     case SAMPLE_RATE_96000_HZ:
-        cts = 25200;
         n = 6144 * 2;
         break;
     case SAMPLE_RATE_48000_HZ:
-        cts = 25200;
         n = 6144;
         break;
     case SAMPLE_RATE_44100_HZ:
-        cts = 28000;
         n = 6272;
         break;
     case SAMPLE_RATE_32000_HZ:
-        cts = 25200;
         n = 4096;
         break;
     default:
-        // Assume a freq. close to 32000, so let's use that
-        cts = 25200;
-        n = (128 * samplerate * cts) / 25200000;
+        // Any other rate, like the N64's own, gets the closest CTS and N there are
+        n = 0;
         break;
     }
 
+    if (n) {
+        // 128 * samplerate = pixel_clock * N / CTS
+        cts = ((uint64_t) dvi_timing_get_pixel_clock(dvi0.timing) * n) / (128 * samplerate);
+    } else {
+        audio_rate_cts_n(dvi_timing_get_pixel_clock(dvi0.timing), samplerate, &cts, &n);
+    }
+
     if (setup) {
         dvi_set_audio_freq(&dvi0, samplerate, cts, n);
     } else {
@@ -116,36 +226,152 @@ static void set_audio_dvi_parameters(sample_rate_hz_t samplerate, bool setup)
     }
 }
 
+#if AUDIO_ASRC
+// Resample what the audio DMA has written so far
+static void __not_in_flash_func(audio_asrc_run)(void)
+{
+    uint32_t write = ((uint32_t) dma_hw->ch[dma_ch_audio_pio_data].write_addr - (uint32_t) asrc_input) / sizeof(audio_sample_t);
+    asrc_process(write, timer_hw->timerawl);
+}
+#elif !AUDIO_DIRECT_DMA
 static void set_audio_sampling_parameters(sample_rate_hz_t samplerate)
 {
-    uint16_t numerator;
-    uint16_t denominator;
+    // The DMA timer runs at numerator / denominator of clk_sys. Find the 16 bit
+    // fraction closest to samplerate, the standard rates are exact at 252 and
+    // 315 MHz.
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    uint32_t numerator = 1;
+    uint32_t denominator = 0xffff; // Slowest possible, if nothing fits
+    uint64_t best_error = 0;
+
+    for (uint32_t n = 1; ; n++) {
+        uint32_t d = ((uint64_t) n * sys_hz + samplerate / 2) / samplerate;
+        if (d > 0xffff) {
+            break;
+        }
 
-    switch (samplerate) {
-    case SAMPLE_RATE_96000_HZ:
-        numerator = 1;
-        denominator = 2625; // No error
-        break;
-    case SAMPLE_RATE_48000_HZ:
-        numerator = 1;
-        denominator = 5250; // No error
-        break;
-    case SAMPLE_RATE_44100_HZ:
-        numerator = 4;
-        denominator = 22857; // Actual freq. 44100.28 Hz
-        break;
-    case SAMPLE_RATE_32000_HZ:
-        numerator = 1;
-        denominator = 7875; // No error
-        break;
-    default:
-        numerator = 1;
-        denominator = 252000000 / samplerate; // There might be rounding errors
-        break;
+        // Error of n / d, times d * samplerate
+        int64_t error = (int64_t) n * sys_hz - (int64_t) d * samplerate;
+        error = (error < 0) ? -error : error;
+
+        // Compare error / d without dividing
+        if (n == 1 || (uint64_t) error * denominator < best_error * d) {
+            numerator = n;
+            denominator = d;
+            best_error = error;
+            if (error == 0) {
+                break;
+            }
+        }
     }
 
+#if AUDIO_DRIFT_CONTROL
+    audio_drift_set_fraction(numerator, denominator);
+#else
     dma_timer_set_fraction(0, numerator, denominator);
+#endif
+}
+#endif
+
+// The audio output rate, the N64's own once AUDIO_RATE_DETECT has measured it
+static uint32_t audio_out_rate(void)
+{
+#if AUDIO_RATE_DETECT
+    uint32_t rate = audio_rate_get();
+    if (rate) {
+        return rate;
+    }
+#endif
+    return g_config.audio_out_sample_rate;
+}
+
+// Everything that follows the audio output rate
+static void audio_rate_changed(void)
+{
+#if !AUDIO_ASRC && !AUDIO_DIRECT_DMA
+    set_audio_sampling_parameters(audio_out_rate());
+#endif
+    set_audio_dvi_parameters(audio_out_rate(), false);
+#if AUDIO_DIRECT_DMA
+    // libdvi reads at the new rate, the difference to the N64 is found again
+    dvi_set_audio_frame_repeat(&dvi0, audio_rate_get_repeat());
+    audio_drift_restart();
+#endif
+}
+
+// Everything derived from clk_sys, called again when a video mode re-clocks it
+static void clocks_changed(void)
+{
+    uart_set_baudrate(UART_ID, BAUD_RATE);
+    pio_sm_set_clkdiv(pio_joybus, sm_joybus, joybus_rx_program_get_clkdiv());
+    audio_rate_changed();
+}
+
+// Capture hooks, only the ones that have anything to do
+#if BEAM_RACE || DEINTERLACE || FRAMEBUF_PALETTE
+static void capture_frame_start(uint32_t *first_line, uint32_t *line_step)
+{
+#if DEINTERLACE
+    *first_line = deinterlace_begin_field(line_step);
+#endif
+#if FRAMEBUF_PALETTE
+    palette_frame_start();
+#endif
+#if BEAM_RACE
+    beam_race_capture_start();
+#endif
+}
+#endif
+
+#if BEAM_RACE
+static void __not_in_flash_func(capture_line)(uint32_t lines)
+{
+#if FULLRES
+    // Before it's marked as captured, core 1 copies the red lane
+    fullres_encode_line(lines - 1);
+#endif
+    beam_race_capture_line(lines);
+}
+#endif
+
+#if DEINTERLACE || FRAMEBUF_PALETTE
+static void capture_frame_end(uint32_t rows)
+{
+#if DEINTERLACE
+    deinterlace_end_field(rows);
+#endif
+#if FRAMEBUF_PALETTE
+    palette_frame_end();
+#endif
 }
+#endif
+
+#if FRAMEBUF_PALETTE || AUDIO_ASRC
+static void __not_in_flash_func(capture_row_skipped)(void)
+{
+#if AUDIO_ASRC
+    audio_asrc_run();
+#endif
+#if FRAMEBUF_PALETTE
+    palette_build(PALETTE_BUILD_CYCLES);
+#endif
+}
+#endif
+
+static const n64_capture_callbacks_t capture_callbacks = {
+#if BEAM_RACE || DEINTERLACE || FRAMEBUF_PALETTE
+    .frame_start = capture_frame_start,
+#endif
+#if BEAM_RACE
+    .line = capture_line,
+#endif
+#if DEINTERLACE || FRAMEBUF_PALETTE
+    .frame_end = capture_frame_end,
+#endif
+#if FRAMEBUF_PALETTE || AUDIO_ASRC
+    .row_skipped = capture_row_skipped,
+#endif
+};
 
 void set_input_pin(int pin, bool pullup, bool pulldown)
 {
@@ -164,8 +390,9 @@ int main(void)
     vreg_set_voltage(VREG_VSEL);
     sleep_ms(10);
 
-    // Run system at TMDS bit clock (252.000 MHz)
-    set_sys_clock_khz(DVI_TIMING.bit_clk_khz, true);
+    // Run system at TMDS bit clock (252.000 MHz for 480p60)
+    const struct dvi_timing *timing = video_mode_get_timing(g_config.video_mode);
+    video_mode_set_sys_clock_khz(timing->bit_clk_khz);
 
     // setup_default_uart();
     stdio_uart_init_full(UART_ID, BAUD_RATE, UART_TX_PIN, UART_RX_PIN);
@@ -175,27 +402,58 @@ int main(void)
 
     printf("Configuring DVI\n");
 
+    // For the cycle counts on core 0, core1_main() starts its own
+    cycles_start();
+
+    framebuf_init();
     gfx_init();
-    dvi0.timing = &DVI_TIMING;
+    dvi0.timing = timing;
     dvi0.ser_cfg = DVI_DEFAULT_SERIAL_CONFIG;
     dvi0.scanline_callback = core1_scanline_callback;
     dvi_init(&dvi0, next_striped_spin_lock_num(), next_striped_spin_lock_num());
+    video_mode_init(&dvi0, clocks_changed);
+#if BEAM_RACE
+    beam_race_init(&dvi0);
+#if FULLRES
+    fullres_init(&dvi0);
+#endif
+#if FRAMEBUF_BPP == 32
+    rgb888_init(&dvi0);
+#endif
+#elif GENLOCK
+    genlock_init(&dvi0);
+#endif
+#if DEINTERLACE
+    deinterlace_init(&dvi0);
+#endif
+#if FRAMEBUF_PALETTE
+    palette_encode_init(&dvi0);
+    palette_init();
+#endif
+#if TMDS_LINE_CACHE
+    line_cache_init(&dvi0);
+#endif
+    color_apply();
+    n64_capture_init(&capture_callbacks);
 
-    // Once we've given core 1 the g_framebuffer, it will just keep on displaying
-    // it without any intervention from core 0
+    // Once we've given core 1 the frame buffers, it will just keep on displaying
+    // whichever was flipped last without any intervention from core 0
 
 #ifdef DIAGNOSTICS
 	// Fill with red
-    sprite_fill16(g_framebuf, RGB888_TO_RGB565(0xFF, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
+    framebuf_fill(RGB888_TO_RGB565(0xFF, 0x00, 0x00));
 #else
     // Fill with black
-    sprite_fill16(g_framebuf, RGB888_TO_RGB565(0x00, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
+    framebuf_fill(RGB888_TO_RGB565(0x00, 0x00, 0x00));
 #endif
 
-    uint16_t *bufptr = g_framebuf;
+    // The first two lines, or the first frame for DVI_FRAMEBUF_WORKER
+    framebuf_pixel_t *bufptr = framebuf_get_scanline(0);
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
-    bufptr += FRAME_WIDTH;
+#if !DVI_FRAMEBUF_WORKER
+    bufptr = framebuf_get_scanline(1);
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
+#endif
 
      // HDMI Audio related
     dvi_get_blank_settings(&dvi0)->top    = 4 * 0;
@@ -235,12 +493,21 @@ int main(void)
 	set_input_pin(n64_JOYBUS_CON1, false, false);
 
     // Video
-    uint offset = pio_add_program(pio, &n64_program);
-    n64_video_program_init(pio, sm_video, offset);
+#if VIDEO_CAPTURE_PACKED
+    uint offset_video = pio_add_program(pio, &n64_packed_program);
+    n64_packed_program_init(pio, sm_video, offset_video);
+#else
+    uint offset_video = pio_add_program(pio, &n64_program);
+    n64_video_program_init(pio, sm_video, offset_video);
+#endif
+
+    // DMA drains the video FIFO into a ring, see video_dma.h
+    video_dma_init(pio, sm_video);
     pio_sm_set_enabled(pio, sm_video, true);
 
     // Audio
-    n64_audio_program_init(pio, sm_audio, offset);
+    uint offset_audio = pio_add_program(pio, &n64_audio_program);
+    n64_audio_program_init(pio, sm_audio, offset_audio);
     pio_sm_set_enabled(pio, sm_audio, true);
 
     // Joybus RX
@@ -286,7 +553,7 @@ int main(void)
     // This is done, so we have a location in RAM where we always
     // have the _latest_ valid audio sample. This is needed because the FIFO filling speed.
     // A workaround is to push multiple times in the PIO, but that's ugly and breaks for low sample rates.
-    uint dma_ch_audio_pio_data = dma_claim_unused_channel(true);
+    dma_ch_audio_pio_data = dma_claim_unused_channel(true);
     uint dma_ch_audio_pio_ctrl = dma_claim_unused_channel(true);
     printf("dma_ch_audio_pio_data=%d\n", dma_ch_audio_pio_data);
     printf("dma_ch_audio_pio_ctrl=%d\n", dma_ch_audio_pio_ctrl);
@@ -296,12 +563,31 @@ int main(void)
     channel_config_set_dreq(&c_audio_pio_data, pio_get_dreq(pio, sm_audio, false));
     channel_config_set_chain_to(&c_audio_pio_data, dma_ch_audio_pio_ctrl);
     channel_config_set_irq_quiet(&c_audio_pio_data, true);
+#if AUDIO_ASRC
+    // Keep every frame instead, wrapping around the input ring
+    channel_config_set_write_increment(&c_audio_pio_data, true);
+    channel_config_set_ring(&c_audio_pio_data, true, __builtin_ctz(sizeof(asrc_input)));
+#elif AUDIO_DIRECT_DMA
+    // Keep every frame instead, wrapping around the audio ring
+    channel_config_set_write_increment(&c_audio_pio_data, true);
+    channel_config_set_ring(&c_audio_pio_data, true, __builtin_ctz(sizeof(audio_buffer)));
+#endif
 
     const volatile void* ptr_audio_pio_rxf = &pio->rxf[sm_audio];
     dma_channel_configure(dma_ch_audio_pio_data, &c_audio_pio_data,
+#if AUDIO_ASRC
+        asrc_input,           // Write to the input ring
+#elif AUDIO_DIRECT_DMA
+        audio_buffer,         // Write to the audio ring
+#else
         &last_audio_sample,   // Write to last_audio_sample
+#endif
         ptr_audio_pio_rxf,    // Read from RX FIFO
+#if AUDIO_RATE_DETECT
+        0xffffffff,           // Count the frames down, see audio_rate.h
+#else
         1,                    // Sample one full buffer
+#endif
         false                 // Do not start immediately
     );
 
@@ -315,7 +601,24 @@ int main(void)
         1,                  // A single transfer is needed to restart data DMA
         true                // Start immediately
     );
+#if AUDIO_RATE_DETECT
+    audio_rate_init(dma_ch_audio_pio_data, g_config.audio_out_sample_rate);
+#endif
+
+#if AUDIO_ASRC
+    // Now every frame lands in asrc_input, core 0 resamples them into audio_buffer
+    dvi_audio_sample_buffer_set(&dvi0, audio_buffer, AUDIO_BUFFER_SIZE);
+    asrc_init(asrc_input, &dvi0.audio_ring, g_config.audio_out_sample_rate);
+#elif AUDIO_DIRECT_DMA
+    // Now every frame lands in audio_buffer, libdvi reads it at the N64's rate
+    audio_drift_init(&dvi0, 0);
 
+    // Write to the beginning of the buffer, read from the middle
+    set_read_offset(&dvi0.audio_ring, (AUDIO_BUFFER_SIZE) / 2);
+
+    // Let the dvi code know which dma channel we use so it can query the write pointer
+    dvi_audio_sample_dma_set_chan(&dvi0, dma_ch_audio_pio_data, audio_buffer, 0, 0, AUDIO_BUFFER_SIZE);
+#else
     // Now there is a dma job running that reads the Audio PIO rx fifo, and puts it in last_audio_sample.
     // Set up data + ctrl loop DMA jobs that reads continuously with 96kHz from last_audio_sample
     // and write the result in a ringbuffer, audio_buffer.
@@ -334,6 +637,9 @@ int main(void)
 
     // Configure the DMA timer that pulls the latest sample at a constant frequency
     dma_timer_claim(0);
+#if AUDIO_DRIFT_CONTROL
+    audio_drift_init(&dvi0, 0);
+#endif
 
     set_audio_sampling_parameters(g_config.audio_out_sample_rate);
 
@@ -366,6 +672,7 @@ int main(void)
 
     // Let the dvi code know which dma channel we use so it can query the write pointer
     dvi_audio_sample_dma_set_chan(&dvi0, dma_ch_audio_buffer_data, audio_buffer, 0, 0, AUDIO_BUFFER_SIZE);
+#endif
 
 #ifdef DIAGNOSTICS_JOYBUS
 
@@ -447,33 +754,6 @@ int main(void)
 
     // Video
 
-    int count = 0;
-    int row = 0;
-    int column = 0;
-
-    #define CSYNCB_POS (0)
-    #define HSYNCB_POS (1)
-    #define CLAMPB_POS (2)
-    #define VSYNCB_POS (3)
-
-    #define CSYNCB_MASK (1 << CSYNCB_POS)
-    #define HSYNCB_MASK (1 << HSYNCB_POS)
-    #define CLAMPB_MASK (1 << CLAMPB_POS)
-    #define VSYNCB_MASK (1 << VSYNCB_POS)
-
-    #define ACTIVE_PIXEL_MASK (VSYNCB_MASK | HSYNCB_MASK | CLAMPB_MASK)
-
-    /*
-    0      8       10   15    1B  1F
-                    v    v     v   v
-                    RRRRRGGGGGGBBBBB
-   xBBBBBBBxGGGGGGGxRRRRRRRXXXXVLHC
-                 BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-                               BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-                 BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-    */
-
-    uint32_t BGRS;
     uint32_t frame = 0;
     uint32_t crop_x = DEFAULT_CROP_X_PAL;
     uint32_t crop_y = DEFAULT_CROP_Y_PAL;
@@ -489,141 +769,130 @@ int main(void)
         // Let the OSD code run
         osd_run();
 
-        // 1. Find posedge VSYNC
-        do {
-            BGRS = pio_sm_get_blocking(pio, sm_video);
-        } while (!(BGRS & VSYNCB_MASK));
+        // Anything left in the capture ring is from the previous frame
+        video_dma_resync();
 
-        // printf("VSYNC\n");
+        // Capture as many rows as the output shows, per field when interlaced
+        uint32_t frame_height = dvi0.timing->v_active_lines / DVI_VERTICAL_REPEAT;
+        uint32_t row = n64_capture_frame(crop_x, crop_y, frame_height);
+#if AUDIO_ASRC
+        audio_asrc_run();
+#endif
 
-        int active_row = 0;
-        for (row = 0; ; row++) {
+#if GENLOCK
+        genlock_update(GENLOCK_TARGET_LINE);
+#endif
+#if AUDIO_DRIFT_CONTROL
+        audio_drift_update();
+#endif
+#if AUDIO_RATE_DETECT
+        if (audio_rate_update()) {
+            // The game changed the AI rate, the DMA timer or libdvi and the HDMI stream follow
+            audio_rate_changed();
+        }
+#endif
 
-            int skip_row = (
-                (row % 2 != 0) ||            // Skip every second line (TODO: Add blend option later)
-                (row < crop_y) ||            // crop_y, number of rows to skip vertically from the top
-                (active_row >= FRAME_HEIGHT) // Never attempt to write more rows than the g_framebuffer
-            );
+        // Show diagnostic information every 100 frames, for 1 second
 
-            // 2. Find posedge HSYNC
-            do {
-                BGRS = pio_sm_get_blocking(pio, sm_video);
+#ifdef DIAGNOSTICS
+        if (frame % (50) == 0) {
+            uint32_t y = 0;
+            t1 = *pGetTime;
 
-                if ((BGRS & VSYNCB_MASK) == 0) {
-                    // VSYNC found, time to quit
-                    goto end_of_line;
-                }
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "Delta %d", (t1 - t0));
 
-            } while ((BGRS & ACTIVE_PIXEL_MASK) != ACTIVE_PIXEL_MASK);
+            const n64_capture_stats_t *capture_stats = n64_capture_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "row %d", capture_stats->rows);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "column %d", capture_stats->columns);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "count %d", capture_stats->pixels);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "convert cycles %d max %d", capture_stats->convert_cycles, capture_stats->convert_max_cycles);
+
+            const video_dma_stats_t *dma_stats = video_dma_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "frame cycles %d", dma_stats->frame_cycles);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "idle cycles %d", dma_stats->idle_cycles);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "idle cycles/row %d", dma_stats->idle_cycles_per_row);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "overruns %d", dma_stats->overruns);
+
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "scanline irq max %d avg %d cycles", scanline_callback_cycles, scanline_callback_average);
+#if DVI_IRQ_STATS
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "dvi irq %d data island %d cycles", dvi0.irq_cycles, dvi0.data_packet_cycles);
+#endif
 
-            if (skip_row) {
-                // Skip rows based on logic above
-                do {
-                    BGRS = pio_sm_get_blocking(pio, sm_video);
+            const framebuf_stats_t *fb_stats = framebuf_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "flips %d", fb_stats->flips);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "drops %d", fb_stats->drops);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "repeats %d", fb_stats->repeats);
 
-                    if ((BGRS & VSYNCB_MASK) == 0) {
-                        // VSYNC found, time to quit
-                        goto end_of_line;
-                    }
-                } while ((BGRS & ACTIVE_PIXEL_MASK) == ACTIVE_PIXEL_MASK);
+#if BEAM_RACE
+            const beam_race_stats_t *beam_stats = beam_race_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "lag %d", beam_stats->lag);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "late lines %d total %d", beam_stats->late_lines, beam_stats->late_total);
+#endif
 
-                continue;
-            }
+#if FULLRES
+            const fullres_stats_t *fullres_stats = fullres_get_stats();
+            // Nothing can be drawn at full resolution
+            printf("encode core0 %d core1 %d of %d cycles/line\n", (int) fullres_stats->core0_cycles, (int) fullres_stats->core1_cycles, (int) fullres_stats->budget_cycles);
+#endif
 
-            // printf("HSYNC\n");
-            count = active_row * FRAME_WIDTH;
-            int count_max = count + FRAME_WIDTH;
-            active_row++;
-
-            column = 0;
-
-            // 3.  Capture scanline
-
-            // 3.1 Crop left black bar
-            for (int left_ctr = 0; left_ctr < crop_x; left_ctr++) {
-                BGRS = pio_sm_get_blocking(pio, sm_video);
-            };
-
-            // 3.2 Capture active pixels
-            BGRS = pio_sm_get_blocking(pio, sm_video);
-
-            // This code is duplucated for performance reasons - 555 and 565 respectively
-
-            if (g_config.dvi_color_mode == DVI_RGB_555) {
-                do {
-                    // 3.3 Convert to RGB555
-                    g_framebuf[count++] = (
-                        ((BGRS <<  1) & 0xf800) |
-                        ((BGRS >> 12) & 0x07e0) |
-                        ((BGRS >> 26) & 0x001f)
-                        // | 0x1f // Uncomment to tint everything with blue
-                    );
-
-                    // Never write more than the line width.
-                    // Input might be weird and have too many active pixels - discard in those cases.
-                    if (count >= count_max) {
-                        do {
-                            // Consume all active pixels
-                            BGRS = pio_sm_get_blocking(pio, sm_video);
-                        } while ((BGRS & ACTIVE_PIXEL_MASK) == ACTIVE_PIXEL_MASK);
-                        break;
-                    }
-
-                    // 3.4 Skip every second pixel
-                    BGRS = pio_sm_get_blocking(pio, sm_video);
-
-                    // 3.5 Count number of pixels processed on this row
-                    column += 2; // Fuse two increments into one instruction
-
-                    // Fetch new pixel in the end, so the loop logic can react to it first
-                    BGRS = pio_sm_get_blocking(pio, sm_video);
-                } while (1);
-            } else if (g_config.dvi_color_mode == DVI_RGB_565) {
-                do {
-                    // 3.3 Convert to RGB565
-                    g_framebuf[count++] = (
-                        ((BGRS <<  1) & 0xf800) |
-                        ((BGRS >> 12) & 0x07c0) | // Mask so only 5 bits for green are used
-                        ((BGRS >> 26) & 0x001f)
-                        // | 0x1f // Uncomment to tint everything with blue
-                    );
-
-                    // Never write more than the line width.
-                    // Input might be weird and have too many active pixels - discard in those cases.
-                    if (count >= count_max) {
-                        do {
-                            // Consume all active pixels
-                            BGRS = pio_sm_get_blocking(pio, sm_video);
-                        } while ((BGRS & ACTIVE_PIXEL_MASK) == ACTIVE_PIXEL_MASK);
-                        break;
-                    }
-
-                    // 3.4 Skip every second pixel
-                    BGRS = pio_sm_get_blocking(pio, sm_video);
-
-                    // 3.5 Count number of pixels processed on this row
-                    column += 2; // Fuse two increments into one instruction
-
-                    // Fetch new pixel in the end, so the loop logic can react to it first
-                    BGRS = pio_sm_get_blocking(pio, sm_video);
-                } while (1);
-            } else {
-                // Panic
-            }
-        }
+#if FRAMEBUF_BPP == 32
+            const rgb888_stats_t *rgb888_stats = rgb888_get_stats();
+            // Nothing can be drawn on the ring of lines either
+            printf("encode rgb888 %d of %d cycles/line\n", (int) rgb888_stats->cycles, (int) rgb888_stats->budget_cycles);
+#endif
 
-end_of_line:
-        // Show diagnostic information every 100 frames, for 1 second
+#if FRAMEBUF_PALETTE
+            const palette_stats_t *palette_stats = palette_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "palette %d colors %d entries %d/%d cycles", palette_stats->colors, palette_stats->entries, palette_stats->build_cycles, palette_stats->build_max_cycles);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "error %d rgb332 %d", palette_stats->error, palette_stats->error_332);
+            const palette_encode_stats_t *palette_encode_stats = palette_encode_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "encode %d of %d cycles/line", palette_encode_stats->cycles, palette_encode_stats->budget_cycles);
+#endif
 
-#ifdef DIAGNOSTICS
-        if (frame % (50) == 0) {
-            uint32_t y = 0;
-            t1 = *pGetTime;
+#if AUDIO_ASRC
+            const asrc_stats_t *asrc_stats = asrc_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "asrc in %d hz resyncs %d", asrc_stats->input_rate, asrc_stats->resyncs);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "asrc %d max %d cycles", asrc_stats->cycles, asrc_stats->max_cycles);
+#endif
 
-            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "Delta %d", (t1 - t0));
-            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "row %d", row);
-            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "column %d", column);
-            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "count %d", count);
+#if AUDIO_DRIFT_CONTROL
+            const audio_drift_stats_t *drift_stats = audio_drift_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "audio gap %d min %d max %d", drift_stats->gap, drift_stats->min_gap, drift_stats->max_gap);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "audio rate %d ppm fast %d slow %d recenter %d", drift_stats->rate / 256, drift_stats->speedups, drift_stats->slowdowns, drift_stats->recenters);
+#endif
+
+#if AUDIO_RATE_DETECT
+            const audio_rate_stats_t *rate_stats = audio_rate_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "audio in %d hz out %d hz changes %d", rate_stats->measured, rate_stats->rate, rate_stats->changes);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "audio cts %d n %d repeat %d", rate_stats->cts, rate_stats->n, rate_stats->repeat);
+#endif
+
+#if TMDS_LINE_CACHE
+            const line_cache_stats_t *line_cache_stats = line_cache_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "line cache %d of %d hits", line_cache_stats->hits, line_cache_stats->lines);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "core1 busy %d cycles idle %d%%", line_cache_stats->busy_cycles, line_cache_stats->idle_percent);
+#endif
+
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "crop %d %d updates %d", g_autocrop.crop_x, g_autocrop.crop_y, g_autocrop.updates);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "area x %d-%d y %d-%d", g_autocrop.left, g_autocrop.right, g_autocrop.top, g_autocrop.bottom);
+
+            const dedither_stats_t *dedither_stats = dedither_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "dedither %d max %d of %d cycles/line", dedither_stats->cycles, dedither_stats->max_cycles, dedither_stats->budget_cycles);
+
+#if DEINTERLACE
+            const deinterlace_stats_t *deinterlace_stats = deinterlace_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "interlaced %d field %d woven %d", deinterlace_stats->interlaced, deinterlace_stats->field, deinterlace_stats->fields);
+#endif
+
+            const video_mode_stats_t *mode_stats = video_mode_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "mode switches %d blackout %d us", mode_stats->switches, mode_stats->blackout_us);
+
+#if BEAM_RACE || GENLOCK
+            const genlock_stats_t *genlock_stats = genlock_get_stats();
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "phase %d adjust %d", genlock_stats->phase_error, genlock_stats->adjust);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "rate %d locked %d", genlock_stats->rate, genlock_stats->locked);
+            gfx_puttextf(0, ++y * 8, 0xffff, 0x0000, "slips %d", genlock_stats->slips);
+#endif
 
 
             sleep_ms(2000);
@@ -632,15 +901,26 @@ end_of_line:
 #endif
 
         // Perform NTSC / PAL detection based on number of rows
-        if (IN_TOLERANCE(row, ROWS_PAL, ROWS_TOLERANCE)) {
+        bool pal = IN_TOLERANCE(row, ROWS_PAL, ROWS_TOLERANCE);
+        if (pal) {
             crop_x = DEFAULT_CROP_X_PAL;
+#if PAL_50HZ
+            crop_y = DEFAULT_CROP_Y_PAL_50HZ;
+#else
             crop_y = DEFAULT_CROP_Y_PAL;
+#endif
         } else {
             // In case the mode can't be detected, default to NTSC as it crops fewer rows
             crop_x = DEFAULT_CROP_X_NTSC;
             crop_y = DEFAULT_CROP_Y_NTSC;
         }
 
+        // Replace the defaults with the measured crop, once there is one
+        autocrop_frame_end(pal, frame_height, &crop_x, &crop_y);
+
+        // Follow the console between 50 and 60 Hz
+        video_mode_update_standard(pal);
+
 #ifdef DIAGNOSTICS_JOYBUS
     {
         // Use helper functions to decode the last controller state
@@ -0,0 +1,580 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "n64_capture.h"
+
+#include "pico/stdlib.h"
+#include "hardware/interp.h"
+
+#include "framebuf.h"
+#include "video_dma.h"
+#include "dedither.h"
+#include "autocrop.h"
+#include "palette.h"
+#include "cycles.h"
+
+/*
+ 0      8       10   15    1B  1F
+                 v    v     v   v
+                 RRRRRGGGGGGBBBBB
+xBBBBBBBxGGGGGGGxRRRRRRRXXXXVLHC
+              BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+                            BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+              BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+*/
+
+#if VIDEO_CAPTURE_PACKED
+// See n64_packed in n64.pio, each word holds two of every four VI pixels
+#define CLAMPB_POS (30)
+#define VSYNCB_POS (31)
+
+#define CLAMPB_MASK (1u << CLAMPB_POS)
+#define VSYNCB_MASK (1u << VSYNCB_POS)
+
+#define ACTIVE_PIXEL_MASK (VSYNCB_MASK | CLAMPB_MASK)
+
+// Upper four bits of each color of both pixels
+#define NON_BLACK_MASK (0x3def7bde)
+
+#define VI_PIXELS_PER_WORD (4)
+#else
+#define CSYNCB_POS (0)
+#define HSYNCB_POS (1)
+#define CLAMPB_POS (2)
+#define VSYNCB_POS (3)
+
+#define CSYNCB_MASK (1 << CSYNCB_POS)
+#define HSYNCB_MASK (1 << HSYNCB_POS)
+#define CLAMPB_MASK (1 << CLAMPB_POS)
+#define VSYNCB_MASK (1 << VSYNCB_POS)
+
+#define ACTIVE_PIXEL_MASK (VSYNCB_MASK | HSYNCB_MASK | CLAMPB_MASK)
+
+// Upper five bits of each color
+#define NON_BLACK_MASK (0x7c7c7c00)
+
+#define VI_PIXELS_PER_WORD (1)
+#endif
+
+// VI words per frame pixel, every second one is skipped unless capturing at full resolution
+#define VI_PIXEL_STRIDE FRAME_HORIZONTAL_REPEAT
+
+#if !VIDEO_CAPTURE_PACKED && FRAMEBUF_BPP != 32 && !FRAMEBUF_PALETTE
+// Set up interp1 to extract two channels of a VI word at once. Each lane
+// shifts the word right and masks the channel into place, lane 1 reads
+// ACCUM0 as well, and the full result is the sum of both.
+static inline void convert_interp_init(uint shift0, uint lsb0, uint msb0, uint shift1, uint lsb1, uint msb1)
+{
+    interp_config c = interp_default_config();
+    interp_config_set_shift(&c, shift0);
+    interp_config_set_mask(&c, lsb0, msb0);
+    interp_set_config(interp1, 0, &c);
+
+    c = interp_default_config();
+    interp_config_set_shift(&c, shift1);
+    interp_config_set_mask(&c, lsb1, msb1);
+    interp_config_set_cross_input(&c, true);
+    interp_set_config(interp1, 1, &c);
+
+    interp_set_base(interp1, 0, 0);
+    interp_set_base(interp1, 1, 0);
+    interp_set_base(interp1, 2, 0);
+}
+
+// Set up interp1 for convert_run_interp in the current pixel format
+static inline void convert_interp_setup(void)
+{
+#if FRAMEBUF_BPP == 8
+    // Red (bits 7-5) and green (bits 4-2)
+    convert_interp_init(7, 5, 7, 18, 2, 4);
+#else
+    // Green (bits 10-5, or 10-6 in RGB565 mode) and blue (bits 4-0)
+    convert_interp_init(12, (g_config.dvi_color_mode == DVI_RGB_565) ? 6 : 5, 10, 26, 0, 4);
+#endif
+}
+#endif
+
+#if FRAMEBUF_BPP == 8
+
+// Convert words from the n64_packed program to pairs of RGB332 pixels
+static inline void __attribute__((always_inline)) convert_run_packed(framebuf_pixel_t *dst_pixels, const uint32_t *src, uint32_t words)
+{
+    uint16_t *dst = (uint16_t *) dst_pixels;
+    const uint32_t *end = src + words;
+    while (src != end) {
+        uint32_t RGB2 = *src++;
+        *dst++ = (
+            ((RGB2 >> 22) & 0x00e0) | // Pixel 0 R
+            ((RGB2 >> 20) & 0x001c) | // Pixel 0 G
+            ((RGB2 >> 18) & 0x0003) | // Pixel 0 B
+            ((RGB2 <<  1) & 0xe000) | // Pixel 1 R
+            ((RGB2 <<  3) & 0x1c00) | // Pixel 1 G
+            ((RGB2 <<  5) & 0x0300)   // Pixel 1 B
+        );
+    }
+}
+
+// Convert every VI_PIXEL_STRIDE VI word of src to RGB332
+static inline void __attribute__((always_inline)) convert_run_332(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        *dst++ = (
+            ((BGRS >>  7) & 0xe0) |
+            ((BGRS >> 18) & 0x1c) |
+            ((BGRS >> 29) & 0x03)
+        );
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+// Like convert_run_332, with red and green from interp1
+static inline void __attribute__((always_inline)) convert_run_interp(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        interp_set_accumulator(interp1, 0, BGRS);
+        *dst++ = interp_peek_full_result(interp1) | ((BGRS >> 29) & 0x03);
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+#if FRAMEBUF_PALETTE
+// Palette of the frame being captured, see get_capture_line()
+static const uint8_t *palette_lut;
+static uint16_t *palette_histogram;
+
+// Convert every VI_PIXEL_STRIDE VI word of src to a palette index
+static inline void __attribute__((always_inline)) convert_run_palette(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const uint8_t *lut = palette_lut;
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        *dst++ = lut[palette_bin(*src)];
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+// The same, counting the color of every pixel
+static inline void __attribute__((always_inline)) convert_run_palette_count(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const uint8_t *lut = palette_lut;
+    uint16_t *histogram = palette_histogram;
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t bin = palette_bin(*src);
+        uint32_t n = histogram[bin] + 1;
+        histogram[bin] = n - (n >> 16); // Saturate
+        *dst++ = lut[bin];
+        src += VI_PIXEL_STRIDE;
+    }
+}
+#endif
+
+#elif FRAMEBUF_BPP == 32
+
+// Convert every VI_PIXEL_STRIDE VI word of src to the red and green plane and
+// the blue plane, 7 bits per channel
+static inline void __attribute__((always_inline)) convert_run_888(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        dst[FRAMEBUF_PLANE_BLUE] = (BGRS >> 15) & 0xfe00;
+        *dst++ = ((BGRS << 1) & 0xfe00) | ((BGRS >> 15) & 0x00fe);
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+#else
+
+// Convert words from the n64_packed program to pairs of RGB555 pixels
+static inline void __attribute__((always_inline)) convert_run_packed(framebuf_pixel_t *dst_pixels, const uint32_t *src, uint32_t words)
+{
+    uint32_t *dst = (uint32_t *) dst_pixels;
+    const uint32_t *end = src + words;
+    while (src != end) {
+        uint32_t RGB2 = *src++;
+        *dst++ = (
+            ((RGB2 >> 14) & 0x0000ffc0) | // Pixel 0 R, G
+            ((RGB2 >> 15) & 0x0000001f) | // Pixel 0 B
+            ((RGB2 << 17) & 0xffc00000) | // Pixel 1 R, G
+            ((RGB2 << 16) & 0x001f0000)   // Pixel 1 B
+        );
+    }
+}
+
+// Convert every VI_PIXEL_STRIDE VI word of src to RGB555
+static inline void __attribute__((always_inline)) convert_run_555(uint16_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const uint16_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        *dst++ = (
+            ((BGRS <<  1) & 0xf800) |
+            ((BGRS >> 12) & 0x07e0) |
+            ((BGRS >> 26) & 0x001f)
+            // | 0x1f // Uncomment to tint everything with blue
+        );
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+// Convert every VI_PIXEL_STRIDE VI word of src to RGB565
+static inline void __attribute__((always_inline)) convert_run_565(uint16_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const uint16_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        *dst++ = (
+            ((BGRS <<  1) & 0xf800) |
+            ((BGRS >> 12) & 0x07c0) | // Mask so only 5 bits for green are used
+            ((BGRS >> 26) & 0x001f)
+            // | 0x1f // Uncomment to tint everything with blue
+        );
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+// Like convert_run_555 and convert_run_565, with green and blue from interp1.
+// Red has to move left, which the interpolator can't do.
+static inline void __attribute__((always_inline)) convert_run_interp(framebuf_pixel_t *dst, const uint32_t *src, uint32_t pixels)
+{
+    const framebuf_pixel_t *end = dst + pixels;
+    while (dst != end) {
+        uint32_t BGRS = *src;
+        interp_set_accumulator(interp1, 0, BGRS);
+        *dst++ = ((BGRS << 1) & 0xf800) | interp_peek_full_result(interp1);
+        src += VI_PIXEL_STRIDE; // Skip every second pixel, unless at full resolution
+    }
+}
+
+#endif
+
+// Built without LINE_BLEND too, for host/capturebench
+#if FRAMEBUF_BPP == 8 || FRAMEBUF_BPP == 16
+
+#if FRAMEBUF_BPP == 8
+// Lowest bit of each channel of four RGB332 pixels
+#define BLEND_LSB_MASK (0x25252525)
+#else
+// Lowest bit of each channel of two RGB565 pixels
+#define BLEND_LSB_MASK (0x08210821)
+#endif
+
+#define BLEND_WORDS (FRAME_WIDTH * sizeof(framebuf_pixel_t) / sizeof(uint32_t))
+
+#if LINE_BLEND
+// Row captured to be blended into the row above it
+static framebuf_pixel_t blend_buffer[FRAME_WIDTH] __attribute__((aligned(4)));
+#endif
+
+// Average all pixels in a word at once, rounding down. Channels are halved
+// with their lowest bit masked off, so nothing carries into the next channel.
+static inline void __attribute__((always_inline)) blend_run(uint32_t *dst, const uint32_t *src, uint32_t words)
+{
+    const uint32_t *end = src + words;
+    while (src != end) {
+        uint32_t a = *dst;
+        uint32_t b = *src++;
+        *dst++ = (a & b) + (((a ^ b) & ~BLEND_LSB_MASK) >> 1);
+    }
+}
+
+#endif
+
+
+// Capture the active pixels of a line with one of the converters above, a
+// whole DMA run at a time. Never write more than the line width, input might
+// be weird and have too many active pixels - the rest is discarded later.
+// Each pixel format gets its own copy, so there is no branch on the format
+// in the loop.
+typedef void (*capture_line_t)(framebuf_pixel_t *dst);
+
+// Words from the n64_packed program, the skipped pixels never made it here
+#define DEFINE_CAPTURE_LINE_PACKED(name, convert)                               \
+static void __not_in_flash_func(name)(framebuf_pixel_t *dst)                    \
+{                                                                               \
+    uint32_t left = FRAME_WIDTH / 2;                                            \
+    while (left) {                                                              \
+        uint32_t available;                                                     \
+        const uint32_t *src = video_dma_acquire(&available);                    \
+        uint32_t words = MIN(available, left);                                  \
+                                                                                \
+        convert(dst, src, words);                                               \
+        video_dma_release(words);                                               \
+                                                                                \
+        dst += 2 * words;                                                       \
+        left -= words;                                                          \
+    }                                                                           \
+}
+
+// One word per VI pixel, every VI_PIXEL_STRIDE-th is converted
+#define DEFINE_CAPTURE_LINE(name, convert)                                      \
+static void __not_in_flash_func(name)(framebuf_pixel_t *dst)                    \
+{                                                                               \
+    uint32_t left = FRAME_WIDTH;                                                \
+    while (left) {                                                              \
+        uint32_t available;                                                     \
+        const uint32_t *src = video_dma_acquire(&available);                    \
+        uint32_t pixels = MIN((available + VI_PIXEL_STRIDE - 1) / VI_PIXEL_STRIDE, left); \
+                                                                                \
+        convert(dst, src, pixels);                                              \
+                                                                                \
+        dst += pixels;                                                          \
+        left -= pixels;                                                         \
+                                                                                \
+        /* Skip every second pixel, which may not have arrived yet */           \
+        if (VI_PIXEL_STRIDE * pixels > available) {                             \
+            video_dma_release(available);                                       \
+            if (left) {                                                         \
+                video_dma_get();                                                \
+            }                                                                   \
+        } else {                                                                \
+            video_dma_release(VI_PIXEL_STRIDE * pixels);                        \
+        }                                                                       \
+    }                                                                           \
+}
+
+#if VIDEO_CAPTURE_PACKED
+DEFINE_CAPTURE_LINE_PACKED(capture_line_packed, convert_run_packed)
+#elif FRAMEBUF_BPP == 32
+DEFINE_CAPTURE_LINE(capture_line_888, convert_run_888)
+#elif FRAMEBUF_PALETTE
+DEFINE_CAPTURE_LINE(capture_line_palette, convert_run_palette)
+DEFINE_CAPTURE_LINE(capture_line_palette_count, convert_run_palette_count)
+#elif VIDEO_CONVERT_INTERP
+DEFINE_CAPTURE_LINE(capture_line_interp, convert_run_interp)
+#elif FRAMEBUF_BPP == 8
+DEFINE_CAPTURE_LINE(capture_line_332, convert_run_332)
+#else
+DEFINE_CAPTURE_LINE(capture_line_555, convert_run_555)
+DEFINE_CAPTURE_LINE(capture_line_565, convert_run_565)
+#endif
+
+static const n64_capture_callbacks_t no_callbacks;
+
+static struct {
+    const n64_capture_callbacks_t *callbacks;
+    n64_capture_stats_t stats;
+} state = {
+    .callbacks = &no_callbacks,
+};
+
+// The line capture for the current pixel format
+static capture_line_t get_capture_line(void)
+{
+#if VIDEO_CAPTURE_PACKED
+    return capture_line_packed;
+#elif FRAMEBUF_BPP == 32
+    return capture_line_888;
+#elif FRAMEBUF_PALETTE
+    palette_lut = palette_get_lut();
+    palette_histogram = palette_get_histogram();
+    return palette_histogram ? capture_line_palette_count : capture_line_palette;
+#elif VIDEO_CONVERT_INTERP
+    convert_interp_setup();
+    return capture_line_interp;
+#elif FRAMEBUF_BPP == 8
+    return capture_line_332;
+#else
+    return (g_config.dvi_color_mode == DVI_RGB_565) ? capture_line_565 : capture_line_555;
+#endif
+}
+
+// 2. Find posedge HSYNC, false if VSYNC comes first
+static inline bool find_hsync(void)
+{
+    uint32_t BGRS;
+    do {
+        BGRS = video_dma_get();
+
+        if ((BGRS & VSYNCB_MASK) == 0) {
+            return false;
+        }
+
+    } while ((BGRS & ACTIVE_PIXEL_MASK) != ACTIVE_PIXEL_MASK);
+
+    return true;
+}
+
+void n64_capture_init(const n64_capture_callbacks_t *callbacks)
+{
+    state.callbacks = callbacks;
+}
+
+uint32_t n64_capture_frame(uint32_t crop_x, uint32_t crop_y, uint32_t frame_height)
+{
+    const n64_capture_callbacks_t *callbacks = state.callbacks;
+    capture_line_t capture_line = get_capture_line();
+    uint32_t BGRS;
+    int count = 0;
+    uint32_t row = 0;
+    int column = 0;
+
+    // 1. Find posedge VSYNC
+    do {
+        BGRS = video_dma_get();
+    } while (!(BGRS & VSYNCB_MASK));
+
+    // printf("VSYNC\n");
+
+    // Capture as many rows as the output shows, per field when interlaced
+    uint32_t active_row = 0;
+    uint32_t line_first = 0;
+    uint32_t line_step = 1;
+    framebuf_pixel_t *back = NULL;
+#if FRAMEBUF_BPP == 16
+    bool dedither_above = false; // The previous captured line went through dedither_line()
+#endif
+#if LINE_BLEND
+    uint32_t captured_row = UINT32_MAX - 1; // None yet, no row is one past it
+    framebuf_pixel_t *captured_line = NULL;
+#endif
+    for (row = 0; ; row++) {
+
+        int skip_row = (
+            (row % 2 != 0) ||            // Skip every second line, or blend it (see below)
+            (row < crop_y) ||            // crop_y, number of rows to skip vertically from the top
+            (active_row >= frame_height) // Never attempt to write more rows than the frame buffer
+        );
+
+#if LINE_BLEND
+        // The row right below a captured row is blended into it, unless fields are woven
+        bool blend_row = (row % 2 != 0) && (row == captured_row + 1) && (line_step == 1);
+        if (blend_row) {
+            skip_row = 0;
+        }
+#endif
+
+        if (!skip_row && active_row == 0) {
+            // Get a buffer as late as possible, core 1 might still be showing it
+            back = framebuf_begin();
+            if (back == NULL) {
+                // Drop this frame
+                active_row = frame_height;
+                skip_row = 1;
+            }
+            if (callbacks->frame_start) {
+                callbacks->frame_start(&line_first, &line_step);
+            }
+        }
+
+        // 2. Find posedge HSYNC
+        if (!find_hsync()) {
+            // VSYNC found, time to quit
+            break;
+        }
+
+        if (skip_row) {
+            // Skip rows based on logic above, measuring some for the auto crop
+            if (autocrop_probe(row)) {
+                uint32_t first;
+                uint32_t last;
+                BGRS = video_dma_scan_while_set(ACTIVE_PIXEL_MASK, NON_BLACK_MASK, &first, &last);
+                if (first != UINT32_MAX) {
+                    autocrop_row(row, first * VI_PIXELS_PER_WORD, (last + 1) * VI_PIXELS_PER_WORD);
+                }
+            } else {
+                BGRS = video_dma_skip_while_set(ACTIVE_PIXEL_MASK);
+            }
+
+            if ((BGRS & VSYNCB_MASK) == 0) {
+                // VSYNC found, time to quit
+                break;
+            }
+
+            if (callbacks->row_skipped) {
+                callbacks->row_skipped();
+            }
+            continue;
+        }
+
+        // printf("HSYNC\n");
+        framebuf_pixel_t *line;
+#if LINE_BLEND
+        if (blend_row) {
+            // Captured aside, then averaged into the line above
+            line = blend_buffer;
+        } else
+#endif
+        {
+            count = active_row * FRAME_WIDTH;
+            line = framebuf_line(back, line_first + active_row * line_step);
+            active_row++;
+        }
+
+        column = 0;
+
+        // 3.  Capture scanline
+
+        // 3.1 Crop left black bar
+        for (uint32_t left_ctr = 0; left_ctr < crop_x / VI_PIXELS_PER_WORD; left_ctr++) {
+            BGRS = video_dma_get();
+        };
+
+        // 3.2 Capture and convert active pixels, counting the time spent
+        // converting rather than waiting for them
+        uint32_t t0 = cycles_now();
+        uint32_t idle0 = g_video_dma.idle_cycles;
+        capture_line(line);
+        state.stats.convert_cycles = cycles_since(t0) - (g_video_dma.idle_cycles - idle0);
+        state.stats.convert_max_cycles = MAX(state.stats.convert_max_cycles, state.stats.convert_cycles);
+
+#if FRAMEBUF_BPP == 16
+        // 3.3 Smooth out the dither pattern
+        if (g_config.dedither) {
+            dedither_line(line, dedither_above);
+        }
+        dedither_above = g_config.dedither;
+#endif
+
+#if LINE_BLEND
+        if (blend_row) {
+            blend_run((uint32_t *) captured_line, (const uint32_t *) blend_buffer, BLEND_WORDS);
+
+            // Consume all active pixels
+            BGRS = video_dma_skip_while_set(ACTIVE_PIXEL_MASK);
+            continue;
+        }
+        captured_row = row;
+        captured_line = line;
+#endif
+
+        // 3.4 Count number of pixels processed on this row
+        count += FRAME_WIDTH;
+        column = VI_PIXEL_STRIDE * FRAME_WIDTH;
+
+        if (callbacks->line) {
+            callbacks->line(active_row);
+        }
+
+        // Consume all active pixels
+        BGRS = video_dma_skip_while_set(ACTIVE_PIXEL_MASK);
+    }
+
+    video_dma_frame_end(row);
+
+    if (callbacks->frame_end) {
+        callbacks->frame_end(row);
+    }
+
+    // Show the new frame from the next DVI frame on
+    framebuf_flip();
+
+    state.stats.rows = row;
+    state.stats.pixels = count;
+    state.stats.columns = column;
+
+    return row;
+}
+
+const n64_capture_stats_t *n64_capture_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,93 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file n64_capture.h
+ * @brief Capture of VI frames into the frame buffer.
+ *
+ * Finds VSYNC and HSYNC in the VI words, crops, converts the active pixels
+ * and hands the frame over to the output. The words come from video_dma.h,
+ * and nothing else in here touches the hardware, so the same code runs on
+ * the host against a recorded VI trace (see host/vireplay.c).
+ *
+ * Whatever else has to happen per frame or per line, like beam racing or
+ * deinterlacing, is hooked in with callbacks. The pixel conversion is
+ * compiled once per pixel format, and picked once per frame.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * @struct n64_capture_callbacks
+ * @brief Hooks called from the capture loop (core 0), any of them may be NULL.
+ */
+typedef struct n64_capture_callbacks {
+    /**
+     * @brief Called before the first line of a frame is captured.
+     * @param first_line The first frame buffer line to capture into, 0 by default.
+     * @param line_step The frame buffer lines from one captured line to the next, 1 by default.
+     */
+    void (*frame_start)(uint32_t *first_line, uint32_t *line_step);
+
+    /**
+     * @brief Called after each line is captured.
+     * @param lines The number of lines captured so far in this frame.
+     */
+    void (*line)(uint32_t lines);
+
+    /**
+     * @brief Called after each row that is skipped rather than captured.
+     *
+     * Time for work that can be spread over the frame. The ring holds a few
+     * rows, which the capture catches up on, so it may take up to half a row.
+     */
+    void (*row_skipped)(void);
+
+    /**
+     * @brief Called on the VSYNC that ends a frame, before it is handed over.
+     * @param rows The number of VI rows in the frame.
+     */
+    void (*frame_end)(uint32_t rows);
+} n64_capture_callbacks_t;
+
+/**
+ * @struct n64_capture_stats
+ * @brief Counters of the last captured frame.
+ */
+typedef struct n64_capture_stats {
+    uint32_t rows;               ///< Number of VI rows in the frame.
+    uint32_t pixels;             ///< Number of pixels captured, up to the last captured line.
+    uint32_t columns;            ///< Number of VI pixels captured on the last line.
+    uint32_t convert_cycles;     ///< Cycles spent converting the last line, not counting waits for the DMA.
+    uint32_t convert_max_cycles; ///< Cycles spent converting the slowest line, since boot.
+} n64_capture_stats_t;
+
+/**
+ * @brief Set the callbacks.
+ * @param callbacks The callbacks, kept by reference.
+ */
+void n64_capture_init(const n64_capture_callbacks_t *callbacks);
+
+/**
+ * @brief Capture one frame (core 0).
+ *
+ * Waits for the next VSYNC, captures up to frame_height lines into a buffer
+ * from framebuf_begin() and flips it on the VSYNC after that.
+ * @param crop_x VI pixels to skip on the left of every row.
+ * @param crop_y VI rows to skip on the top.
+ * @param frame_height The number of lines to capture.
+ * @return The number of VI rows in the frame.
+ */
+uint32_t n64_capture_frame(uint32_t crop_x, uint32_t crop_y, uint32_t frame_height);
+
+/**
+ * @brief Get the counters of the last captured frame.
+ * @return A pointer to the counters.
+ */
+const n64_capture_stats_t *n64_capture_get_stats(void);
@@ -11,6 +11,9 @@
 #include "gfx.h"
 #include "osd.h"
 #include "joybus.h"
+#include "video_mode.h"
+#include "autocrop.h"
+#include "color.h"
 
 typedef enum item_type {
     ITEM_TYPE_TEXT = 0,
@@ -31,8 +34,13 @@ typedef struct menu_item {
         int32_t *value_i32;
         void *value_ptr;
     } value;
+    uint32_t max;              // Largest value of ITEM_TYPE_VALUE_RW_U32, the smallest is 0
+    const char *const *names;  // Optional names of the values
+    void (*on_change)(void);   // Optional, called after the value changed
 } menu_item_t;
 
+static const char *const off_on_names[] = {"Off", "On"};
+
 menu_item_t menu_audio[] = {
     {
         .text = "OSD Audio Menu",
@@ -46,6 +54,122 @@ menu_item_t menu_audio[] = {
     }
 };
 
+menu_item_t menu_video[] = {
+    {
+        .text = "OSD Video Menu",
+    },
+    {
+        .text = "Mode",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.video_mode,
+        .max = VIDEO_MODE_COUNT - 1,
+        .names = video_mode_names,
+        .on_change = video_mode_apply,
+    },
+#if PAL_50HZ
+    {
+        .text = "PAL mode",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.video_mode_pal,
+        .max = VIDEO_MODE_COUNT - 1,
+        .names = video_mode_names,
+        .on_change = video_mode_apply,
+    },
+#endif
+#if FRAMEBUF_BPP == 16
+    {
+        .text = "Dedither",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.dedither,
+        .max = 1,
+        .names = off_on_names,
+    },
+#endif
+    {
+        .text = "Auto crop",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.autocrop,
+        .max = 1,
+        .names = off_on_names,
+    },
+    {
+        .text = "Crop X",
+        .type = ITEM_TYPE_VALUE_RO_U32,
+        .value.value_u32 = &g_autocrop.crop_x,
+    },
+    {
+        .text = "Crop Y",
+        .type = ITEM_TYPE_VALUE_RO_U32,
+        .value.value_u32 = &g_autocrop.crop_y,
+    },
+    {
+        .text = "Back",
+        .type = ITEM_TYPE_BACK,
+    },
+    {
+        .text = NULL,
+    }
+};
+
+#if !FULLRES
+menu_item_t menu_color[] = {
+    {
+        .text = "OSD Color Menu",
+    },
+    {
+        .text = "Gamma",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_gamma,
+        .max = COLOR_GAMMA_COUNT - 1,
+        .names = color_gamma_names,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Black level",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_black_level,
+        .max = COLOR_BLACK_LEVEL_MAX,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Red gain",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_gain_red,
+        .max = COLOR_GAIN_MAX,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Green gain",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_gain_green,
+        .max = COLOR_GAIN_MAX,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Blue gain",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_gain_blue,
+        .max = COLOR_GAIN_MAX,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Range",
+        .type = ITEM_TYPE_VALUE_RW_U32,
+        .value.value_u32 = &g_config.color_range,
+        .max = COLOR_RANGE_COUNT - 1,
+        .names = color_range_names,
+        .on_change = color_apply,
+    },
+    {
+        .text = "Back",
+        .type = ITEM_TYPE_BACK,
+    },
+    {
+        .text = NULL,
+    }
+};
+#endif
+
 menu_item_t menu[] = {
     {
         .text = "OSD Menu",
@@ -56,6 +180,18 @@ menu_item_t menu[] = {
     {
         .text = "Third",
     },
+    {
+        .text = "Video",
+        .type = ITEM_TYPE_MENU,
+        .value.value_ptr = menu_video,
+    },
+#if !FULLRES
+    {
+        .text = "Color",
+        .type = ITEM_TYPE_MENU,
+        .value.value_ptr = menu_color,
+    },
+#endif
     {
         .text = "Sub menu",
         .type = ITEM_TYPE_MENU,
@@ -117,7 +253,13 @@ void osd_run(void)
             uint16_t bg_color = (item == state.focused_item) ? (RGB888_TO_RGB565(0xff, 0x00, 0xff)) : (RGB888_TO_RGB565(0x00, 0x00, 0x00));
             uint16_t fg_color = RGB888_TO_RGB565(0xff, 0xff, 0xff);
 
-            gfx_puttextf(x, y++ * 8, bg_color, fg_color, "%s", item->text);
+            if (item->type == ITEM_TYPE_VALUE_RW_U32 && item->names) {
+                gfx_puttextf(x, y++ * 8, bg_color, fg_color, "%s: %-8s", item->text, item->names[*item->value.value_u32]);
+            } else if (item->type == ITEM_TYPE_VALUE_RW_U32 || item->type == ITEM_TYPE_VALUE_RO_U32) {
+                gfx_puttextf(x, y++ * 8, bg_color, fg_color, "%s: %-8u", item->text, *item->value.value_u32);
+            } else {
+                gfx_puttextf(x, y++ * 8, bg_color, fg_color, "%s", item->text);
+            }
             item++;
         }
 
@@ -133,6 +275,24 @@ void osd_run(void)
                 state.focused_item--;
             }
         }
+        else if (BUTTON_PRESSED(DL_BUTTON) || BUTTON_PRESSED(DR_BUTTON)) {
+            menu_item_t *item = state.focused_item;
+            if (item->type == ITEM_TYPE_VALUE_RW_U32) {
+                uint32_t value = *item->value.value_u32;
+                if (BUTTON_PRESSED(DL_BUTTON) && value > 0) {
+                    value--;
+                } else if (BUTTON_PRESSED(DR_BUTTON) && value < item->max) {
+                    value++;
+                }
+
+                if (value != *item->value.value_u32) {
+                    *item->value.value_u32 = value;
+                    if (item->on_change) {
+                        item->on_change();
+                    }
+                }
+            }
+        }
         else if (BUTTON_PRESSED(A_BUTTON)) {
             if (state.focused_item->type == ITEM_TYPE_MENU) {
                 menu_item_t *previous_root = state.current_root;
@@ -0,0 +1,499 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "palette.h"
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+#if FRAMEBUF_PALETTE
+
+#define BIN(r, g, b) (((r) << 8) | ((g) << 4) | (b))
+
+// Palette entries built by median cut
+#define PALETTE_BOXES (PALETTE_COLORS - PALETTE_FIXED_COLORS)
+
+// A box of RGB444 colors, channels in the order red, green, blue
+typedef struct box {
+    uint8_t lo[3];      // Bounds, inclusive. Together the boxes cover every bin.
+    uint8_t hi[3];
+    uint8_t used_lo[3]; // Bounds of the bins with any pixels
+    uint8_t used_hi[3];
+    uint32_t pixels;
+} box_t;
+
+// A pass over the bins between lo and hi, one red plane per step
+typedef struct scan {
+    uint8_t lo[3];
+    uint8_t hi[3];
+    uint8_t r;          // Next red plane
+    uint8_t axis;       // Channel the planes are counted along
+    uint8_t used_lo[3]; // Bounds of the bins with any pixels
+    uint8_t used_hi[3];
+    uint32_t pixels;
+    uint32_t planes[16];
+} scan_t;
+
+typedef enum build_phase {
+    BUILD_IDLE,    // Counting the frame being captured
+    BUILD_ERROR,   // Measuring the counted frame
+    BUILD_SPLIT,   // Finding the median of the box being split
+    BUILD_MEASURE, // Measuring the two halves of the split
+    BUILD_ASSIGN,  // Pointing the bins of every box at its entry
+    BUILD_READY,   // Waiting for the frame to end
+} build_phase_t;
+
+static uint16_t histogram[PALETTE_BINS];
+static uint8_t luts[2][PALETTE_BINS];
+static palette_color_t colors[PALETTE_SETS][PALETTE_COLORS];
+static box_t boxes[PALETTE_BOXES];
+
+// Boxes that can still be split, as a binary heap with the most pixels on top
+static uint8_t heap[PALETTE_BOXES];
+
+static struct {
+    uint8_t current;                    // Palette the capture maps colors to
+    uint8_t lut;                        // LUT of the current palette
+    uint8_t buffer_set[FRAMEBUF_COUNT]; // Palette each buffer was captured with
+    bool counting;                      // The frame being captured is counted
+
+    // The palette being built, one step at a time
+    build_phase_t phase;
+    uint8_t set;         // Palette being built
+    uint32_t count;      // Boxes so far
+    uint32_t splittable; // Boxes in the heap
+    uint32_t box;        // Box being split or assigned
+    uint32_t half;       // Half of the split being measured
+    uint32_t cut;        // Last plane of the lower half
+    scan_t scan;
+    uint32_t sum[3];
+    uint64_t error;
+    uint64_t error_332;
+    uint32_t colors;
+    uint32_t cycles;
+
+    palette_stats_t stats;
+} state;
+
+// The fixed colors, and the one a bin maps to before there is a histogram
+static uint32_t fixed_index(uint32_t bin)
+{
+    return ((bin >> 9) & 0x4) | ((bin >> 6) & 0x2) | ((bin >> 3) & 0x1);
+}
+
+static palette_color_t fixed_color(uint32_t index)
+{
+    return (palette_color_t) {
+        .r = (index & 0x4) ? 127 : 0,
+        .g = (index & 0x2) ? 127 : 0,
+        .b = (index & 0x1) ? 127 : 0,
+    };
+}
+
+void palette_init(void)
+{
+    for (uint32_t set = 0; set < PALETTE_SETS; set++) {
+        for (uint32_t i = 0; i < PALETTE_COLORS; i++) {
+            colors[set][i] = fixed_color(i % PALETTE_FIXED_COLORS);
+        }
+        palette_encode_set(set, colors[set]);
+    }
+    for (uint32_t bin = 0; bin < PALETTE_BINS; bin++) {
+        luts[0][bin] = fixed_index(bin);
+    }
+    memset(histogram, 0, sizeof(histogram));
+    memset(state.buffer_set, 0, sizeof(state.buffer_set));
+    state.current = 0;
+    state.lut = 0;
+    state.phase = BUILD_IDLE;
+    state.counting = true;
+}
+
+const uint8_t *palette_get_lut(void)
+{
+    return luts[state.lut];
+}
+
+uint16_t *palette_get_histogram(void)
+{
+    return state.counting ? histogram : NULL;
+}
+
+void palette_frame_start(void)
+{
+    framebuf_pixel_t *back = framebuf_get_back();
+    if (back != NULL) {
+        state.buffer_set[framebuf_index(back)] = state.current;
+    }
+}
+
+static void scan_start(const uint8_t *lo, const uint8_t *hi, int axis)
+{
+    scan_t *scan = &state.scan;
+    memcpy(scan->lo, lo, sizeof(scan->lo));
+    memcpy(scan->hi, hi, sizeof(scan->hi));
+    memset(scan->used_lo, 15, sizeof(scan->used_lo));
+    memset(scan->used_hi, 0, sizeof(scan->used_hi));
+    memset(scan->planes, 0, sizeof(scan->planes));
+    scan->r = lo[0];
+    scan->axis = axis;
+    scan->pixels = 0;
+}
+
+// Count the pixels of the next red plane, true when the scan is done
+static bool __not_in_flash_func(scan_step)(void)
+{
+    scan_t *scan = &state.scan;
+    uint32_t c[3];
+    c[0] = scan->r++;
+    for (c[1] = scan->lo[1]; c[1] <= scan->hi[1]; c[1]++) {
+        const uint16_t *bins = &histogram[BIN(c[0], c[1], 0)];
+        for (c[2] = scan->lo[2]; c[2] <= scan->hi[2]; c[2]++) {
+            uint32_t n = bins[c[2]];
+            if (n == 0) {
+                continue;
+            }
+            scan->pixels += n;
+            scan->planes[c[scan->axis]] += n;
+            for (int i = 0; i < 3; i++) {
+                scan->used_lo[i] = MIN(scan->used_lo[i], c[i]);
+                scan->used_hi[i] = MAX(scan->used_hi[i], c[i]);
+            }
+        }
+    }
+    return scan->r > scan->hi[0];
+}
+
+static void scan_to_box(box_t *box)
+{
+    box->pixels = state.scan.pixels;
+    memcpy(box->used_lo, state.scan.used_lo, sizeof(box->used_lo));
+    memcpy(box->used_hi, state.scan.used_hi, sizeof(box->used_hi));
+}
+
+// The channel the colors of a box spread over the most, -1 if it's a single color
+static int box_axis(const box_t *box)
+{
+    int axis = -1;
+    int extent = 0;
+    for (int c = 0; c < 3; c++) {
+        if (box->used_hi[c] - box->used_lo[c] > extent) {
+            extent = box->used_hi[c] - box->used_lo[c];
+            axis = c;
+        }
+    }
+    return axis;
+}
+
+static void heap_push(uint32_t box)
+{
+    uint32_t i = state.splittable++;
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (boxes[heap[parent]].pixels >= boxes[box].pixels) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = box;
+}
+
+static uint32_t heap_pop(void)
+{
+    uint32_t size = --state.splittable;
+    uint32_t top = heap[0];
+    uint32_t last = heap[size];
+    uint32_t i = 0;
+    while (2 * i + 1 < size) {
+        uint32_t child = 2 * i + 1;
+        if (child + 1 < size && boxes[heap[child + 1]].pixels > boxes[heap[child]].pixels) {
+            child++;
+        }
+        if (boxes[heap[child]].pixels <= boxes[last].pixels) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static void heap_push_splittable(uint32_t box)
+{
+    if (box_axis(&boxes[box]) >= 0) {
+        heap_push(box);
+    }
+}
+
+// Median cut, the box with the most pixels first, until every color has an
+// entry of its own or the entries run out
+static void split_next(void)
+{
+    if (state.count == PALETTE_BOXES || state.splittable == 0) {
+        state.phase = BUILD_ASSIGN;
+        state.box = 0;
+        state.scan.r = boxes[0].lo[0];
+        memset(state.sum, 0, sizeof(state.sum));
+        return;
+    }
+
+    // Only the bins with colors are visited, the rest of the box is empty
+    state.box = heap_pop();
+    box_t *box = &boxes[state.box];
+    scan_start(box->used_lo, box->used_hi, box_axis(box));
+    state.phase = BUILD_SPLIT;
+}
+
+// Split the box at the median of its pixels, the upper half going to a new
+// box. Both halves keep some of the colors.
+static void split_box(void)
+{
+    box_t *box = &boxes[state.box];
+    uint32_t axis = state.scan.axis;
+    uint32_t cut = box->used_lo[axis];
+    uint32_t below = state.scan.planes[cut];
+    while (cut + 1 < box->used_hi[axis] && below < box->pixels / 2) {
+        cut++;
+        below += state.scan.planes[cut];
+    }
+
+    uint8_t hi[3];
+    memcpy(hi, box->used_hi, sizeof(hi));
+    hi[axis] = cut;
+
+    boxes[state.count] = *box;
+    box->hi[axis] = cut;
+    boxes[state.count].lo[axis] = cut + 1;
+
+    state.cut = cut;
+    state.half = 0;
+    scan_start(box->used_lo, hi, axis);
+    state.phase = BUILD_MEASURE;
+}
+
+static void measure_upper_half(void)
+{
+    box_t *other = &boxes[state.count];
+    uint8_t lo[3];
+    memcpy(lo, other->used_lo, sizeof(lo));
+    lo[state.scan.axis] = state.cut + 1;
+    state.half = 1;
+    scan_start(lo, other->used_hi, state.scan.axis);
+}
+
+static uint32_t square(int32_t x)
+{
+    return x * x;
+}
+
+// How far the pixels of a red plane are from the colors shown for them
+static void __not_in_flash_func(measure_error)(uint32_t r)
+{
+    const palette_color_t *shown = colors[state.current];
+    const uint8_t *lut = luts[state.lut];
+
+    for (uint32_t bin = BIN(r, 0, 0); bin < BIN(r + 1, 0, 0); bin++) {
+        uint32_t n = histogram[bin];
+        if (n == 0) {
+            continue;
+        }
+
+        // 8 bit levels: the bin center, the palette color, and RGB332 like the TMDS tables send it
+        uint32_t g = (bin >> 4) & 0xf;
+        uint32_t b = bin & 0xf;
+        int32_t r8 = r * 16 + 8;
+        int32_t g8 = g * 16 + 8;
+        int32_t b8 = b * 16 + 8;
+        palette_color_t p = shown[lut[bin]];
+
+        state.error += (uint64_t) n * (square(r8 - 2 * p.r) + square(g8 - 2 * p.g) + square(b8 - 2 * p.b));
+        state.error_332 += (uint64_t) n * (square(r8 - (int32_t) ((r >> 1) << 5)) +
+                                           square(g8 - (int32_t) ((g >> 1) << 5)) +
+                                           square(b8 - (int32_t) ((b >> 2) << 6)));
+        state.colors++;
+    }
+}
+
+// Point the bins of the next red plane of a box at its entry, true when the box is done
+static bool __not_in_flash_func(assign_step)(const box_t *box, uint32_t index)
+{
+    uint8_t *lut = luts[state.lut ^ 1];
+    uint32_t r = state.scan.r++;
+    for (uint32_t g = box->lo[1]; g <= box->hi[1]; g++) {
+        for (uint32_t b = box->lo[2]; b <= box->hi[2]; b++) {
+            uint32_t bin = BIN(r, g, b);
+            uint32_t n = histogram[bin];
+            lut[bin] = index;
+            state.sum[0] += n * r;
+            state.sum[1] += n * g;
+            state.sum[2] += n * b;
+        }
+    }
+    return state.scan.r > box->hi[0];
+}
+
+// The mean color of the pixels of a box, from the 4 bit bins to 7 bits, the
+// center of a bin being v * 8 + 4
+static palette_color_t box_color(const box_t *box)
+{
+    uint32_t pixels = box->pixels;
+    return (palette_color_t) {
+        .r = (8 * state.sum[0] + 4 * pixels + pixels / 2) / pixels,
+        .g = (8 * state.sum[1] + 4 * pixels + pixels / 2) / pixels,
+        .b = (8 * state.sum[2] + 4 * pixels + pixels / 2) / pixels,
+    };
+}
+
+static void build_step(void)
+{
+    switch (state.phase) {
+    case BUILD_ERROR: {
+        // The whole histogram, which is the first box as well
+        measure_error(state.scan.r);
+        if (!scan_step()) {
+            break;
+        }
+        uint32_t pixels = state.scan.pixels;
+        state.stats.colors = state.colors;
+        state.stats.error = pixels ? state.error / pixels : 0;
+        state.stats.error_332 = pixels ? state.error_332 / pixels : 0;
+        if (pixels == 0) {
+            // Dropped frame, keep the palette
+            state.phase = BUILD_IDLE;
+            break;
+        }
+        memset(boxes[0].lo, 0, sizeof(boxes[0].lo));
+        memset(boxes[0].hi, 15, sizeof(boxes[0].hi));
+        scan_to_box(&boxes[0]);
+        state.count = 1;
+        state.splittable = 0;
+        heap_push_splittable(0);
+        split_next();
+        break;
+    }
+
+    case BUILD_SPLIT:
+        if (scan_step()) {
+            split_box();
+        }
+        break;
+
+    case BUILD_MEASURE:
+        if (!scan_step()) {
+            break;
+        }
+        if (state.half == 0) {
+            scan_to_box(&boxes[state.box]);
+            measure_upper_half();
+            break;
+        }
+        scan_to_box(&boxes[state.count]);
+        heap_push_splittable(state.box);
+        heap_push_splittable(state.count);
+        state.count++;
+        split_next();
+        break;
+
+    case BUILD_ASSIGN: {
+        palette_color_t *palette = colors[state.set];
+        const box_t *box = &boxes[state.box];
+        if (!assign_step(box, PALETTE_FIXED_COLORS + state.box)) {
+            break;
+        }
+        palette[PALETTE_FIXED_COLORS + state.box] = box_color(box);
+        memset(state.sum, 0, sizeof(state.sum));
+        if (++state.box < state.count) {
+            state.scan.r = boxes[state.box].lo[0];
+            break;
+        }
+
+        for (uint32_t i = 0; i < PALETTE_FIXED_COLORS; i++) {
+            palette[i] = fixed_color(i);
+        }
+        for (uint32_t i = PALETTE_FIXED_COLORS + state.count; i < PALETTE_COLORS; i++) {
+            palette[i] = fixed_color(0);
+        }
+        palette_encode_set(state.set, palette);
+        memset(histogram, 0, sizeof(histogram));
+        state.phase = BUILD_READY;
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void __not_in_flash_func(palette_build)(uint32_t budget_cycles)
+{
+    if (state.phase == BUILD_IDLE || state.phase == BUILD_READY) {
+        return;
+    }
+
+    uint32_t t0 = cycles_now();
+    uint32_t cycles;
+    do {
+        build_step();
+        cycles = cycles_since(t0);
+    } while (cycles < budget_cycles && state.phase != BUILD_IDLE && state.phase != BUILD_READY);
+
+    state.cycles += cycles;
+    state.stats.build_max_cycles = MAX(state.stats.build_max_cycles, cycles);
+}
+
+void palette_frame_end(void)
+{
+    if (state.counting) {
+        // Build from the frame just counted while the next one is captured.
+        // The palette no buffer was captured with, and that isn't being
+        // captured with, is free.
+        for (state.set = 0; state.set < PALETTE_SETS; state.set++) {
+            bool used = (state.set == state.current);
+            for (uint32_t i = 0; i < FRAMEBUF_COUNT; i++) {
+                used |= (state.buffer_set[i] == state.set);
+            }
+            if (!used) {
+                break;
+            }
+        }
+        memset(boxes[0].lo, 0, sizeof(boxes[0].lo));
+        memset(boxes[0].hi, 15, sizeof(boxes[0].hi));
+        scan_start(boxes[0].lo, boxes[0].hi, 0);
+        state.error = 0;
+        state.error_332 = 0;
+        state.colors = 0;
+        state.cycles = 0;
+        state.phase = BUILD_ERROR;
+    } else if (state.phase == BUILD_READY) {
+        // The next frame is captured with the new palette
+        state.current = state.set;
+        state.lut ^= 1;
+        state.stats.entries = state.count;
+        state.stats.build_cycles = state.cycles;
+        state.phase = BUILD_IDLE;
+    }
+    state.counting = (state.phase == BUILD_IDLE);
+}
+
+uint32_t __not_in_flash_func(palette_get_set)(const framebuf_pixel_t *line)
+{
+    return state.buffer_set[framebuf_index(line)];
+}
+
+const palette_color_t *palette_get_colors(uint32_t set)
+{
+    return colors[set];
+}
+
+const palette_stats_t *palette_get_stats(void)
+{
+    return &state.stats;
+}
+
+#endif
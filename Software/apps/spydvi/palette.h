@@ -0,0 +1,212 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file palette.h
+ * @brief Adaptive palette for 8 bpp frame buffers.
+ *
+ * With FRAMEBUF_PALETTE every captured pixel is stored as the palette index
+ * its RGB444 color maps to, and every second frame is also counted in a
+ * histogram of RGB444 colors. While the next frame is captured, the histogram
+ * is split into boxes by median cut, the most populated box first, and the
+ * mean color of each box becomes a palette entry. The boxes cover every
+ * RGB444 color, so colors that weren't in the frame still map somewhere. The
+ * new palette is swapped in on the following VSYNC.
+ *
+ * Building a palette takes around half a million cycles, much longer than
+ * the VSYNC. It is done in small steps on the rows the capture skips, see
+ * palette_build(), and the capture catches up on the rows it keeps.
+ *
+ * The palette of a frame goes with its buffer: core 1 looks up the palette
+ * of every line it encodes, so a line is always sent with the palette its
+ * pixels were captured with, and a new palette shows up where the page flip
+ * does. A single buffer would be overwritten under the new palette while
+ * core 1 is still sending it, so at least two are needed. The first PALETTE_FIXED_COLORS entries are black, the
+ * primaries and white, for the OSD, see framebuf_from_rgb565().
+ *
+ * The palette is built in palette.c, which has no hardware dependencies and
+ * also runs on the host. The TMDS encode is in palette_encode.c, with a table
+ * per palette and channel looked up by the whole 8 bit pixel.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "framebuf.h"
+
+struct dvi_inst;
+
+#if FRAMEBUF_PALETTE && FRAMEBUF_BPP != 8
+#error "FRAMEBUF_PALETTE requires FRAMEBUF_BPP 8"
+#endif
+
+#if FRAMEBUF_PALETTE && FRAMEBUF_COUNT < 2
+#error "FRAMEBUF_PALETTE requires FRAMEBUF_COUNT 2 or more"
+#endif
+
+#if FRAMEBUF_PALETTE && (VIDEO_CAPTURE_PACKED || LINE_BLEND || DEINTERLACE)
+#error "FRAMEBUF_PALETTE requires VIDEO_CAPTURE_PACKED 0, LINE_BLEND 0 and DEINTERLACE 0"
+#endif
+
+/// Entries of a palette, one per 8 bit pixel value.
+#define PALETTE_COLORS 256
+
+/// Entries at the start of every palette with fixed colors, index bits 2-0 being red, green and blue.
+#define PALETTE_FIXED_COLORS 8
+
+/// Colors counted in the histogram, RGB444.
+#define PALETTE_BINS 4096
+
+/// Palettes kept, one for each frame buffer, the one being captured with and one being built.
+#define PALETTE_SETS (FRAMEBUF_COUNT + 2)
+
+/// Cycles spent building the palette per skipped row, about half a VI row at 252 MHz.
+#define PALETTE_BUILD_CYCLES 4000
+
+/**
+ * @brief Get the histogram bin of a VI word, the top 4 bits of each channel.
+ * @param BGRS The VI word.
+ * @return The bin, red in bits 11-8, green in bits 7-4 and blue in bits 3-0.
+ */
+static inline uint32_t palette_bin(uint32_t BGRS)
+{
+    return ((BGRS >> 3) & 0xf00) | ((BGRS >> 15) & 0x0f0) | ((BGRS >> 27) & 0x00f);
+}
+
+/**
+ * @struct palette_color
+ * @brief A palette entry, 7 bits per channel like the VI.
+ */
+typedef struct palette_color {
+    uint8_t r; ///< Red, 0-127.
+    uint8_t g; ///< Green, 0-127.
+    uint8_t b; ///< Blue, 0-127.
+} palette_color_t;
+
+/**
+ * @struct palette_stats
+ * @brief The last palette built, and the frame it was built from.
+ *
+ * The errors are measured against the center of each RGB444 color, so the
+ * RGB444 rounding itself isn't counted.
+ */
+typedef struct palette_stats {
+    uint32_t colors;       ///< Number of RGB444 colors in the frame.
+    uint32_t entries;      ///< Number of palette entries built from them, without the fixed ones.
+    uint32_t error;        ///< Mean squared error per pixel with the palette it was captured with, 8 bit levels, sum of the channels.
+    uint32_t error_332;    ///< The same error with RGB332, for comparison.
+    uint32_t build_cycles;     ///< Cycles core 0 spent building the palette, over all steps.
+    uint32_t build_max_cycles; ///< Longest call of palette_build() since boot, including the step that ran over.
+} palette_stats_t;
+
+/**
+ * @brief Initialize the palette, every color mapping to a fixed one.
+ */
+void palette_init(void);
+
+/**
+ * @brief Get the palette index of each histogram bin, for the frame being captured.
+ * @return PALETTE_BINS indices.
+ */
+const uint8_t *palette_get_lut(void);
+
+/**
+ * @brief Get the histogram of the frame being captured.
+ *
+ * The capture adds one for every pixel, saturating at UINT16_MAX.
+ * @return PALETTE_BINS counters, or NULL if the frame isn't counted.
+ */
+uint16_t *palette_get_histogram(void);
+
+/**
+ * @brief Tie the palette being captured with to the back buffer (core 0).
+ *
+ * Called after framebuf_begin(), before the first line is captured.
+ */
+void palette_frame_start(void);
+
+/**
+ * @brief Start building a palette from the frame just counted, or swap in
+ * the one that was built (core 0).
+ *
+ * Called on the captured VSYNC, before the next frame's palette_get_lut().
+ */
+void palette_frame_end(void);
+
+/**
+ * @brief Take the next steps of building the palette (core 0).
+ *
+ * Each step visits up to 256 bins, and steps are taken until the budget is
+ * used up, so a call runs a little over it.
+ * @param budget_cycles Cycles to spend, usually PALETTE_BUILD_CYCLES.
+ */
+void palette_build(uint32_t budget_cycles);
+
+/**
+ * @brief Get the palette a line was captured with.
+ * @param line A line of a frame buffer.
+ * @return The palette, below PALETTE_SETS.
+ */
+uint32_t palette_get_set(const framebuf_pixel_t *line);
+
+/**
+ * @brief Get the colors of a palette.
+ * @param set The palette, below PALETTE_SETS.
+ * @return PALETTE_COLORS colors.
+ */
+const palette_color_t *palette_get_colors(uint32_t set);
+
+/**
+ * @brief Get the palette counters.
+ * @return A pointer to the counters.
+ */
+const palette_stats_t *palette_get_stats(void);
+
+/**
+ * @struct palette_encode_stats
+ * @brief TMDS encode cost per line, the worst line of the last frame.
+ */
+typedef struct palette_encode_stats {
+    uint32_t cycles;        ///< Cycles core 1 spent encoding the three channels, including DVI IRQs.
+    uint32_t budget_cycles; ///< Cycles available per line, every line is shown DVI_VERTICAL_REPEAT times.
+} palette_encode_stats_t;
+
+/**
+ * @brief Initialize the TMDS encode of palette pixels with identity levels.
+ * @param inst The DVI instance.
+ */
+void palette_encode_init(struct dvi_inst *inst);
+
+/**
+ * @brief Rebuild the TMDS tables of a palette (core 0).
+ *
+ * Called from palette.c whenever a palette changes.
+ * @param set The palette, below PALETTE_SETS.
+ * @param colors Its PALETTE_COLORS colors.
+ */
+void palette_encode_set(uint32_t set, const palette_color_t *colors);
+
+/**
+ * @brief Set the output levels of a channel, and rebuild every palette.
+ * @param tmds_channel The TMDS channel, 0 blue, 1 green, 2 red.
+ * @param levels The 8 bit output level of each 7 bit color, 128 of them.
+ */
+void palette_encode_set_levels(uint32_t tmds_channel, const uint8_t *levels);
+
+/**
+ * @brief TMDS encode worker (core 1).
+ *
+ * Replaces dvi_scanbuf_main_8bpp, and like it returns when a NULL scanline
+ * is queued.
+ */
+void palette_scanbuf_main(void);
+
+/**
+ * @brief Get the encode cost.
+ * @return A pointer to the counters.
+ */
+const palette_encode_stats_t *palette_encode_get_stats(void);
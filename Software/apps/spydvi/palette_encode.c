@@ -0,0 +1,110 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "palette.h"
+
+#include "pico/stdlib.h"
+#include "cycles.h"
+#include "dvi.h"
+#include "tmds_encode.h"
+
+#if FRAMEBUF_PALETTE
+
+#define PALETTE_LANE_WORDS (FRAME_HORIZONTAL_REPEAT * FRAME_WIDTH / DVI_SYMBOLS_PER_WORD)
+
+// Output levels of 7 bit colors
+#define PALETTE_LEVELS 128
+
+// Symbol pairs for every 7 bit value per TMDS channel, with the color correction applied
+static uint32_t level_symbols[3][PALETTE_LEVELS];
+
+// Symbol pairs for every palette entry per TMDS channel, one set per palette.
+// Too large for scratch X next to the 64 entry tables and the core 1 stack.
+static uint32_t tmds_tables[PALETTE_SETS][3][PALETTE_COLORS];
+
+static struct {
+    struct dvi_inst *inst;
+    uint32_t max;
+    uint frame;
+    palette_encode_stats_t stats;
+} state;
+
+void palette_encode_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+
+    uint8_t levels[PALETTE_LEVELS];
+    for (int i = 0; i < PALETTE_LEVELS; i++) {
+        levels[i] = i * 2;
+    }
+    for (uint channel = 0; channel < 3; channel++) {
+        tmds_table_from_levels(level_symbols[channel], levels, PALETTE_LEVELS);
+    }
+}
+
+void palette_encode_set(uint32_t set, const palette_color_t *colors)
+{
+    for (uint32_t i = 0; i < PALETTE_COLORS; i++) {
+        tmds_tables[set][0][i] = level_symbols[0][colors[i].b];
+        tmds_tables[set][1][i] = level_symbols[1][colors[i].g];
+        tmds_tables[set][2][i] = level_symbols[2][colors[i].r];
+    }
+}
+
+void palette_encode_set_levels(uint32_t tmds_channel, const uint8_t *levels)
+{
+    tmds_table_from_levels(level_symbols[tmds_channel], levels, PALETTE_LEVELS);
+    for (uint32_t set = 0; set < PALETTE_SETS; set++) {
+        palette_encode_set(set, palette_get_colors(set));
+    }
+}
+
+void __not_in_flash_func(palette_scanbuf_main)(void)
+{
+    struct dvi_inst *inst = state.inst;
+
+    while (1) {
+        uint32_t *scanbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            return;
+        }
+
+        // The whole pixel is the index, looked up in the palette the line was captured with
+        uint32_t (*tables)[PALETTE_COLORS] = tmds_tables[palette_get_set((const framebuf_pixel_t *) scanbuf)];
+        uint32_t *tmdsbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+
+        uint32_t t0 = cycles_now();
+        for (uint channel = 0; channel < 3; channel++) {
+            tmds_encode_data_channel_8bpp_lut(scanbuf, tmdsbuf + channel * PALETTE_LANE_WORDS, FRAME_WIDTH,
+                                              7, 0, tables[channel], 8);
+        }
+        uint32_t cycles = cycles_since(t0);
+
+        queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
+        queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
+
+        if (inst->dvi_frame_count != state.frame) {
+            state.frame = inst->dvi_frame_count;
+            state.stats.cycles = state.max;
+            state.max = 0;
+        }
+        state.max = MAX(state.max, cycles);
+    }
+}
+
+const palette_encode_stats_t *palette_encode_get_stats(void)
+{
+    // clk_sys is the TMDS bit clock, 10 cycles per pixel
+    const struct dvi_timing *t = state.inst->timing;
+    uint32_t h_total = t->h_front_porch + t->h_sync_width + t->h_back_porch + t->h_active_pixels;
+    state.stats.budget_cycles = DVI_VERTICAL_REPEAT * h_total * 10;
+
+    return &state.stats;
+}
+
+#endif
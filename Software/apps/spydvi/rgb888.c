@@ -0,0 +1,102 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "rgb888.h"
+#include "framebuf.h"
+
+#include "pico/stdlib.h"
+#include "cycles.h"
+#include "tmds_encode.h"
+
+#if FRAMEBUF_BPP == 32
+
+#define RGB888_LANE_WORDS (FRAME_HORIZONTAL_REPEAT * FRAME_WIDTH / DVI_SYMBOLS_PER_WORD)
+
+// Channels in the 16 bit planes, see framebuf_pixel_t
+#define RGB888_RED_MSB   15
+#define RGB888_RED_LSB    9
+#define RGB888_GREEN_MSB  7
+#define RGB888_GREEN_LSB  1
+#define RGB888_BLUE_MSB  15
+#define RGB888_BLUE_LSB   9
+
+// Symbol pairs for each 7 bit value, per TMDS channel. Too large for scratch X
+// next to the 64 entry tables and the core 1 stack.
+static uint32_t tmds_tables[3][RGB888_TABLE_LEVELS];
+
+static struct {
+    struct dvi_inst *inst;
+    uint32_t max;
+    uint frame;
+    rgb888_stats_t stats;
+} state;
+
+void rgb888_init(struct dvi_inst *inst)
+{
+    state.inst = inst;
+
+    uint8_t levels[RGB888_TABLE_LEVELS];
+    for (int i = 0; i < RGB888_TABLE_LEVELS; i++) {
+        levels[i] = i * 2;
+    }
+    for (uint channel = 0; channel < 3; channel++) {
+        rgb888_set_levels(channel, levels);
+    }
+}
+
+void rgb888_set_levels(uint tmds_channel, const uint8_t *levels)
+{
+    tmds_table_from_levels(tmds_tables[tmds_channel], levels, RGB888_TABLE_LEVELS);
+}
+
+void __not_in_flash_func(rgb888_scanbuf_main)(void)
+{
+    struct dvi_inst *inst = state.inst;
+
+    while (1) {
+        uint32_t *scanbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            return;
+        }
+
+        const uint32_t *red_green = scanbuf;
+        const uint32_t *blue = (const uint32_t *) ((const framebuf_pixel_t *) scanbuf + FRAMEBUF_PLANE_BLUE);
+        uint32_t *tmdsbuf = NULL;
+        queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+
+        uint32_t t0 = cycles_now();
+        tmds_encode_data_channel_16bpp_lut(blue, tmdsbuf + 0 * RGB888_LANE_WORDS, FRAME_WIDTH,
+                                           RGB888_BLUE_MSB, RGB888_BLUE_LSB, tmds_tables[0], 7);
+        tmds_encode_data_channel_16bpp_lut(red_green, tmdsbuf + 1 * RGB888_LANE_WORDS, FRAME_WIDTH,
+                                           RGB888_GREEN_MSB, RGB888_GREEN_LSB, tmds_tables[1], 7);
+        tmds_encode_data_channel_16bpp_lut(red_green, tmdsbuf + 2 * RGB888_LANE_WORDS, FRAME_WIDTH,
+                                           RGB888_RED_MSB, RGB888_RED_LSB, tmds_tables[2], 7);
+        uint32_t cycles = cycles_since(t0);
+
+        queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
+        queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
+
+        if (inst->dvi_frame_count != state.frame) {
+            state.frame = inst->dvi_frame_count;
+            state.stats.cycles = state.max;
+            state.max = 0;
+        }
+        state.max = MAX(state.max, cycles);
+    }
+}
+
+const rgb888_stats_t *rgb888_get_stats(void)
+{
+    // clk_sys is the TMDS bit clock, 10 cycles per pixel
+    const struct dvi_timing *t = state.inst->timing;
+    uint32_t h_total = t->h_front_porch + t->h_sync_width + t->h_back_porch + t->h_active_pixels;
+    state.stats.budget_cycles = DVI_VERTICAL_REPEAT * h_total * 10;
+
+    return &state.stats;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file rgb888.h
+ * @brief 24 bit color output, all 7 bits of each VI color channel.
+ *
+ * The pixel doubled TMDS encode sends every pixel as a DC balanced pair of
+ * symbols for an even level and the odd level above it, which is exactly 7
+ * bits per channel, as many as the VI has. With FRAMEBUF_BPP 32 each line is
+ * kept as two planes of 16 bit pixels, red and green, then blue, and core 1
+ * encodes every channel with a 128 entry table instead of the 64 entry one.
+ * That costs the same as encoding an RGB565 line. Only a ring of lines fits
+ * in RAM, so the output races the capture.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+#if FRAMEBUF_BPP == 32 && !BEAM_RACE
+#error "FRAMEBUF_BPP 32 only keeps a few lines, it requires BEAM_RACE 1"
+#endif
+
+#if FRAMEBUF_BPP == 32 && (VIDEO_CAPTURE_PACKED || FULLRES || DEINTERLACE)
+#error "FRAMEBUF_BPP 32 requires VIDEO_CAPTURE_PACKED 0, FULLRES 0 and DEINTERLACE 0"
+#endif
+
+#if FRAMEBUF_BPP == 32 && (RGB888_RING_LINES & (RGB888_RING_LINES - 1))
+#error "RGB888_RING_LINES must be a power of two"
+#endif
+
+#if FRAMEBUF_BPP == 32 && (RGB888_RING_LINES <= BEAM_RACE_LAG_LINES + 2)
+#error "RGB888_RING_LINES has to cover the beam racing lag and the encoder pipeline"
+#endif
+
+/// Entries of each TMDS table, one per 7 bit channel value.
+#define RGB888_TABLE_LEVELS 128
+
+/**
+ * @struct rgb888_stats
+ * @brief TMDS encode cost per line, the worst line of the last frame.
+ */
+typedef struct rgb888_stats {
+    uint32_t cycles;        ///< Cycles core 1 spent encoding the three channels, including DVI IRQs.
+    uint32_t budget_cycles; ///< Cycles available per line, every line is shown DVI_VERTICAL_REPEAT times.
+} rgb888_stats_t;
+
+/**
+ * @brief Initialize 24 bit output with identity TMDS tables.
+ * @param inst The DVI instance.
+ */
+void rgb888_init(struct dvi_inst *inst);
+
+/**
+ * @brief Rebuild the TMDS table of a channel.
+ * @param tmds_channel The TMDS channel, 0 blue, 1 green, 2 red.
+ * @param levels The 8 bit output level of each 7 bit input, RGB888_TABLE_LEVELS of them.
+ */
+void rgb888_set_levels(uint tmds_channel, const uint8_t *levels);
+
+/**
+ * @brief TMDS encode worker (core 1).
+ *
+ * Replaces dvi_scanbuf_main_16bpp, and like it returns when a NULL scanline
+ * is queued.
+ */
+void rgb888_scanbuf_main(void);
+
+/**
+ * @brief Get the encode cost.
+ * @return A pointer to the counters.
+ */
+const rgb888_stats_t *rgb888_get_stats(void);
@@ -0,0 +1,129 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "video_dma.h"
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "cycles.h"
+
+// Restart the data channel every 2^31 words (~3 minutes at the VI word rate)
+#define VIDEO_DMA_TRANSFER_COUNT (0x80000000)
+
+video_dma_state_t g_video_dma;
+
+static uint32_t ring[VIDEO_DMA_RING_WORDS] __attribute__((aligned(1 << VIDEO_DMA_RING_BITS)));
+static const uint32_t *const ring_end = &ring[VIDEO_DMA_RING_WORDS];
+
+static struct {
+    uint chan_data;
+    uint chan_ctrl;
+    uint32_t transfer_count;
+    video_dma_stats_t stats;
+} state = {
+    .transfer_count = VIDEO_DMA_TRANSFER_COUNT,
+};
+
+static inline const uint32_t *dma_write_pointer(void)
+{
+    return (const uint32_t *) dma_hw->ch[state.chan_data].write_addr;
+}
+
+void video_dma_init(PIO pio, uint sm)
+{
+    state.chan_data = dma_claim_unused_channel(true);
+    state.chan_ctrl = dma_claim_unused_channel(true);
+
+    // The data channel copies the RX FIFO into the ring, wrapping the write address
+    dma_channel_config c_data = dma_channel_get_default_config(state.chan_data);
+    channel_config_set_read_increment(&c_data, false);
+    channel_config_set_write_increment(&c_data, true);
+    channel_config_set_ring(&c_data, true, VIDEO_DMA_RING_BITS);
+    channel_config_set_dreq(&c_data, pio_get_dreq(pio, sm, false));
+    channel_config_set_chain_to(&c_data, state.chan_ctrl);
+    channel_config_set_irq_quiet(&c_data, true);
+    dma_channel_configure(state.chan_data, &c_data,
+        ring,             // Write to the ring
+        &pio->rxf[sm],    // Read from RX FIFO
+        state.transfer_count,
+        false             // Do not start immediately
+    );
+
+    // The control channel reloads the transfer count when the data channel is
+    // done, which also retriggers it. The write address just carries on.
+    dma_channel_config c_ctrl = dma_channel_get_default_config(state.chan_ctrl);
+    channel_config_set_read_increment(&c_ctrl, false);
+    channel_config_set_write_increment(&c_ctrl, false);
+    channel_config_set_irq_quiet(&c_ctrl, true);
+    dma_channel_configure(state.chan_ctrl, &c_ctrl,
+        &dma_hw->ch[state.chan_data].al1_transfer_count_trig,
+        &state.transfer_count,
+        1,
+        false
+    );
+
+    g_video_dma.read = ring;
+    g_video_dma.limit = ring;
+    g_video_dma.idle_cycles = 0;
+    g_video_dma.frame_start = cycles_now();
+
+    dma_channel_start(state.chan_data);
+}
+
+void __not_in_flash_func(video_dma_wait)(void)
+{
+    uint32_t t0 = cycles_now();
+    const uint32_t *read = g_video_dma.read;
+    const uint32_t *write;
+
+    if (read == ring_end) {
+        read = ring;
+    }
+
+    while ((write = dma_write_pointer()) == read) {
+        tight_loop_contents();
+    }
+
+    // Data that was written a full ring ago is gone, start over from the newest word
+    uint32_t fill = (write - read) & (VIDEO_DMA_RING_WORDS - 1);
+    if (fill > VIDEO_DMA_OVERRUN_WORDS) {
+        state.stats.overruns++;
+        read = write;
+        while ((write = dma_write_pointer()) == read) {
+            tight_loop_contents();
+        }
+    }
+
+    g_video_dma.read = read;
+    g_video_dma.limit = (write > read) ? write : ring_end;
+    g_video_dma.idle_cycles += cycles_since(t0);
+}
+
+void video_dma_resync(void)
+{
+    const uint32_t *write = dma_write_pointer();
+    g_video_dma.read = write;
+    g_video_dma.limit = write;
+}
+
+void video_dma_frame_end(uint32_t rows)
+{
+    uint32_t now = cycles_now();
+
+    state.stats.frames++;
+    state.stats.rows = rows;
+    state.stats.frame_cycles = (g_video_dma.frame_start - now) & SYSTICK_MASK;
+    state.stats.idle_cycles = g_video_dma.idle_cycles;
+    state.stats.idle_cycles_per_row = rows ? (g_video_dma.idle_cycles / rows) : 0;
+
+    g_video_dma.idle_cycles = 0;
+    g_video_dma.frame_start = now;
+}
+
+const video_dma_stats_t *video_dma_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,208 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file video_dma.h
+ * @brief DMA driven capture of the N64 VI bus.
+ *
+ * A pair of DMA channels drains the joined RX FIFO of the video state machine
+ * into a ring buffer in RAM. Core 0 no longer pops the FIFO word by word, it
+ * reads the ring directly and only has to wait when it has caught up with the
+ * DMA write pointer. The time spent waiting is what core 0 has left over for
+ * other work, and is accounted per frame.
+ *
+ * The inline accessors below only depend on g_video_dma and video_dma_wait(),
+ * so host/video_dma_trace.c can feed the capture from a recorded trace.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "hardware/pio.h"
+
+/**
+ * @brief The number of bits of the capture ring size in bytes.
+ *
+ * The ring is used with DMA write address wrapping, so its size must be a
+ * power of two and it is aligned to its own size. 14 bits (16 KiB) holds a
+ * little more than five VI lines, which is enough to ride out the OSD and
+ * diagnostics drawing at the start of a frame.
+ */
+#define VIDEO_DMA_RING_BITS 14
+
+/// Number of 32-bit words in the capture ring.
+#define VIDEO_DMA_RING_WORDS ((1 << VIDEO_DMA_RING_BITS) / sizeof(uint32_t))
+
+/**
+ * @brief Fill level (in words) at which the ring is considered overrun.
+ *
+ * The DMA write pointer can't be told apart from a full lap of the ring, so
+ * anything closer than this to a full ring is treated as lost data.
+ */
+#define VIDEO_DMA_OVERRUN_WORDS (VIDEO_DMA_RING_WORDS - 64)
+
+/**
+ * @struct video_dma_stats
+ * @brief Per-frame counters for the capture engine.
+ */
+typedef struct video_dma_stats {
+    uint32_t frames;              ///< Number of frames captured.
+    uint32_t rows;                ///< Number of VI rows in the last frame.
+    uint32_t frame_cycles;        ///< Core 0 cycles spent on the last frame.
+    uint32_t idle_cycles;         ///< Core 0 cycles spent waiting for the DMA in the last frame.
+    uint32_t idle_cycles_per_row; ///< Core 0 cycles left per VI row in the last frame.
+    uint32_t overruns;            ///< Number of times the ring was overrun since boot.
+} video_dma_stats_t;
+
+/**
+ * @brief Internal state of the capture engine.
+ *
+ * Exposed only so the accessors below can be inlined into the capture loop.
+ */
+typedef struct video_dma_state {
+    const uint32_t *read;  ///< Next word to be consumed.
+    const uint32_t *limit; ///< End of the contiguous run known to be valid.
+    uint32_t idle_cycles;  ///< Cycles spent waiting in the current frame.
+    uint32_t frame_start;  ///< SysTick value at the start of the current frame.
+} video_dma_state_t;
+
+extern video_dma_state_t g_video_dma;
+
+/**
+ * @brief Set up the DMA channels and start draining the state machine.
+ *
+ * The state machine must already be configured with a joined RX FIFO.
+ * @param pio The PIO instance running the video program.
+ * @param sm The video state machine.
+ */
+void video_dma_init(PIO pio, uint sm);
+
+/**
+ * @brief Wait until at least one word is available past the read pointer.
+ *
+ * Slow path of the accessors below, counts the waiting time as idle time.
+ */
+void video_dma_wait(void);
+
+/**
+ * @brief Drop everything in the ring and continue from the DMA write pointer.
+ *
+ * Used after core 0 has been busy for a long time (e.g. in the OSD), where
+ * the ring content is stale or has been overwritten anyway.
+ */
+void video_dma_resync(void);
+
+/**
+ * @brief Close the accounting for the current frame.
+ * @param rows The number of VI rows seen in the frame.
+ */
+void video_dma_frame_end(uint32_t rows);
+
+/**
+ * @brief Get the capture statistics of the last completed frame.
+ * @return A pointer to the statistics.
+ */
+const video_dma_stats_t *video_dma_get_stats(void);
+
+/**
+ * @brief Get the next word from the capture ring, waiting if needed.
+ * @return The next VI word.
+ */
+static inline uint32_t video_dma_get(void)
+{
+    if (g_video_dma.read == g_video_dma.limit) {
+        video_dma_wait();
+    }
+    return *g_video_dma.read++;
+}
+
+/**
+ * @brief Get a contiguous run of captured words without consuming them.
+ *
+ * Waits until at least one word is available. The run ends either at the
+ * DMA write pointer or at the end of the ring.
+ * @param count Returns the number of words in the run (at least 1).
+ * @return A pointer to the first word of the run.
+ */
+static inline const uint32_t *video_dma_acquire(uint32_t *count)
+{
+    if (g_video_dma.read == g_video_dma.limit) {
+        video_dma_wait();
+    }
+    *count = g_video_dma.limit - g_video_dma.read;
+    return g_video_dma.read;
+}
+
+/**
+ * @brief Consume words previously returned by video_dma_acquire().
+ * @param count Number of words to consume, no more than were acquired.
+ */
+static inline void video_dma_release(uint32_t count)
+{
+    g_video_dma.read += count;
+}
+
+/**
+ * @brief Consume words while all bits of mask are set.
+ *
+ * Scans whole runs at a time instead of fetching word by word.
+ * @param mask The bits that all have to be set for a word to be consumed.
+ * @return The first word not matching the mask (which is consumed as well).
+ */
+static inline uint32_t video_dma_skip_while_set(uint32_t mask)
+{
+    while (1) {
+        uint32_t count;
+        const uint32_t *src = video_dma_acquire(&count);
+        const uint32_t *end = src + count;
+        while (src != end) {
+            uint32_t word = *src++;
+            if ((word & mask) != mask) {
+                g_video_dma.read = src;
+                return word;
+            }
+        }
+        g_video_dma.read = end;
+    }
+}
+
+/**
+ * @brief Consume words while all bits of mask are set, and find where any of
+ * the content bits are set.
+ *
+ * Like video_dma_skip_while_set(), for rows that are skipped but measured.
+ * @param mask The bits that all have to be set for a word to be consumed.
+ * @param content The bits to look for, e.g. the upper bits of each color.
+ * @param first Returns the index of the first consumed word with content, or UINT32_MAX if there is none.
+ * @param last Returns the index of the last consumed word with content, or UINT32_MAX if there is none.
+ * @return The first word not matching the mask (which is consumed as well).
+ */
+static inline uint32_t video_dma_scan_while_set(uint32_t mask, uint32_t content, uint32_t *first, uint32_t *last)
+{
+    uint32_t index = 0;
+    *first = UINT32_MAX;
+    *last = UINT32_MAX;
+    while (1) {
+        uint32_t count;
+        const uint32_t *src = video_dma_acquire(&count);
+        const uint32_t *end = src + count;
+        while (src != end) {
+            uint32_t word = *src++;
+            if ((word & mask) != mask) {
+                g_video_dma.read = src;
+                return word;
+            }
+            if (word & content) {
+                if (*first == UINT32_MAX) {
+                    *first = index;
+                }
+                *last = index;
+            }
+            index++;
+        }
+        g_video_dma.read = end;
+    }
+}
@@ -0,0 +1,177 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "video_mode.h"
+#include "framebuf.h"
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/ssi.h"
+#include "hardware/sync.h"
+
+static const struct dvi_timing *const timings[VIDEO_MODE_COUNT] = {
+    [VIDEO_MODE_640x480P60] = &dvi_timing_640x480p_60hz,
+    [VIDEO_MODE_640x480P72] = &dvi_timing_640x480p_72hz,
+    [VIDEO_MODE_640x576P50] = &dvi_timing_640x576p_50hz,
+};
+
+const char *const video_mode_names[VIDEO_MODE_COUNT] = {
+    [VIDEO_MODE_640x480P60] = "480p60",
+    [VIDEO_MODE_640x480P72] = "480p72",
+    [VIDEO_MODE_640x576P50] = "576p50",
+};
+
+static struct {
+    struct dvi_inst *inst;
+    void (*reclocked)(void);
+    bool pal;
+    uint32_t standard_frames;
+    video_mode_stats_t stats;
+} state;
+
+const struct dvi_timing *video_mode_get_timing(uint32_t mode)
+{
+    return timings[(mode < VIDEO_MODE_COUNT) ? mode : VIDEO_MODE_640x480P60];
+}
+
+// The flash can't be read while the SSI is disabled, so this runs from RAM.
+// The other core must not run from flash either.
+static void __no_inline_not_in_flash_func(flash_set_clkdiv)(uint32_t div)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    ssi_hw->ssienr = 0;
+    ssi_hw->baudr = div;
+    ssi_hw->ssienr = 1;
+    restore_interrupts(irq);
+}
+
+void video_mode_set_sys_clock_khz(uint32_t khz)
+{
+    // Even divider, rounded up
+    uint32_t div = (khz + FLASH_MAX_KHZ - 1) / FLASH_MAX_KHZ;
+    div = (div + 1) & ~1u;
+
+    // Slow the flash down before speeding up, and the other way around
+    if (khz * 1000 > clock_get_hz(clk_sys)) {
+        flash_set_clkdiv(div);
+        set_sys_clock_khz(khz, true);
+    } else {
+        set_sys_clock_khz(khz, true);
+        flash_set_clkdiv(div);
+    }
+}
+
+void video_mode_init(struct dvi_inst *inst, void (*reclocked)(void))
+{
+    state.inst = inst;
+    state.reclocked = reclocked;
+}
+
+bool video_mode_set(const struct dvi_timing *timing)
+{
+    struct dvi_inst *inst = state.inst;
+
+    // Every frame buffer line is shown twice
+    if (timing->h_active_pixels != FRAME_HORIZONTAL_REPEAT * FRAME_WIDTH ||
+        timing->v_active_lines > DVI_VERTICAL_REPEAT * FRAME_HEIGHT) {
+        return false;
+    }
+
+    if (timing == inst->timing) {
+        return true;
+    }
+
+    if (dvi_timing_same_horizontal(timing, inst->timing)) {
+        dvi_set_vertical_timing(inst, timing);
+        return true;
+    }
+
+    // Core 1 encodes the lines it already has, stops DVI and reports back
+    uint32_t *stop = NULL;
+    queue_add_blocking_u32(&inst->q_colour_valid, &stop);
+    multicore_fifo_pop_blocking();
+
+    bool reclock = (timing->bit_clk_khz != inst->timing->bit_clk_khz);
+    if (reclock) {
+        video_mode_set_sys_clock_khz(timing->bit_clk_khz);
+    }
+
+    dvi_set_timing(inst, timing);
+
+    if (reclock && state.reclocked) {
+        state.reclocked();
+    }
+
+    // Same as at boot, the first two lines (or the first frame) have to be there before starting
+    framebuf_pixel_t *bufptr = framebuf_get_scanline(0);
+    queue_add_blocking_u32(&inst->q_colour_valid, &bufptr);
+#if !DVI_FRAMEBUF_WORKER
+    bufptr = framebuf_get_scanline(1);
+    queue_add_blocking_u32(&inst->q_colour_valid, &bufptr);
+#endif
+
+    // Core 1 restarts and reports how long the output was stopped
+    multicore_fifo_push_blocking(0);
+    state.stats.blackout_us = multicore_fifo_pop_blocking();
+    state.stats.switches++;
+
+    return true;
+}
+
+void video_mode_apply(void)
+{
+#if PAL_50HZ
+    uint32_t mode = state.pal ? g_config.video_mode_pal : g_config.video_mode;
+#else
+    uint32_t mode = g_config.video_mode;
+#endif
+
+    if (!video_mode_set(video_mode_get_timing(mode))) {
+        // Doesn't fit the frame buffer, fall back to the default
+        video_mode_set(video_mode_get_timing(VIDEO_MODE_640x480P60));
+    }
+}
+
+void video_mode_update_standard(bool pal)
+{
+    // The monitor has to resync, so don't switch on a single odd frame
+    if (pal == state.pal) {
+        state.standard_frames = 0;
+    } else if (++state.standard_frames >= DVI_TIMING_SWITCH_FRAMES) {
+        state.standard_frames = 0;
+        state.pal = pal;
+        video_mode_apply();
+    }
+}
+
+void __not_in_flash_func(video_mode_core1_restart)(uint irq_num)
+{
+    struct dvi_inst *inst = state.inst;
+
+    dvi_unregister_irqs_this_core(inst, irq_num);
+    dvi_stop(inst);
+    uint32_t t0 = time_us_32();
+
+    // Core 0 may change the flash clock, so wait without leaving RAM
+    while (!multicore_fifo_wready())
+        ;
+    sio_hw->fifo_wr = 0;
+    __sev();
+    while (!multicore_fifo_rvalid()) {
+        __wfe();
+    }
+    (void) sio_hw->fifo_rd;
+
+    dvi_register_irqs_this_core(inst, irq_num);
+    dvi_start(inst);
+    multicore_fifo_push_blocking(time_us_32() - t0);
+}
+
+const video_mode_stats_t *video_mode_get_stats(void)
+{
+    return &state.stats;
+}
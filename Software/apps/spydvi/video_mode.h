@@ -0,0 +1,96 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file video_mode.h
+ * @brief Switch the DVI output mode at runtime.
+ *
+ * Modes that only differ in the number of lines are switched between two
+ * frames without interrupting the output. Anything else stops the output:
+ * core 1 encodes what it has been given, stops DVI and waits, while core 0
+ * re-clocks the system, rebuilds the DMA lists and TMDS buffers and hands
+ * the first lines of the frame buffer back to core 1, which restarts.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "dvi.h"
+
+/**
+ * @struct video_mode_stats
+ * @brief Mode switch counters.
+ */
+typedef struct video_mode_stats {
+    uint32_t switches;    ///< Number of switches that stopped the output, since boot.
+    uint32_t blackout_us; ///< Time the output was stopped, last switch. The monitor takes longer to resync.
+} video_mode_stats_t;
+
+/// Names of the video modes, indexed by @ref video_mode_t.
+extern const char *const video_mode_names[VIDEO_MODE_COUNT];
+
+/**
+ * @brief Get the DVI timing of a video mode.
+ * @param mode The video mode (see @ref video_mode_t).
+ * @return The timing, or the timing of the default mode if mode is invalid.
+ */
+const struct dvi_timing *video_mode_get_timing(uint32_t mode);
+
+/**
+ * @brief Set the system clock, keeping the flash clock within FLASH_MAX_KHZ.
+ *
+ * Everything else derived from clk_sys has to be updated by the caller.
+ * @param khz The new system clock in kHz.
+ */
+void video_mode_set_sys_clock_khz(uint32_t khz);
+
+/**
+ * @brief Initialize mode switching.
+ * @param inst The DVI instance, already initialized.
+ * @param reclocked Called after the system clock changed, with DVI stopped.
+ */
+void video_mode_init(struct dvi_inst *inst, void (*reclocked)(void));
+
+/**
+ * @brief Switch to another DVI timing (core 0).
+ *
+ * Blocks until the new timing is in use.
+ * @param timing The new timing.
+ * @return false if the frame buffer can't fill the timing.
+ */
+bool video_mode_set(const struct dvi_timing *timing);
+
+/**
+ * @brief Switch to the configured mode for the current video standard (core 0).
+ *
+ * Called when g_config.video_mode or g_config.video_mode_pal changed.
+ */
+void video_mode_apply(void);
+
+/**
+ * @brief Follow the video standard of the console (core 0).
+ *
+ * Called once per captured frame. Switches mode once the standard has been
+ * stable for DVI_TIMING_SWITCH_FRAMES frames.
+ * @param pal true if the last frame was PAL.
+ */
+void video_mode_update_standard(bool pal);
+
+/**
+ * @brief Stop the output, wait for the new mode and restart it (core 1).
+ *
+ * Called by core 1 when the TMDS encode worker returns.
+ * @param irq_num The DMA IRQ DVI is using.
+ */
+void video_mode_core1_restart(uint irq_num);
+
+/**
+ * @brief Get the mode switch counters.
+ * @return A pointer to the counters.
+ */
+const video_mode_stats_t *video_mode_get_stats(void);
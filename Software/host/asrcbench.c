@@ -0,0 +1,282 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// THD+N of the audio resampling, with and without AUDIO_ASRC.
+//
+// A sine at the N64's rate is written to the input ring as the audio DMA
+// would, while libdvi takes samples out of the audio ring at the output rate.
+// asrc_process() is called on every row the capture skips, none on the 240
+// rows it keeps. The old path is modelled by taking the latest input frame at
+// every output sample, like the timer paced DMA does.
+//
+// The output is split into blocks, a sine is fitted to each one, and what's
+// left over is the noise and distortion, summed over all blocks. The pitch
+// error of the converter is shown separately, in ppm.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "asrc.h"
+#include "hardware/structs/systick.h"
+
+// The output is measured after the rate has been found
+#define SETTLE_SECONDS 1
+
+// Samples per fitted block
+#define BLOCK 4096
+
+// NTSC VI rows, and the ones the capture keeps
+#define ROWS_PER_FRAME 511
+#define FRAME_RATE 60
+#define CAPTURED_ROWS 240
+
+static const double default_tones[] = { 100, 1000, 4000, 10000 };
+
+systick_hw_t host_systick_hw;
+
+typedef struct result {
+    double asrc_db;
+    double asrc_ppm;
+    double nearest_db;
+    uint32_t input_rate;
+    uint32_t resyncs;
+    uint32_t underruns;
+} result_t;
+
+// Solve m x = the last column, for n unknowns
+static void solve(double m[4][5], int n, double *x)
+{
+    for (int p = 0; p < n; p++) {
+        for (int r = p + 1; r < n; r++) {
+            double f = m[r][p] / m[p][p];
+            for (int c = p; c <= n; c++) {
+                m[r][c] -= f * m[p][c];
+            }
+        }
+    }
+    for (int r = n - 1; r >= 0; r--) {
+        x[r] = m[r][n];
+        for (int c = r + 1; c < n; c++) {
+            x[r] -= m[r][c] * x[c];
+        }
+        x[r] /= m[r][r];
+    }
+}
+
+// Least squares of a sin + b cos + c at w radians per sample, around the middle of the block,
+// and with the frequency as the fourth unknown when fit_w is set
+static void fit(const double *x, double w, bool fit_w, const double *k0, double *k)
+{
+    int n = fit_w ? 4 : 3;
+    double m[4][5] = { { 0 } };
+    for (int i = 0; i < BLOCK; i++) {
+        double t = i - BLOCK / 2;
+        double v[4] = { sin(w * t), cos(w * t), 1, 0 };
+        if (fit_w) {
+            v[3] = t * (k0[0] * v[1] - k0[1] * v[0]);
+        }
+        for (int r = 0; r < n; r++) {
+            for (int c = 0; c < n; c++) {
+                m[r][c] += v[r] * v[c];
+            }
+            m[r][n] += v[r] * x[i];
+        }
+    }
+    solve(m, n, k);
+}
+
+// Noise and distortion left after fitting a sine to each block, starting at
+// w radians per sample. The frequency is fitted too, so a pitch off by a few
+// ppm isn't counted, and the mean of it is returned.
+static double thdn(const double *x, size_t n, double w, double *signal, double *noise)
+{
+    double w_sum = 0;
+    int blocks = 0;
+
+    for (size_t start = 0; start + BLOCK <= n; start += BLOCK) {
+        const double *block = x + start;
+        double w_block = w;
+        double k[4];
+        fit(block, w_block, false, NULL, k);
+        for (int i = 0; i < 4; i++) {
+            double k4[4];
+            fit(block, w_block, true, k, k4);
+            w_block += k4[3];
+            fit(block, w_block, false, NULL, k);
+        }
+        w_sum += w_block;
+        blocks++;
+
+        for (int i = 0; i < BLOCK; i++) {
+            double t = i - BLOCK / 2;
+            double s = k[0] * sin(w_block * t) + k[1] * cos(w_block * t);
+            double e = block[i] - s - k[2];
+            *signal += s * s;
+            *noise += e * e;
+        }
+    }
+
+    return blocks ? w_sum / blocks : w;
+}
+
+static double to_db(double signal, double noise)
+{
+    return 10 * log10(noise / signal);
+}
+
+static void run(double input_rate, uint32_t output_rate, double tone, double level, double seconds, result_t *result)
+{
+    static audio_sample_t input[ASRC_INPUT_SIZE];
+    static audio_sample_t output[AUDIO_BUFFER_SIZE];
+    static audio_ring_t ring;
+    uint32_t resyncs = asrc_get_stats()->resyncs;
+
+    memset(input, 0, sizeof(input));
+    audio_ring_set(&ring, output, AUDIO_BUFFER_SIZE);
+    asrc_init(input, &ring, output_rate);
+
+    size_t samples = (seconds - SETTLE_SECONDS) * output_rate;
+    double *asrc_out = calloc(samples, sizeof(double));
+    double *nearest_out = calloc(samples, sizeof(double));
+    size_t count = 0;
+
+    uint32_t written = 0;
+    audio_sample_t latest = { { 0, 0 } };
+    double input_phase = 0;
+    double output_phase = 0;
+    uint32_t last_row = 0;
+    result->underruns = 0;
+
+    uint64_t total_us = seconds * 1e6;
+    for (uint64_t us = 0; us < total_us && count < samples; us++) {
+        // The PIO and DMA
+        input_phase += input_rate * 1e-6;
+        while (input_phase >= 1) {
+            input_phase -= 1;
+            double v = level * 32767 * sin(2 * M_PI * tone * written / input_rate);
+            latest.channels[0] = lrint(v);
+            latest.channels[1] = -latest.channels[0];
+            input[written % ASRC_INPUT_SIZE] = latest;
+            written++;
+        }
+
+        // Core 0
+        uint32_t row = (us * FRAME_RATE * ROWS_PER_FRAME / 1000000) % ROWS_PER_FRAME;
+        if (row != last_row) {
+            last_row = row;
+            if (row >= CAPTURED_ROWS) {
+                asrc_process(written % ASRC_INPUT_SIZE, us);
+            }
+        }
+
+        // libdvi
+        output_phase += output_rate * 1e-6;
+        while (output_phase >= 1) {
+            output_phase -= 1;
+            audio_sample_t s = { { 0, 0 } };
+            if (get_read_size(&ring, true) > 0) {
+                s = ring.buffer[ring.read];
+                increase_read_pointer(&ring, 1);
+            } else if (us >= SETTLE_SECONDS * 1000000) {
+                result->underruns++;
+            }
+            if (us >= SETTLE_SECONDS * 1000000 && count < samples) {
+                asrc_out[count] = s.channels[0];
+                nearest_out[count] = latest.channels[0];
+                count++;
+            }
+        }
+    }
+
+    double w = 2 * M_PI * tone / output_rate;
+    double signal = 0;
+    double noise = 0;
+    double w_asrc = thdn(asrc_out, count, w, &signal, &noise);
+    result->asrc_db = to_db(signal, noise);
+    result->asrc_ppm = (w_asrc / w - 1) * 1e6;
+    signal = 0;
+    noise = 0;
+    thdn(nearest_out, count, w, &signal, &noise);
+    result->nearest_db = to_db(signal, noise);
+
+    const asrc_stats_t *stats = asrc_get_stats();
+    result->input_rate = stats->input_rate;
+    result->resyncs = stats->resyncs - resyncs;
+
+    free(asrc_out);
+    free(nearest_out);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -i hz       N64 audio rate (default 32005, the NTSC rate for 32 kHz)\n"
+        "  -o hz       output rate (default 48000)\n"
+        "  -f hz       tone, may be repeated (default 100, 1000, 4000 and 10000)\n"
+        "  -l dbfs     tone level (default -1)\n"
+        "  -s seconds  time simulated per tone (default 10)\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    double input_rate = 32005;
+    uint32_t output_rate = 48000;
+    double tones[16];
+    int tone_count = 0;
+    double level_db = -1;
+    double seconds = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:f:l:s:")) != -1) {
+        switch (opt) {
+        case 'i':
+            input_rate = strtod(optarg, NULL);
+            break;
+        case 'o':
+            output_rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            if (tone_count < 16) {
+                tones[tone_count++] = strtod(optarg, NULL);
+            }
+            break;
+        case 'l':
+            level_db = strtod(optarg, NULL);
+            break;
+        case 's':
+            seconds = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || input_rate <= 0 || output_rate == 0 || seconds <= SETTLE_SECONDS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (tone_count == 0) {
+        tone_count = sizeof(default_tones) / sizeof(default_tones[0]);
+        memcpy(tones, default_tones, sizeof(default_tones));
+    }
+
+    printf("%.0f Hz to %u Hz, %.1f dBFS\n", input_rate, output_rate, level_db);
+    printf("tone Hz    asrc dB  pitch ppm  nearest dB  measured Hz  resyncs  underruns\n");
+    for (int i = 0; i < tone_count; i++) {
+        result_t result;
+        run(input_rate, output_rate, tones[i], pow(10, level_db / 20), seconds, &result);
+        printf("%7.0f  %9.1f  %9.1f  %10.1f  %11u  %7u  %9u\n", tones[i], result.asrc_db, result.asrc_ppm, result.nearest_db,
+               result.input_rate, result.resyncs, result.underruns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// Time stamps for the host benchmarks: TSC ticks on x86, nanoseconds
+// elsewhere. Either only says how two pieces of code compare on the host,
+// not what they take on the RP2040.
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_UNIT "TSC ticks"
+#else
+#define BENCH_UNIT "ns"
+#endif
+
+static inline uint64_t bench_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
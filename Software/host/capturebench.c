@@ -0,0 +1,278 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// Line capture of n64_capture.c, timed on the host.
+//
+// n64_capture.c is included for its static functions. A line of random VI
+// words is handed out by video_dma_trace.c in runs of a few lengths: the
+// whole ring, as when core 0 is behind, down to a few words, as when it
+// keeps up with the DMA and each video_dma_acquire() only gets what arrived
+// since the last one.
+//
+// The line converters DEFINE_CAPTURE_LINE makes for each pixel format are
+// timed against a copy of the loop they replaced, which tested the color
+// mode on every run. Both have to give the same pixels.
+//
+// Then the odd rows: skipped, or with LINE_BLEND cropped, converted and
+// averaged into the row above with blend_run(), which is checked against
+// averaging each channel on its own first.
+
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "n64_capture.c"
+
+#include "bench.h"
+#include "video_dma_trace.h"
+
+#if VIDEO_CAPTURE_PACKED || FRAMEBUF_BPP == 32 || FRAMEBUF_PALETTE || VIDEO_CONVERT_INTERP
+#error "The loop before DEFINE_CAPTURE_LINE only had the RGB555, RGB565 and RGB332 converters"
+#endif
+
+// A row after HSYNC: the left crop, the active pixels, and HSYNC again
+#define CROP_WORDS (DEFAULT_CROP_X_NTSC / VI_PIXELS_PER_WORD)
+#define ACTIVE_WORDS (VI_PIXEL_STRIDE * FRAME_WIDTH)
+#define ROW_WORDS (CROP_WORDS + ACTIVE_WORDS + 64)
+
+config_t g_config = {
+    .dvi_color_mode = DVI_RGB_555,
+};
+
+static uint32_t row_words[ROW_WORDS];
+static const vi_trace_t row_trace = {
+    .words = row_words,
+    .count = ROW_WORDS,
+};
+// The same without the crop, what the line capture sees
+static const vi_trace_t line_trace = {
+    .words = row_words + CROP_WORDS,
+    .count = ROW_WORDS - CROP_WORDS,
+};
+
+// Never jumped to, a line leaves words over
+static jmp_buf at_end;
+
+// The loop before DEFINE_CAPTURE_LINE, as it was in n64_capture_frame()
+static void __not_in_flash_func(ref_capture_line)(framebuf_pixel_t *dst)
+{
+    uint32_t left = FRAME_WIDTH;
+    uint32_t color_mode = g_config.dvi_color_mode;
+
+    while (left) {
+        uint32_t available;
+        const uint32_t *src = video_dma_acquire(&available);
+        uint32_t pixels = MIN((available + VI_PIXEL_STRIDE - 1) / VI_PIXEL_STRIDE, left);
+
+#if FRAMEBUF_BPP == 8
+        (void) color_mode;
+        convert_run_332(dst, src, pixels);
+#else
+        if (color_mode == DVI_RGB_555) {
+            convert_run_555(dst, src, pixels);
+        } else if (color_mode == DVI_RGB_565) {
+            convert_run_565(dst, src, pixels);
+        } else {
+            // Panic
+        }
+#endif
+
+        dst += pixels;
+        left -= pixels;
+
+        if (VI_PIXEL_STRIDE * pixels > available) {
+            video_dma_release(available);
+            if (left) {
+                video_dma_get();
+            }
+        } else {
+            video_dma_release(VI_PIXEL_STRIDE * pixels);
+        }
+    }
+}
+
+// Called through a pointer like n64_capture_frame() does, so never inlined
+static capture_line_t volatile capture_fn;
+static void (*volatile row_fn)(void);
+
+static framebuf_pixel_t line[FRAMEBUF_PLANES * FRAME_WIDTH] __attribute__((aligned(4)));
+static framebuf_pixel_t blend_line[FRAME_WIDTH] __attribute__((aligned(4)));
+
+static void convert_row(void)
+{
+    capture_fn(line);
+}
+
+// An odd row without LINE_BLEND
+static void skip_row(void)
+{
+    video_dma_skip_while_set(ACTIVE_PIXEL_MASK);
+}
+
+// An odd row with LINE_BLEND, as in n64_capture_frame()
+static void blend_row(void)
+{
+    for (uint32_t left_ctr = 0; left_ctr < CROP_WORDS; left_ctr++) {
+        video_dma_get();
+    }
+    capture_fn(blend_line);
+    blend_run((uint32_t *) line, (const uint32_t *) blend_line, BLEND_WORDS);
+    video_dma_skip_while_set(ACTIVE_PIXEL_MASK);
+}
+
+// Cycles per row, the fastest of all rounds
+static double run(void (*row)(void), const vi_trace_t *trace, uint32_t run_words, int rows, int rounds)
+{
+    uint64_t best = UINT64_MAX;
+
+    row_fn = row;
+    for (int round = 0; round < rounds; round++) {
+        uint64_t t0 = bench_now();
+        for (int i = 0; i < rows; i++) {
+            video_dma_trace_start(trace, run_words, &at_end);
+            row_fn();
+            // Keep the stores
+            __asm__ volatile("" : : "r"(line) : "memory");
+        }
+        uint64_t t = bench_now() - t0;
+        best = (t < best) ? t : best;
+    }
+    return (double) best / rows;
+}
+
+// Average of two pixels, one channel at a time
+static framebuf_pixel_t ref_blend_pixel(framebuf_pixel_t a, framebuf_pixel_t b)
+{
+#if FRAMEBUF_BPP == 8
+    static const uint32_t shifts[] = { 5, 2, 0 };
+    static const uint32_t masks[] = { 0x7, 0x7, 0x3 };
+#else
+    static const uint32_t shifts[] = { 11, 5, 0 };
+    static const uint32_t masks[] = { 0x1f, 0x3f, 0x1f };
+#endif
+    framebuf_pixel_t p = 0;
+    for (int c = 0; c < 3; c++) {
+        uint32_t ca = (a >> shifts[c]) & masks[c];
+        uint32_t cb = (b >> shifts[c]) & masks[c];
+        p |= ((ca + cb) / 2) << shifts[c];
+    }
+    return p;
+}
+
+// Pixels of random lines where blend_run() differs from ref_blend_pixel()
+static int check_blend(int count)
+{
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        static framebuf_pixel_t a[FRAME_WIDTH] __attribute__((aligned(4)));
+        static framebuf_pixel_t b[FRAME_WIDTH] __attribute__((aligned(4)));
+        static framebuf_pixel_t out[FRAME_WIDTH] __attribute__((aligned(4)));
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            a[x] = rand();
+            b[x] = rand();
+        }
+        memcpy(out, a, sizeof(out));
+        blend_run((uint32_t *) out, (const uint32_t *) b, BLEND_WORDS);
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            failures += (out[x] != ref_blend_pixel(a[x], b[x]));
+        }
+    }
+    return failures;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -n lines    lines or rows per round (default 20000)\n"
+        "  -r rounds   rounds, the fastest counts (default 20)\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    int lines = 20000;
+    int rounds = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            lines = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            rounds = strtol(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || lines <= 0 || rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Pixels of random colors, HSYNC after the active ones
+    for (uint32_t i = 0; i < ROW_WORDS; i++) {
+        uint32_t sync = (i < CROP_WORDS + ACTIVE_WORDS) ? ACTIVE_PIXEL_MASK : (ACTIVE_PIXEL_MASK & ~HSYNCB_MASK);
+        row_words[i] = (rand() & 0x7f7f7f00) | sync;
+    }
+
+#if FRAMEBUF_BPP == 8
+    static const uint32_t modes[] = { DVI_RGB_555 };
+    static const char *const names[] = { "RGB332" };
+#else
+    static const uint32_t modes[] = { DVI_RGB_555, DVI_RGB_565 };
+    static const char *const names[] = { "RGB555", "RGB565" };
+#endif
+    static const uint32_t runs[] = { VIDEO_DMA_RING_WORDS, 64, 16, 4 };
+
+    int failures = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        g_config.dvi_color_mode = modes[m];
+        capture_line_t capture_line = get_capture_line();
+
+        printf("%s, per line, %s\n", names[m], BENCH_UNIT);
+        printf("  run words  per run branch  per format\n");
+        for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+            static framebuf_pixel_t ref_line[FRAMEBUF_PLANES * FRAME_WIDTH];
+            capture_fn = ref_capture_line;
+            run(convert_row, &line_trace, runs[r], 1, 1);
+            memcpy(ref_line, line, sizeof(line));
+            capture_fn = capture_line;
+            run(convert_row, &line_trace, runs[r], 1, 1);
+            if (memcmp(ref_line, line, sizeof(line))) {
+                printf("  run words %u: the pixels differ\n", runs[r]);
+                failures++;
+            }
+
+            capture_fn = ref_capture_line;
+            double before = run(convert_row, &line_trace, runs[r], lines, rounds);
+            capture_fn = capture_line;
+            double after = run(convert_row, &line_trace, runs[r], lines, rounds);
+            printf("  %9u  %14.1f  %10.1f (%.0f%%)\n", runs[r], before, after, 100 * after / before);
+        }
+    }
+
+    int blend_failures = check_blend(1000);
+    printf("\nblend_run, %d of %d pixels differ from the average of each channel\n", blend_failures, 1000 * FRAME_WIDTH);
+    failures += blend_failures;
+
+    g_config.dvi_color_mode = modes[0];
+    capture_fn = get_capture_line();
+    printf("%s odd rows, per row, %s\n", names[0], BENCH_UNIT);
+    printf("  run words  skipped  blended\n");
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        double skipped = run(skip_row, &row_trace, runs[r], lines, rounds);
+        double blended = run(blend_row, &row_trace, runs[r], lines, rounds);
+        printf("  %9u  %7.1f  %7.1f (%.1fx)\n", runs[r], skipped, blended, blended / skipped);
+    }
+
+    return failures ? 1 : 0;
+}
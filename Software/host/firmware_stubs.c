@@ -0,0 +1,36 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// Firmware functions the capture code links against that are assembly or
+// TMDS encode on the RP2040, for the host tools.
+
+#include <string.h>
+
+#include "config.h"
+#include "sprite.h"
+#include "palette.h"
+
+// sprite.S, only used to fill the frame buffers
+void sprite_fill8(uint8_t *dst, uint8_t colour, uint len)
+{
+    memset(dst, colour, len);
+}
+
+void sprite_fill16(uint16_t *dst, uint16_t colour, uint len)
+{
+    while (len--) {
+        *dst++ = colour;
+    }
+}
+
+#if FRAMEBUF_PALETTE
+// palette_encode.c, there is no TMDS encode here
+void palette_encode_set(uint32_t set, const palette_color_t *colors)
+{
+    (void) set;
+    (void) colors;
+}
+#endif
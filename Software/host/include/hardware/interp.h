@@ -0,0 +1,109 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code.
+// A model of the interpolator lanes: shift (a right rotate), mask, sign
+// extension, cross input and raw add.
+
+#pragma once
+
+#include "pico/types.h"
+
+#define INTERP_CTRL_SHIFT_LSB    0
+#define INTERP_CTRL_MASK_LSB_LSB 5
+#define INTERP_CTRL_MASK_MSB_LSB 10
+#define INTERP_CTRL_SIGNED       (1u << 15)
+#define INTERP_CTRL_CROSS_INPUT  (1u << 16)
+#define INTERP_CTRL_ADD_RAW      (1u << 18)
+
+typedef struct {
+    uint32_t accum[2];
+    uint32_t base[3];
+    uint32_t ctrl[2];
+} interp_hw_t;
+
+extern interp_hw_t host_interp_hw[2];
+
+#define interp0_hw (&host_interp_hw[0])
+#define interp1_hw (&host_interp_hw[1])
+#define interp0 interp0_hw
+#define interp1 interp1_hw
+
+typedef struct {
+    uint32_t ctrl;
+} interp_config;
+
+static inline void interp_config_set_shift(interp_config *c, uint shift)
+{
+    c->ctrl = (c->ctrl & ~(0x1fu << INTERP_CTRL_SHIFT_LSB)) | (shift << INTERP_CTRL_SHIFT_LSB);
+}
+
+static inline void interp_config_set_mask(interp_config *c, uint mask_lsb, uint mask_msb)
+{
+    c->ctrl = (c->ctrl & ~(0x3ffu << INTERP_CTRL_MASK_LSB_LSB)) |
+              (mask_lsb << INTERP_CTRL_MASK_LSB_LSB) | (mask_msb << INTERP_CTRL_MASK_MSB_LSB);
+}
+
+static inline void interp_config_set_signed(interp_config *c, bool _signed)
+{
+    c->ctrl = _signed ? (c->ctrl | INTERP_CTRL_SIGNED) : (c->ctrl & ~INTERP_CTRL_SIGNED);
+}
+
+static inline void interp_config_set_cross_input(interp_config *c, bool cross_input)
+{
+    c->ctrl = cross_input ? (c->ctrl | INTERP_CTRL_CROSS_INPUT) : (c->ctrl & ~INTERP_CTRL_CROSS_INPUT);
+}
+
+static inline void interp_config_set_add_raw(interp_config *c, bool add_raw)
+{
+    c->ctrl = add_raw ? (c->ctrl | INTERP_CTRL_ADD_RAW) : (c->ctrl & ~INTERP_CTRL_ADD_RAW);
+}
+
+static inline interp_config interp_default_config(void)
+{
+    interp_config c = {0};
+    interp_config_set_mask(&c, 0, 31);
+    return c;
+}
+
+static inline void interp_set_config(interp_hw_t *interp, uint lane, interp_config *config)
+{
+    interp->ctrl[lane] = config->ctrl;
+}
+
+static inline void interp_set_base(interp_hw_t *interp, uint lane, uint32_t val)
+{
+    interp->base[lane] = val;
+}
+
+static inline void interp_set_accumulator(interp_hw_t *interp, uint lane, uint32_t val)
+{
+    interp->accum[lane] = val;
+}
+
+// Shifted and masked input of a lane, or the raw input with ADD_RAW
+static inline uint32_t interp_lane_value(const interp_hw_t *interp, uint lane)
+{
+    uint32_t ctrl = interp->ctrl[lane];
+    uint32_t input = (ctrl & INTERP_CTRL_CROSS_INPUT) ? interp->accum[lane ^ 1] : interp->accum[lane];
+    if (ctrl & INTERP_CTRL_ADD_RAW) {
+        return input;
+    }
+
+    uint shift = (ctrl >> INTERP_CTRL_SHIFT_LSB) & 0x1f;
+    uint lsb = (ctrl >> INTERP_CTRL_MASK_LSB_LSB) & 0x1f;
+    uint msb = (ctrl >> INTERP_CTRL_MASK_MSB_LSB) & 0x1f;
+    uint32_t mask = (0xffffffffu >> (31 - msb)) & ~((1u << lsb) - 1);
+    uint32_t value = ((input >> shift) | (input << ((32 - shift) & 31))) & mask;
+    if ((ctrl & INTERP_CTRL_SIGNED) && (value & (1u << msb))) {
+        value |= ~(0xffffffffu >> (31 - msb));
+    }
+    return value;
+}
+
+static inline uint32_t interp_peek_lane_result(interp_hw_t *interp, uint lane)
+{
+    return interp->base[lane] + interp_lane_value(interp, lane);
+}
+
+static inline uint32_t interp_peek_full_result(interp_hw_t *interp)
+{
+    return interp->base[2] + interp_lane_value(interp, 0) + interp_lane_value(interp, 1);
+}
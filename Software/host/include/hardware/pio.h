@@ -0,0 +1,8 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code
+
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t *PIO;
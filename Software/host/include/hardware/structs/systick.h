@@ -0,0 +1,20 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code.
+// SysTick never counts, cycle counters read as zero.
+
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    const volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t host_systick_hw;
+
+#define systick_hw (&host_systick_hw)
+
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001
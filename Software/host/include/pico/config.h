@@ -0,0 +1,3 @@
+// Host stand-in for the pico-sdk header, just enough for dvi_config_defs.h
+
+#pragma once
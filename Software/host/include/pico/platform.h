@@ -0,0 +1,19 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code
+
+#pragma once
+
+#include <assert.h>
+#include "pico/types.h"
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __force_inline inline __attribute__((always_inline))
+
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
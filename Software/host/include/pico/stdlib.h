@@ -0,0 +1,6 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code
+
+#pragma once
+
+#include "pico/types.h"
+#include "pico/platform.h"
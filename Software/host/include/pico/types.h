@@ -0,0 +1,9 @@
+// Host stand-in for the pico-sdk header, just enough for the capture code
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
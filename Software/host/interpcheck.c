@@ -0,0 +1,106 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// The interp1 converter of the capture, against the shifts and masks it
+// stands in for (VIDEO_CONVERT_INTERP).
+//
+// n64_capture.c is included for its static converters. All 2^21 colors of a
+// VI word go through convert_run_interp(), with interp1 modelled by
+// include/hardware/interp.h, and through the plain converter of each color
+// mode, once with the bits around the colors clear and once set. The pixels
+// have to be the same.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "n64_capture.c"
+
+#if VIDEO_CAPTURE_PACKED || FRAMEBUF_BPP == 32 || FRAMEBUF_PALETTE
+#error "There is no convert_run_interp in this configuration"
+#endif
+
+#define COLORS (1u << 21)
+
+// Sync, unused and padding bits of a VI word
+#define OTHER_BITS (0x808080ff)
+
+config_t g_config = {
+    .dvi_color_mode = DVI_RGB_555,
+};
+
+// Differing pixels of both converters for all colors
+static uint32_t check(const uint32_t *words, framebuf_pixel_t *ref, framebuf_pixel_t *out)
+{
+    convert_interp_setup();
+    convert_run_interp(out, words, COLORS);
+#if FRAMEBUF_BPP == 8
+    convert_run_332(ref, words, COLORS);
+#else
+    if (g_config.dvi_color_mode == DVI_RGB_565) {
+        convert_run_565(ref, words, COLORS);
+    } else {
+        convert_run_555(ref, words, COLORS);
+    }
+#endif
+
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < COLORS; i++) {
+        if (ref[i] != out[i]) {
+            if (failures == 0) {
+                printf("  word %08x: %04x, interp %04x\n", words[i * VI_PIXEL_STRIDE], ref[i], out[i]);
+            }
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void)
+{
+    uint32_t *words = calloc(COLORS * VI_PIXEL_STRIDE, sizeof(uint32_t));
+    framebuf_pixel_t *ref = calloc(COLORS, sizeof(framebuf_pixel_t));
+    framebuf_pixel_t *out = calloc(COLORS, sizeof(framebuf_pixel_t));
+    if (!words || !ref || !out) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+#if FRAMEBUF_BPP == 8
+    static const uint32_t modes[] = { DVI_RGB_555 };
+    static const char *const names[] = { "RGB332" };
+#else
+    static const uint32_t modes[] = { DVI_RGB_555, DVI_RGB_565 };
+    static const char *const names[] = { "RGB555", "RGB565" };
+#endif
+
+    uint32_t failures = 0;
+    for (uint32_t other = 0; other < 2; other++) {
+        // xBBBBBBBxGGGGGGGxRRRRRRRXXXXVLHC, the skipped words hold garbage
+        for (uint32_t color = 0; color < COLORS; color++) {
+            uint32_t r = color & 0x7f;
+            uint32_t g = (color >> 7) & 0x7f;
+            uint32_t b = color >> 14;
+            uint32_t *word = &words[color * VI_PIXEL_STRIDE];
+            word[0] = (b << 24) | (g << 16) | (r << 8) | (other ? OTHER_BITS : 0);
+            for (uint32_t i = 1; i < VI_PIXEL_STRIDE; i++) {
+                word[i] = rand();
+            }
+        }
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            g_config.dvi_color_mode = modes[m];
+            uint32_t differ = check(words, ref, out);
+            printf("%s, other bits %s: %u of %u colors differ\n", names[m], other ? "set" : "clear", differ, COLORS);
+            failures += differ;
+        }
+    }
+
+    free(words);
+    free(ref);
+    free(out);
+    return failures ? 1 : 0;
+}
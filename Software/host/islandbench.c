@@ -0,0 +1,252 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// Data island encode, table driven against the per symbol encoder it replaced.
+//
+// The DMA IRQ builds an audio sample packet with set_audio_sample() and
+// encodes it with encode() on every line. Both are run here on random
+// packets and samples, next to copies of the old versions below, and have to
+// give the same TMDS words. Then both are timed, in host cycles, which only
+// say how the two compare. The cycles on the RP2040 are shown under
+// DIAGNOSTICS when libdvi is built with DVI_IRQ_STATS.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "data_packet.h"
+
+// From data_packet.c, not in its header
+extern uint16_t TERC4Syms_[16];
+bool compute8_3(uint8_t index1, uint8_t index2, uint8_t index3);
+
+// The old encoder, as it was
+
+#define REF_GUARDBAND 0x0004CD33
+
+static inline uint32_t ref_terc4x2(int i0, int i1) { return TERC4Syms_[i0] | (TERC4Syms_[i1] << 10); }
+
+static void ref_encode_header(const data_packet_t *data_packet, uint32_t *dst, int hv, bool firstPacket) {
+    int hv1 = hv | 8;
+    if (!firstPacket) {
+        hv = hv1;
+    }
+    for (int i = 0; i < 4; ++i) {
+        uint8_t h = data_packet->header[i];
+        dst[0] = ref_terc4x2(((h << 2) & 4) | hv,  ((h << 1) & 4) | hv1);
+        dst[1] = ref_terc4x2((h & 4) | hv1,        ((h >> 1) & 4) | hv1);
+        dst[2] = ref_terc4x2(((h >> 2) & 4) | hv1, ((h >> 3) & 4) | hv1);
+        dst[3] = ref_terc4x2(((h >> 4) & 4) | hv1, ((h >> 5) & 4) | hv1);
+        dst += 4;
+        hv = hv1;
+    }
+}
+
+static void ref_encode_subpacket(const data_packet_t *data_packet, uint32_t *dst1, uint32_t *dst2) {
+    for (int i = 0; i < 8; ++i) {
+        uint32_t v = (data_packet->subpacket[0][i] << 0)  | (data_packet->subpacket[1][i] << 8) |
+                     (data_packet->subpacket[2][i] << 16) | (data_packet->subpacket[3][i] << 24);
+        uint32_t t = (v ^ (v >> 7)) & 0x00aa00aa;
+        v = v ^ t ^ (t << 7);
+        t = (v ^ (v >> 14)) & 0x0000cccc;
+        v = v ^ t ^ (t << 14);
+        dst1[0] = ref_terc4x2((v >> 0) & 15,  (v >> 16) & 15);
+        dst1[1] = ref_terc4x2((v >> 4) & 15,  (v >> 20) & 15);
+        dst2[0] = ref_terc4x2((v >> 8) & 15,  (v >> 24) & 15);
+        dst2[1] = ref_terc4x2((v >> 12) & 15, (v >> 28) & 15);
+        dst1 += 2;
+        dst2 += 2;
+    }
+}
+
+static void ref_encode(data_island_stream_t *dst, const data_packet_t *packet, bool vsync, bool hsync) {
+    int hv = (vsync ? 2 : 0) | (hsync ? 1 : 0);
+    dst->data[0][0] = ref_terc4x2(0b1100 | hv, 0b1100 | hv);
+    dst->data[1][0] = REF_GUARDBAND;
+    dst->data[2][0] = REF_GUARDBAND;
+
+    ref_encode_header(packet, &dst->data[0][1], hv, true);
+    ref_encode_subpacket(packet, &dst->data[1][1], &dst->data[2][1]);
+
+    dst->data[0][N_DATA_ISLAND_WORDS - 1] = ref_terc4x2(0b1100 | hv, 0b1100 | hv);
+    dst->data[1][N_DATA_ISLAND_WORDS - 1] = REF_GUARDBAND;
+    dst->data[2][N_DATA_ISLAND_WORDS - 1] = REF_GUARDBAND;
+}
+
+static int ref_set_audio_sample(data_packet_t *data_packet, const audio_sample_t *p, int n, int frameCt) {
+    const int layout = 0;
+    const int samplePresent = (1 << n) - 1;
+    const int B = frameCt < 4 ? 1 << frameCt : 0;
+    data_packet->header[0] = 2;
+    data_packet->header[1] = (layout << 4) | samplePresent;
+    data_packet->header[2] = B << 4;
+    compute_header_parity(data_packet);
+
+    for (int i = 0; i < n; ++i) {
+        const int16_t l = (*p).channels[0];
+        const int16_t r = (*p).channels[1];
+        const uint8_t vuc = 1;
+        uint8_t *d = data_packet->subpacket[i];
+        d[0] = 0;
+        d[1] = l;
+        d[2] = l >> 8;
+        d[3] = 0;
+        d[4] = r;
+        d[5] = r >> 8;
+
+        bool pl = compute8_3(d[1], d[2], vuc);
+        bool pr = compute8_3(d[4], d[5], vuc);
+        d[6] = (vuc << 0) | (pl << 3) | (vuc << 4) | (pr << 7);
+        compute_subpacket_parity(data_packet, i);
+        ++p;
+    }
+    set_null(data_packet->subpacket[n], sizeof(data_packet->subpacket[0]) * (4 - n));
+
+    frameCt -= n;
+    if (frameCt < 0) {
+        frameCt += 192;
+    }
+    return frameCt;
+}
+
+// The benchmark
+
+typedef struct job {
+    audio_sample_t samples[4];
+    int n;
+    bool vsync;
+    bool hsync;
+} job_t;
+
+static void random_packet(data_packet_t *packet)
+{
+    uint8_t *bytes = (uint8_t *) packet;
+    for (size_t i = 0; i < sizeof(*packet); i++) {
+        bytes[i] = rand();
+    }
+}
+
+// Same TMDS words for random packets, and for random audio
+static int check(int count)
+{
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        data_packet_t packet;
+        data_island_stream_t ref, out;
+        bool vsync = rand() & 1;
+        bool hsync = rand() & 1;
+        random_packet(&packet);
+        ref_encode(&ref, &packet, vsync, hsync);
+        encode(&out, &packet, vsync, hsync);
+        if (memcmp(&ref, &out, sizeof(ref))) {
+            failures++;
+        }
+
+        audio_sample_t samples[4];
+        for (int j = 0; j < 4; j++) {
+            samples[j].channels[0] = rand();
+            samples[j].channels[1] = rand();
+        }
+        int n = 1 + rand() % 4;
+        int frame = rand() % 192;
+        data_packet_t ref_packet, out_packet;
+        random_packet(&ref_packet);
+        out_packet = ref_packet;
+        int ref_frame = ref_set_audio_sample(&ref_packet, samples, n, frame);
+        int out_frame = set_audio_sample(&out_packet, samples, n, frame);
+        if (ref_frame != out_frame || memcmp(&ref_packet, &out_packet, sizeof(ref_packet))) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Cycles per line of building and encoding the audio packet, the new code if
+// table is set
+static double run(const job_t *jobs, int count, int rounds, bool table)
+{
+    static data_island_stream_t stream;
+    data_packet_t packet;
+    int frame = 0;
+    uint64_t best = UINT64_MAX;
+
+    for (int round = 0; round < rounds; round++) {
+        uint64_t t0 = bench_now();
+        for (int i = 0; i < count; i++) {
+            const job_t *job = &jobs[i];
+            if (table) {
+                frame = set_audio_sample(&packet, job->samples, job->n, frame);
+                encode(&stream, &packet, job->vsync, job->hsync);
+            } else {
+                frame = ref_set_audio_sample(&packet, job->samples, job->n, frame);
+                ref_encode(&stream, &packet, job->vsync, job->hsync);
+            }
+            // Keep the stores
+            __asm__ volatile("" : : "r"(&stream) : "memory");
+        }
+        uint64_t t = bench_now() - t0;
+        best = (t < best) ? t : best;
+    }
+    return (double) best / count;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -n lines    lines per round (default 100000)\n"
+        "  -r rounds   rounds, the fastest counts (default 20)\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 100000;
+    int rounds = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            rounds = strtol(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || count <= 0 || rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int failures = check(count);
+    printf("%d packets compared, %d differ\n", 2 * count, failures);
+
+    // One or two samples a line, like 48 kHz at 640x480
+    job_t *jobs = calloc(count, sizeof(job_t));
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < 4; j++) {
+            jobs[i].samples[j].channels[0] = rand();
+            jobs[i].samples[j].channels[1] = rand();
+        }
+        jobs[i].n = 1 + (i % 3 == 0);
+        jobs[i].vsync = (i % 525) < 2;
+        jobs[i].hsync = false;
+    }
+
+    double before = run(jobs, count, rounds, false);
+    double after = run(jobs, count, rounds, true);
+    printf("per line, %s: before %.1f after %.1f (%.0f%%)\n", BENCH_UNIT, before, after, 100 * after / before);
+
+    free(jobs);
+    return failures ? 1 : 0;
+}
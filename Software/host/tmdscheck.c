@@ -0,0 +1,147 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// The TMDS table generator of libdvi, tmds_table_from_levels(), against the
+// tables it replaces (TMDS_TABLE_PER_CHANNEL).
+//
+// The identity levels, i * 4, have to give back tmds_table.h, and the table
+// printed by "tmds_table_gen.py doubled" when it is given with -p. Every even
+// level has to give a DC balanced pair of symbols that decode to the level
+// and the level + 1, which is what color.c relies on for other levels.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmds_encode.h"
+
+#define TABLE_SIZE 64
+
+static const uint32_t tmds_table[TABLE_SIZE] = {
+#include "tmds_table.h"
+};
+
+// The 8 data bits of a TMDS symbol, as a sink decodes them
+static uint32_t tmds_decode(uint32_t sym)
+{
+    uint32_t q = (sym & 0x200) ? sym ^ 0xff : sym;
+    uint32_t d = q & 1;
+    for (int i = 1; i < 8; i++) {
+        uint32_t bit = ((q >> i) ^ (q >> (i - 1))) & 1;
+        d |= ((q & 0x100) ? bit : bit ^ 1) << i;
+    }
+    return d;
+}
+
+static int compare(const char *name, const uint32_t *ref, const uint32_t *out, int count)
+{
+    int differ = 0;
+    for (int i = 0; i < count; i++) {
+        if (ref[i] != out[i]) {
+            if (!differ) {
+                fprintf(stderr, "%s: level %d is 0x%05x, expected 0x%05x\n", name, i * 4, out[i], ref[i]);
+            }
+            differ++;
+        }
+    }
+    printf("%s: %d of %d entries differ\n", name, differ, count);
+    return differ;
+}
+
+// The lines of "tmds_table_gen.py doubled", 0x7fd00u, one per entry
+static int read_table(const char *path, uint32_t *table)
+{
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    int count = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int v;
+        if (sscanf(line, "0x%xu,", &v) != 1) {
+            continue;
+        }
+        if (count == TABLE_SIZE) {
+            count++;
+            break;
+        }
+        table[count++] = v;
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    return count;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -p file     output of tmds_table_gen.py doubled, - for stdin\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *py_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        switch (opt) {
+        case 'p':
+            py_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    uint8_t levels[TABLE_SIZE];
+    uint32_t out[TABLE_SIZE];
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        levels[i] = i * 4;
+    }
+    tmds_table_from_levels(out, levels, TABLE_SIZE);
+    failures += compare("tmds_table.h", tmds_table, out, TABLE_SIZE);
+
+    if (py_path) {
+        uint32_t py[TABLE_SIZE];
+        int count = read_table(py_path, py);
+        if (count != TABLE_SIZE) {
+            fprintf(stderr, "%s: %d entries, expected %d\n", py_path, count, TABLE_SIZE);
+            failures++;
+        } else {
+            failures += compare("tmds_table_gen.py", py, out, TABLE_SIZE);
+        }
+    }
+
+    // All 128 pairs, like the 7 bit tables of rgb888.c
+    int unbalanced = 0;
+    for (int x = 0; x < 256; x += 2) {
+        uint8_t level = x;
+        uint32_t pair;
+        tmds_table_from_levels(&pair, &level, 1);
+        uint32_t sym0 = pair & 0x3ff;
+        uint32_t sym1 = pair >> 10;
+        if (__builtin_popcount(sym0) + __builtin_popcount(sym1) != 10 ||
+            tmds_decode(sym0) != (uint32_t) x || tmds_decode(sym1) != (uint32_t) x + 1) {
+            unbalanced++;
+        }
+    }
+    printf("even levels: %d of 128 pairs unbalanced or wrong\n", unbalanced);
+    failures += unbalanced;
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+#include "vi_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define VI_TRACE_MAGIC   "N64VITRC"
+#define VI_TRACE_VERSION 1
+
+static bool read_u32(FILE *f, uint32_t *value)
+{
+    uint8_t b[4];
+    if (fread(b, 1, sizeof(b), f) != sizeof(b)) {
+        return false;
+    }
+    *value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+    return true;
+}
+
+// LEB128, false at the end of the file
+static bool read_varint(FILE *f, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(f);
+        if (c == EOF) {
+            return false;
+        }
+        *value |= (uint64_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool vi_trace_load(vi_trace_t *trace, FILE *f)
+{
+    char magic[8];
+    uint32_t version;
+    memset(trace, 0, sizeof(*trace));
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+        memcmp(magic, VI_TRACE_MAGIC, sizeof(magic)) != 0 ||
+        !read_u32(f, &version) || version != VI_TRACE_VERSION ||
+        !read_u32(f, &trace->tick_hz) || trace->tick_hz == 0) {
+        return false;
+    }
+
+    size_t capacity = 0;
+    bool first = true;
+    uint64_t count;
+    while (read_varint(f, &count)) {
+        uint64_t interval;
+        uint32_t word;
+        if (count == 0 || !read_varint(f, &interval) || !read_u32(f, &word)) {
+            vi_trace_free(trace);
+            return false;
+        }
+
+        if (trace->count + count > capacity) {
+            capacity = 2 * (trace->count + count);
+            uint32_t *words = realloc(trace->words, capacity * sizeof(uint32_t));
+            if (words == NULL) {
+                vi_trace_free(trace);
+                return false;
+            }
+            trace->words = words;
+        }
+
+        for (uint64_t i = 0; i < count; i++) {
+            trace->words[trace->count++] = word;
+        }
+
+        // The interval of the very first word is from before the trace
+        trace->ticks += interval * (first ? count - 1 : count);
+        first = false;
+    }
+
+    return trace->count != 0;
+}
+
+void vi_trace_free(vi_trace_t *trace)
+{
+    free(trace->words);
+    trace->words = NULL;
+    trace->count = 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file vi_trace.h
+ * @brief Recorded VI bus traces, as written by scripts/vitrace.
+ *
+ * A trace holds the words the n64 PIO program pushes, run length encoded,
+ * with the time from each word to the next. See scripts/vitrace for the
+ * file format.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @struct vi_trace
+ * @brief A trace, expanded to one word per VI word.
+ */
+typedef struct vi_trace {
+    uint32_t *words;  ///< The VI words.
+    size_t count;     ///< Number of words.
+    uint64_t ticks;   ///< Time from the first to the last word.
+    uint32_t tick_hz; ///< Ticks per second.
+} vi_trace_t;
+
+/**
+ * @brief Read and expand a trace.
+ * @param trace The trace to fill in.
+ * @param f The file, positioned at the start of the trace.
+ * @return true on success, false if the file is not a valid trace.
+ */
+bool vi_trace_load(vi_trace_t *trace, FILE *f);
+
+/**
+ * @brief Free the words of a trace.
+ * @param trace The trace.
+ */
+void vi_trace_free(vi_trace_t *trace);
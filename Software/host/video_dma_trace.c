@@ -0,0 +1,69 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// video_dma.h on the host: the capture ring is a recorded trace, handed out
+// in runs of the same length as the ring. Instead of waiting for more words
+// at the end of the trace, video_dma_wait() jumps back to the replay loop.
+
+#include "video_dma_trace.h"
+
+#include "pico/stdlib.h"
+#include "hardware/interp.h"
+#include "hardware/structs/systick.h"
+
+video_dma_state_t g_video_dma;
+
+// Core 0 hardware used by the capture code
+systick_hw_t host_systick_hw;
+interp_hw_t host_interp_hw[2];
+
+static struct {
+    const uint32_t *start;
+    const uint32_t *end;
+    uint32_t run_words;
+    jmp_buf *at_end;
+    video_dma_stats_t stats;
+} state;
+
+void video_dma_trace_start(const vi_trace_t *trace, uint32_t run_words, jmp_buf *at_end)
+{
+    state.start = trace->words;
+    state.end = trace->words + trace->count;
+    state.run_words = run_words;
+    state.at_end = at_end;
+    g_video_dma.read = trace->words;
+    g_video_dma.limit = trace->words;
+}
+
+size_t video_dma_trace_consumed(void)
+{
+    return g_video_dma.read - state.start;
+}
+
+void video_dma_wait(void)
+{
+    size_t left = state.end - g_video_dma.read;
+    if (left == 0) {
+        longjmp(*state.at_end, 1);
+    }
+    g_video_dma.limit = g_video_dma.read + MIN(left, state.run_words);
+}
+
+void video_dma_resync(void)
+{
+    // Nothing goes stale while the replay is busy elsewhere
+}
+
+void video_dma_frame_end(uint32_t rows)
+{
+    state.stats.frames++;
+    state.stats.rows = rows;
+}
+
+const video_dma_stats_t *video_dma_get_stats(void)
+{
+    return &state.stats;
+}
@@ -0,0 +1,34 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+/**
+ * @file video_dma_trace.h
+ * @brief A recorded trace as the word source of video_dma.h.
+ *
+ * Linked instead of video_dma.c, so n64_capture.c runs unchanged on the host.
+ */
+
+#pragma once
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "video_dma.h"
+#include "vi_trace.h"
+
+/**
+ * @brief Start handing out the words of a trace.
+ * @param trace The trace.
+ * @param run_words The longest run handed out at once, like the ring size.
+ * @param at_end Jumped to when the capture waits for words past the end.
+ */
+void video_dma_trace_start(const vi_trace_t *trace, uint32_t run_words, jmp_buf *at_end);
+
+/**
+ * @brief Get the number of words consumed so far.
+ * @return The number of words.
+ */
+size_t video_dma_trace_consumed(void);
@@ -0,0 +1,363 @@
+/**
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2023 Konrad Beckmann
+ */
+
+// Replay a recorded VI trace through the firmware capture code on the host.
+//
+// Every captured frame can be written out as a PPM, and the capture speed is
+// reported in VI words per second, next to the rate the trace was recorded
+// at. Crop and PAL detection follow main.c.
+
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "framebuf.h"
+#include "n64_capture.h"
+#include "dedither.h"
+#include "autocrop.h"
+#include "palette.h"
+
+#include "vi_trace.h"
+#include "video_dma_trace.h"
+
+#if VIDEO_CAPTURE_PACKED
+#error "Traces hold the words of the n64 program, set VIDEO_CAPTURE_PACKED to 0"
+#endif
+
+#define IN_RANGE(__x, __low, __high) (((__x) >= (__low)) && ((__x) <= (__high)))
+#define IN_TOLERANCE(__x, __value, __tolerance) IN_RANGE(__x, (__value - __tolerance), (__value + __tolerance))
+
+// Lines output for NTSC, and for PAL without PAL_50HZ
+#define NTSC_FRAME_HEIGHT 240
+
+config_t g_config = {
+    .dvi_color_mode = DVI_RGB_555,
+};
+
+// Lines captured in the current frame
+static uint32_t capture_lines;
+
+#if FRAMEBUF_BPP == 16
+// With -d, dedither_line() runs here on each captured line instead of in the
+// capture loop, to be timed on its own
+static bool dedither;
+static double dedither_seconds;
+static uint32_t dedither_lines;
+#endif
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#if FRAMEBUF_RING
+// Only a few lines are kept, they are collected here as they are captured
+static framebuf_pixel_t ring_lines[FRAME_HEIGHT][FRAMEBUF_PLANES * FRAME_WIDTH];
+#endif
+
+static void capture_line(uint32_t lines)
+{
+    capture_lines = lines;
+#if FRAMEBUF_BPP == 16
+    if (dedither) {
+        double t0 = now_seconds();
+        dedither_line(framebuf_line(framebuf_get_front(), lines - 1), lines > 1);
+        dedither_seconds += now_seconds() - t0;
+        dedither_lines++;
+    }
+#endif
+#if FRAMEBUF_RING
+    if (lines <= FRAME_HEIGHT) {
+        memcpy(ring_lines[lines - 1], framebuf_line(framebuf_get_front(), lines - 1), sizeof(ring_lines[0]));
+    }
+#endif
+}
+
+static void capture_frame_start(uint32_t *first_line, uint32_t *line_step)
+{
+    (void) first_line;
+    (void) line_step;
+    capture_lines = 0;
+#if FRAMEBUF_PALETTE
+    palette_frame_start();
+#endif
+}
+
+static void capture_frame_end(uint32_t rows)
+{
+    (void) rows;
+#if FRAMEBUF_PALETTE
+    palette_frame_end();
+#endif
+}
+
+#if FRAMEBUF_PALETTE
+// There is no SysTick here, so the whole palette is built on the first skipped row
+static void capture_row_skipped(void)
+{
+    palette_build(PALETTE_BUILD_CYCLES);
+}
+#endif
+
+static const n64_capture_callbacks_t capture_callbacks = {
+    .frame_start = capture_frame_start,
+    .line = capture_line,
+    .frame_end = capture_frame_end,
+#if FRAMEBUF_PALETTE
+    .row_skipped = capture_row_skipped,
+#endif
+};
+
+// Write the frame shown by the output, like core 1 would pick it up
+static int write_ppm(const char *prefix, uint32_t frame, uint32_t height)
+{
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%04u.ppm", prefix, frame);
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    fprintf(f, "P6\n%d %u\n255\n", FRAME_WIDTH, height);
+    for (uint32_t y = 0; y < height; y++) {
+#if FRAMEBUF_RING
+        const framebuf_pixel_t *line = ring_lines[y];
+#else
+        const framebuf_pixel_t *line = framebuf_get_scanline(y);
+#endif
+#if FRAMEBUF_PALETTE
+        const palette_color_t *colors = palette_get_colors(palette_get_set(line));
+#endif
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            uint32_t p = line[x];
+            uint8_t rgb[3];
+#if FRAMEBUF_BPP == 32
+            rgb[0] = (p >> 9) * 255 / 127;
+            rgb[1] = ((p >> 1) & 0x7f) * 255 / 127;
+            rgb[2] = (line[x + FRAMEBUF_PLANE_BLUE] >> 9) * 255 / 127;
+#elif FRAMEBUF_PALETTE
+            rgb[0] = colors[p].r * 255 / 127;
+            rgb[1] = colors[p].g * 255 / 127;
+            rgb[2] = colors[p].b * 255 / 127;
+#elif FRAMEBUF_BPP == 8
+            rgb[0] = ((p >> 5) & 0x7) * 255 / 7;
+            rgb[1] = ((p >> 2) & 0x7) * 255 / 7;
+            rgb[2] = (p & 0x3) * 255 / 3;
+#else
+            rgb[0] = ((p >> 11) & 0x1f) * 255 / 31;
+            rgb[1] = ((p >> 5) & 0x3f) * 255 / 63;
+            rgb[2] = (p & 0x1f) * 255 / 31;
+#endif
+            fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// The trace, unpacked through gzip when it ends in .gz like vitrace writes
+static FILE *open_trace(const char *filename, bool *gzipped)
+{
+    size_t len = strlen(filename);
+    *gzipped = false;
+    if (strcmp(filename, "-") == 0) {
+        return stdin;
+    }
+    if (len < 3 || strcmp(filename + len - 3, ".gz") != 0) {
+        return fopen(filename, "rb");
+    }
+
+    // Quoted for the shell, a ' becomes '\''
+    char *command = malloc(sizeof("gzip -dc ''") + 4 * len);
+    char *p = command + sprintf(command, "gzip -dc '");
+    for (const char *c = filename; *c; c++) {
+        if (*c == '\'') {
+            p += sprintf(p, "'\\''");
+        } else {
+            *p++ = *c;
+        }
+    }
+    strcpy(p, "'");
+
+    FILE *f = popen(command, "r");
+    free(command);
+    *gzipped = (f != NULL);
+    return f;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] trace\n"
+        "  trace      a file from vitrace, .gz ones are unpacked, - for stdin\n"
+        "  -o prefix  write every frame to <prefix>NNNN.ppm\n"
+        "  -n frames  stop after this many frames\n"
+        "  -r words   longest run of words handed out at once (default %u)\n"
+        "  -g         RGB565 output, green with 5 bits (default RGB555)\n"
+        "  -d         dedither\n"
+        "  -a         auto crop\n",
+        name, (unsigned) VIDEO_DMA_RING_WORDS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *prefix = NULL;
+    uint32_t max_frames = UINT32_MAX;
+    uint32_t run_words = VIDEO_DMA_RING_WORDS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:r:gda")) != -1) {
+        switch (opt) {
+        case 'o':
+            prefix = optarg;
+            break;
+        case 'n':
+            max_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            run_words = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            g_config.dvi_color_mode = DVI_RGB_565;
+            break;
+        case 'd':
+#if FRAMEBUF_BPP == 16
+            dedither = true;
+#endif
+            break;
+        case 'a':
+            g_config.autocrop = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || run_words == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool gzipped = false;
+    FILE *f = open_trace(argv[optind], &gzipped);
+    if (f == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    static vi_trace_t trace;
+    bool loaded = vi_trace_load(&trace, f);
+    if (gzipped) {
+        loaded = (pclose(f) == 0) && loaded;
+    } else if (f != stdin) {
+        fclose(f);
+    }
+    if (!loaded) {
+        fprintf(stderr, "%s: not a VI trace\n", argv[optind]);
+        return 1;
+    }
+
+    framebuf_init();
+#if FRAMEBUF_PALETTE
+    palette_init();
+#endif
+    framebuf_fill(0);
+    n64_capture_init(&capture_callbacks);
+
+    static jmp_buf at_end;
+    video_dma_trace_start(&trace, run_words, &at_end);
+
+    // Only touched between frames, but kept out of registers for the longjmp
+    static uint32_t frames;
+    static size_t words;
+    static double capture_seconds;
+    static uint64_t rows;
+    static uint32_t crop_x = DEFAULT_CROP_X_PAL;
+    static uint32_t crop_y = DEFAULT_CROP_Y_PAL;
+    static uint32_t frame_height = NTSC_FRAME_HEIGHT;
+
+    if (setjmp(at_end) == 0) {
+        while (frames < max_frames) {
+            video_dma_resync();
+
+            double t0 = now_seconds();
+#if FRAMEBUF_BPP == 16
+            double dedither0 = dedither_seconds;
+#endif
+            uint32_t row = n64_capture_frame(crop_x, crop_y, frame_height);
+            capture_seconds += now_seconds() - t0;
+#if FRAMEBUF_BPP == 16
+            // Not the filter, timed on its own
+            capture_seconds -= dedither_seconds - dedither0;
+#endif
+            words = video_dma_trace_consumed();
+            rows += row;
+
+            // The new frame is picked up at the start of the next output frame
+            framebuf_get_scanline(0);
+            if (prefix != NULL && write_ppm(prefix, frames, frame_height) != 0) {
+                return 1;
+            }
+            frames++;
+
+            bool pal = IN_TOLERANCE(row, ROWS_PAL, ROWS_TOLERANCE);
+            if (pal) {
+                crop_x = DEFAULT_CROP_X_PAL;
+#if PAL_50HZ
+                crop_y = DEFAULT_CROP_Y_PAL_50HZ;
+#else
+                crop_y = DEFAULT_CROP_Y_PAL;
+#endif
+            } else {
+                crop_x = DEFAULT_CROP_X_NTSC;
+                crop_y = DEFAULT_CROP_Y_NTSC;
+            }
+            autocrop_frame_end(pal, frame_height, &crop_x, &crop_y);
+
+            // Like video_mode_update_standard(), without waiting for a few frames
+            frame_height = (pal && PAL_50HZ) ? FRAME_HEIGHT : NTSC_FRAME_HEIGHT;
+        }
+    }
+
+    double trace_seconds = (double) trace.ticks / trace.tick_hz;
+    double trace_rate = (trace_seconds > 0) ? trace.count / trace_seconds : 0;
+    double rate = (capture_seconds > 0) ? words / capture_seconds : 0;
+
+    printf("frames         %u\n", frames);
+    printf("last rows      %u\n", n64_capture_get_stats()->rows);
+    printf("last lines     %u\n", capture_lines);
+    printf("crop           %u %u\n", g_autocrop.crop_x, g_autocrop.crop_y);
+#if FRAMEBUF_PALETTE
+    const palette_stats_t *palette_stats = palette_get_stats();
+    printf("palette        %u colors, %u entries\n", palette_stats->colors, palette_stats->entries);
+    printf("palette error  %u, %u with RGB332 (mean squared)\n", palette_stats->error, palette_stats->error_332);
+#endif
+    printf("words          %zu of %zu in whole frames\n", words, trace.count);
+    printf("capture        %.3f s\n", capture_seconds);
+    printf("throughput     %.1f Mwords/s\n", rate * 1e-6);
+    if (trace_rate > 0) {
+        printf("recorded at    %.1f Mwords/s (%.1fx real time)\n", trace_rate * 1e-6, rate / trace_rate);
+    }
+#if FRAMEBUF_BPP == 16
+    if (dedither_lines > 0 && trace_rate > 0 && rows > 0) {
+        // Every second VI row is captured, the line budget is two rows
+        double line_seconds = 2 * words / trace_rate / rows;
+        double dedither_line_seconds = dedither_seconds / dedither_lines;
+        printf("dedither       %.0f ns/line, %.2f%% of the %.1f us per captured line\n",
+               dedither_line_seconds * 1e9, 100 * dedither_line_seconds / line_seconds, line_seconds * 1e6);
+    }
+#endif
+
+    vi_trace_free(&trace);
+    return 0;
+}
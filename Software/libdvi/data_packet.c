@@ -93,6 +93,76 @@ uint16_t __not_in_flash_func(TERC4Syms_)[16] = {
 
 uint32_t inline makeTERC4x2Char(int i) { return TERC4Syms_[i] | (TERC4Syms_[i] << 10); }
 uint32_t inline makeTERC4x2Char_2(int i0, int i1) { return TERC4Syms_[i0] | (TERC4Syms_[i1] << 10); }
+
+// Both symbols of a word at once, indexed by (i1 << 4) | i0. Built statically with
+// for (int i = 0; i < 256; ++i) { TERC4x2Syms_[i] = makeTERC4x2Char_2(i & 15, i >> 4); }
+const uint32_t __not_in_flash_func(TERC4x2Syms_)[256] = {
+    0xa729c, 0xa7263, 0xa72e4, 0xa72e2, 0xa7171, 0xa711e, 0xa718e, 0xa713c,
+    0xa72cc, 0xa7139, 0xa719c, 0xa72c6, 0xa728e, 0xa7271, 0xa7163, 0xa72c3,
+    0x98e9c, 0x98e63, 0x98ee4, 0x98ee2, 0x98d71, 0x98d1e, 0x98d8e, 0x98d3c,
+    0x98ecc, 0x98d39, 0x98d9c, 0x98ec6, 0x98e8e, 0x98e71, 0x98d63, 0x98ec3,
+    0xb929c, 0xb9263, 0xb92e4, 0xb92e2, 0xb9171, 0xb911e, 0xb918e, 0xb913c,
+    0xb92cc, 0xb9139, 0xb919c, 0xb92c6, 0xb928e, 0xb9271, 0xb9163, 0xb92c3,
+    0xb8a9c, 0xb8a63, 0xb8ae4, 0xb8ae2, 0xb8971, 0xb891e, 0xb898e, 0xb893c,
+    0xb8acc, 0xb8939, 0xb899c, 0xb8ac6, 0xb8a8e, 0xb8a71, 0xb8963, 0xb8ac3,
+    0x5c69c, 0x5c663, 0x5c6e4, 0x5c6e2, 0x5c571, 0x5c51e, 0x5c58e, 0x5c53c,
+    0x5c6cc, 0x5c539, 0x5c59c, 0x5c6c6, 0x5c68e, 0x5c671, 0x5c563, 0x5c6c3,
+    0x47a9c, 0x47a63, 0x47ae4, 0x47ae2, 0x47971, 0x4791e, 0x4798e, 0x4793c,
+    0x47acc, 0x47939, 0x4799c, 0x47ac6, 0x47a8e, 0x47a71, 0x47963, 0x47ac3,
+    0x63a9c, 0x63a63, 0x63ae4, 0x63ae2, 0x63971, 0x6391e, 0x6398e, 0x6393c,
+    0x63acc, 0x63939, 0x6399c, 0x63ac6, 0x63a8e, 0x63a71, 0x63963, 0x63ac3,
+    0x4f29c, 0x4f263, 0x4f2e4, 0x4f2e2, 0x4f171, 0x4f11e, 0x4f18e, 0x4f13c,
+    0x4f2cc, 0x4f139, 0x4f19c, 0x4f2c6, 0x4f28e, 0x4f271, 0x4f163, 0x4f2c3,
+    0xb329c, 0xb3263, 0xb32e4, 0xb32e2, 0xb3171, 0xb311e, 0xb318e, 0xb313c,
+    0xb32cc, 0xb3139, 0xb319c, 0xb32c6, 0xb328e, 0xb3271, 0xb3163, 0xb32c3,
+    0x4e69c, 0x4e663, 0x4e6e4, 0x4e6e2, 0x4e571, 0x4e51e, 0x4e58e, 0x4e53c,
+    0x4e6cc, 0x4e539, 0x4e59c, 0x4e6c6, 0x4e68e, 0x4e671, 0x4e563, 0x4e6c3,
+    0x6729c, 0x67263, 0x672e4, 0x672e2, 0x67171, 0x6711e, 0x6718e, 0x6713c,
+    0x672cc, 0x67139, 0x6719c, 0x672c6, 0x6728e, 0x67271, 0x67163, 0x672c3,
+    0xb1a9c, 0xb1a63, 0xb1ae4, 0xb1ae2, 0xb1971, 0xb191e, 0xb198e, 0xb193c,
+    0xb1acc, 0xb1939, 0xb199c, 0xb1ac6, 0xb1a8e, 0xb1a71, 0xb1963, 0xb1ac3,
+    0xa3a9c, 0xa3a63, 0xa3ae4, 0xa3ae2, 0xa3971, 0xa391e, 0xa398e, 0xa393c,
+    0xa3acc, 0xa3939, 0xa399c, 0xa3ac6, 0xa3a8e, 0xa3a71, 0xa3963, 0xa3ac3,
+    0x9c69c, 0x9c663, 0x9c6e4, 0x9c6e2, 0x9c571, 0x9c51e, 0x9c58e, 0x9c53c,
+    0x9c6cc, 0x9c539, 0x9c59c, 0x9c6c6, 0x9c68e, 0x9c671, 0x9c563, 0x9c6c3,
+    0x58e9c, 0x58e63, 0x58ee4, 0x58ee2, 0x58d71, 0x58d1e, 0x58d8e, 0x58d3c,
+    0x58ecc, 0x58d39, 0x58d9c, 0x58ec6, 0x58e8e, 0x58e71, 0x58d63, 0x58ec3,
+    0xb0e9c, 0xb0e63, 0xb0ee4, 0xb0ee2, 0xb0d71, 0xb0d1e, 0xb0d8e, 0xb0d3c,
+    0xb0ecc, 0xb0d39, 0xb0d9c, 0xb0ec6, 0xb0e8e, 0xb0e71, 0xb0d63, 0xb0ec3,
+};
+
+// The four words of a header byte, indexed by hv and a nibble of the byte, with bit 3 of
+// every symbol set. Built statically with
+// for (int hv = 0; hv < 4; ++hv) for (int i = 0; i < 16; ++i) {
+//     TERC4HeaderSyms_[hv][i][0] = makeTERC4x2Char_2(((i << 2) & 4) | hv | 8, ((i << 1) & 4) | hv | 8);
+//     TERC4HeaderSyms_[hv][i][1] = makeTERC4x2Char_2((i & 4) | hv | 8, ((i >> 1) & 4) | hv | 8); }
+const uint32_t __not_in_flash_func(TERC4HeaderSyms_)[4][16][2] = {
+    {
+        { 0xb32cc, 0xb32cc }, { 0xb328e, 0xb32cc }, { 0xa3acc, 0xb32cc }, { 0xa3a8e, 0xb32cc },
+        { 0xb32cc, 0xb328e }, { 0xb328e, 0xb328e }, { 0xa3acc, 0xb328e }, { 0xa3a8e, 0xb328e },
+        { 0xb32cc, 0xa3acc }, { 0xb328e, 0xa3acc }, { 0xa3acc, 0xa3acc }, { 0xa3a8e, 0xa3acc },
+        { 0xb32cc, 0xa3a8e }, { 0xb328e, 0xa3a8e }, { 0xa3acc, 0xa3a8e }, { 0xa3a8e, 0xa3a8e },
+    },
+    {
+        { 0x4e539, 0x4e539 }, { 0x4e671, 0x4e539 }, { 0x9c539, 0x4e539 }, { 0x9c671, 0x4e539 },
+        { 0x4e539, 0x4e671 }, { 0x4e671, 0x4e671 }, { 0x9c539, 0x4e671 }, { 0x9c671, 0x4e671 },
+        { 0x4e539, 0x9c539 }, { 0x4e671, 0x9c539 }, { 0x9c539, 0x9c539 }, { 0x9c671, 0x9c539 },
+        { 0x4e539, 0x9c671 }, { 0x4e671, 0x9c671 }, { 0x9c539, 0x9c671 }, { 0x9c671, 0x9c671 },
+    },
+    {
+        { 0x6719c, 0x6719c }, { 0x67163, 0x6719c }, { 0x58d9c, 0x6719c }, { 0x58d63, 0x6719c },
+        { 0x6719c, 0x67163 }, { 0x67163, 0x67163 }, { 0x58d9c, 0x67163 }, { 0x58d63, 0x67163 },
+        { 0x6719c, 0x58d9c }, { 0x67163, 0x58d9c }, { 0x58d9c, 0x58d9c }, { 0x58d63, 0x58d9c },
+        { 0x6719c, 0x58d63 }, { 0x67163, 0x58d63 }, { 0x58d9c, 0x58d63 }, { 0x58d63, 0x58d63 },
+    },
+    {
+        { 0xb1ac6, 0xb1ac6 }, { 0xb1ac3, 0xb1ac6 }, { 0xb0ec6, 0xb1ac6 }, { 0xb0ec3, 0xb1ac6 },
+        { 0xb1ac6, 0xb1ac3 }, { 0xb1ac3, 0xb1ac3 }, { 0xb0ec6, 0xb1ac3 }, { 0xb0ec3, 0xb1ac3 },
+        { 0xb1ac6, 0xb0ec6 }, { 0xb1ac3, 0xb0ec6 }, { 0xb0ec6, 0xb0ec6 }, { 0xb0ec3, 0xb0ec6 },
+        { 0xb1ac6, 0xb0ec3 }, { 0xb1ac3, 0xb0ec3 }, { 0xb0ec6, 0xb0ec3 }, { 0xb0ec3, 0xb0ec3 },
+    },
+};
+
 #define TERC4_0x2CharSym_ 0x000A729C // Build time generated -> makeTERC4x2Char(0);
 #define dataGaurdbandSym_ 0x0004CD33 // Build time generated -> 0b0100110011'0100110011;
 uint32_t __not_in_flash_func(defaultDataPacket12_)[N_DATA_ISLAND_WORDS] = {
@@ -164,18 +234,23 @@ void __not_in_flash_func(compute_info_frame_checkSum)(data_packet_t *data_packet
 }
 
 void __not_in_flash_func(encode_header)(const data_packet_t *data_packet, uint32_t *dst, int hv, bool firstPacket) {
-    int hv1 = hv | 8;
-    if (!firstPacket) { 
-        hv = hv1;
-    }
+    // Two table words per nibble
+    const uint32_t (*syms)[2] = TERC4HeaderSyms_[hv & 3];
     for (int i = 0; i < 4; ++i) {
         uint8_t h = data_packet->header[i];
-        dst[0] = makeTERC4x2Char_2(((h << 2) & 4) | hv,  ((h << 1) & 4) | hv1);
-        dst[1] = makeTERC4x2Char_2((h & 4) | hv1,        ((h >> 1) & 4) | hv1);
-        dst[2] = makeTERC4x2Char_2(((h >> 2) & 4) | hv1, ((h >> 3) & 4) | hv1);
-        dst[3] = makeTERC4x2Char_2(((h >> 4) & 4) | hv1, ((h >> 5) & 4) | hv1);
+        const uint32_t *lo = syms[h & 15];
+        const uint32_t *hi = syms[h >> 4];
+        dst[0] = lo[0];
+        dst[1] = lo[1];
+        dst[2] = hi[0];
+        dst[3] = hi[1];
         dst += 4;
-        hv = hv1;
+    }
+
+    // Only the very first symbol of a packet has bit 3 clear
+    if (firstPacket) {
+        uint8_t h = data_packet->header[0];
+        dst[-16] = makeTERC4x2Char_2(((h << 2) & 4) | hv, ((h << 1) & 4) | hv | 8);
     }
 }
 
@@ -189,10 +264,16 @@ void __not_in_flash_func(encode_subpacket)(const data_packet_t *data_packet, uin
         v = v ^ t ^ (t << 14);
         // 01234567 89abcdef ghijklmn opqrstuv
         // 08go4cks 19hp5dlt 2aiq6emu 3bjr7fnv
-        dst1[0] = makeTERC4x2Char_2((v >> 0) & 15,  (v >> 16) & 15);
-        dst1[1] = makeTERC4x2Char_2((v >> 4) & 15,  (v >> 20) & 15);
-        dst2[0] = makeTERC4x2Char_2((v >> 8) & 15,  (v >> 24) & 15);
-        dst2[1] = makeTERC4x2Char_2((v >> 12) & 15, (v >> 28) & 15);
+        // Each word is nibble n and n + 16 of v, so pair them up in bytes:
+        // nibbles 0 and 16, 8 and 24 in even, 4 and 20, 12 and 28 in odd
+        uint32_t even = v & 0x0f0f0f0f;
+        uint32_t odd = (v >> 4) & 0x0f0f0f0f;
+        even |= even >> 12;
+        odd |= odd >> 12;
+        dst1[0] = TERC4x2Syms_[even & 0xff];
+        dst1[1] = TERC4x2Syms_[odd & 0xff];
+        dst2[0] = TERC4x2Syms_[(even >> 8) & 0xff];
+        dst2[1] = TERC4x2Syms_[(odd >> 8) & 0xff];
         dst1 += 2;
         dst2 += 2;
     }
@@ -227,8 +308,15 @@ int  __not_in_flash_func(set_audio_sample)(data_packet_t *data_packet, const aud
         d[4] = r;
         d[5] = r >> 8;
 
-        bool pl = compute8_3(d[1], d[2], vuc);
-        bool pr = compute8_3(d[4], d[5], vuc);
+        // Even parity over the sample and vuc, folded down to a nibble
+        uint32_t pl = (uint16_t) l ^ vuc;
+        uint32_t pr = (uint16_t) r ^ vuc;
+        pl ^= pl >> 8;
+        pr ^= pr >> 8;
+        pl ^= pl >> 4;
+        pr ^= pr >> 4;
+        pl = (0x6996 >> (pl & 15)) & 1;
+        pr = (0x6996 >> (pr & 15)) & 1;
         d[6] = (vuc << 0) | (pl << 3) | (vuc << 4) | (pr << 7);
         compute_subpacket_parity(data_packet, i);
         ++p;
@@ -320,14 +408,14 @@ void set_AVI_info_frame(data_packet_t *data_packet, scan_info s, pixel_format y,
 
 void __not_in_flash_func(encode)(data_island_stream_t *dst, const data_packet_t *packet, bool vsync, bool hsync) {
     int hv = (vsync ? 2 : 0) | (hsync ? 1 : 0);
-    dst->data[0][0] = makeTERC4x2Char(0b1100 | hv);
+    dst->data[0][0] = TERC4x2Syms_[(0b1100 | hv) * 0x11];
     dst->data[1][0] = dataGaurdbandSym_;
     dst->data[2][0] = dataGaurdbandSym_;
 
     encode_header(packet, &dst->data[0][1], hv, true);
     encode_subpacket(packet, &dst->data[1][1], &dst->data[2][1]);
 
-    dst->data[0][N_DATA_ISLAND_WORDS - 1] = makeTERC4x2Char(0b1100 | hv);
+    dst->data[0][N_DATA_ISLAND_WORDS - 1] = dst->data[0][0];
     dst->data[1][N_DATA_ISLAND_WORDS - 1] = dataGaurdbandSym_;
     dst->data[2][N_DATA_ISLAND_WORDS - 1] = dataGaurdbandSym_;
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#if DVI_IRQ_STATS
+#include "hardware/structs/systick.h"
+#endif
 
 #include "dvi.h"
 #include "dvi_timing.h"
@@ -18,8 +21,42 @@ static struct dvi_inst *dma_irq_privdata[2];
 static void dvi_dma0_irq();
 static void dvi_dma1_irq();
 
+static void dvi_setup_dma_lists(struct dvi_inst *inst) {
+    dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, true, &inst->dma_list_vblank_sync);
+    dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, false, &inst->dma_list_vblank_nosync);
+    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, (void*)SRAM_BASE, &inst->dma_list_active, false);
+    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, NULL, &inst->dma_list_error, false);
+    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, NULL, &inst->dma_list_active_blank, true);
+}
+
+static void dvi_alloc_tmds_buffers(struct dvi_inst *inst) {
+    for (int i = 0; i < DVI_N_TMDS_BUFFERS; ++i) {
+#if DVI_MONOCHROME_TMDS
+        void *tmdsbuf = malloc(inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
+#else
+        void *tmdsbuf = malloc(TMDS_CHANNELS * inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
+#endif
+        if (!tmdsbuf) {
+            panic("TMDS buffer allocation failed");
+        }
+        queue_add_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
+    }
+}
+
+// Audio packet rates follow the pixel clock and frame length
+static void dvi_update_audio_rates(struct dvi_inst *inst) {
+    uint pixelClock =   dvi_timing_get_pixel_clock(inst->timing);
+    uint nPixPerFrame = dvi_timing_get_pixels_per_frame(inst->timing);
+    uint nPixPerLine =  dvi_timing_get_pixels_per_line(inst->timing);
+    inst->samples_per_frame  = (uint64_t)(inst->audio_freq) * nPixPerFrame / pixelClock;
+    inst->samples_per_line16 = (uint64_t)(inst->audio_freq) * nPixPerLine * 65536 / pixelClock;
+}
+
 void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_colour_queue) {
     inst->dvi_started = false;
+    inst->timing_next = NULL;
+    inst->vertical_repeat = DVI_VERTICAL_REPEAT;
+    inst->vertical_repeat_next = 0;
     inst->timing_state.v_ctr  = 0;
     inst->dvi_frame_count = 0;
     
@@ -40,25 +77,10 @@ void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_col
     queue_init_with_spinlock(&inst->q_colour_valid, sizeof(void*),  8, spinlock_colour_queue);
     queue_init_with_spinlock(&inst->q_colour_free,  sizeof(void*),  8, spinlock_colour_queue);
 
-    dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, true, &inst->dma_list_vblank_sync);
-    dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, false, &inst->dma_list_vblank_nosync);
-    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, (void*)SRAM_BASE, &inst->dma_list_active, false);
-    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, NULL, &inst->dma_list_error, false);
-    dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, NULL, &inst->dma_list_active_blank, true);
-
-    for (int i = 0; i < DVI_N_TMDS_BUFFERS; ++i) {
-#if DVI_MONOCHROME_TMDS
-        void *tmdsbuf = malloc(inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
-#else
-        void *tmdsbuf = malloc(TMDS_CHANNELS * inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
-#endif
-        if (!tmdsbuf) {
-            panic("TMDS buffer allocation failed");
-        }
-        queue_add_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
-    }
+    dvi_setup_dma_lists(inst);
+    dvi_alloc_tmds_buffers(inst);
 
-    set_AVI_info_frame(&inst->avi_info_frame, UNDERSCAN, RGB, ITU601, PIC_ASPECT_RATIO_4_3, SAME_AS_PAR, FULL, _640x480P60);
+    set_AVI_info_frame(&inst->avi_info_frame, UNDERSCAN, RGB, ITU601, PIC_ASPECT_RATIO_4_3, SAME_AS_PAR, FULL, inst->timing->video_code);
 
 }
 
@@ -167,15 +189,86 @@ void dvi_stop(struct dvi_inst *inst) {
     inst->dvi_started = false;
 }
 
+void dvi_set_vertical_timing(struct dvi_inst *inst, const struct dvi_timing *timing) {
+    if (!dvi_timing_same_horizontal(timing, inst->timing)) {
+        panic("Timing differs in more than the vertical direction");
+    }
+    if (timing == inst->timing) {
+        return;
+    }
+
+    // Build the new packet aside, the IRQ may be sending the old one
+    data_packet_t avi_info_frame;
+    set_AVI_info_frame(&avi_info_frame, UNDERSCAN, RGB, ITU601, PIC_ASPECT_RATIO_4_3, SAME_AS_PAR, FULL, timing->video_code);
+    inst->avi_info_frame = avi_info_frame;
+
+    if (inst->dvi_started) {
+        inst->timing_next = timing;
+        while (inst->timing_next) {
+            tight_loop_contents();
+        }
+    } else {
+        inst->timing = timing;
+    }
+
+    dvi_update_audio_rates(inst);
+}
+
+void dvi_set_vertical_repeat(struct dvi_inst *inst, uint repeat) {
+    if (inst->dvi_started) {
+        inst->vertical_repeat_next = repeat;
+    } else {
+        inst->vertical_repeat = repeat;
+    }
+}
+
+void dvi_set_timing(struct dvi_inst *inst, const struct dvi_timing *timing) {
+    if (inst->dvi_started) {
+        panic("DVI must be stopped to change the timing");
+    }
+
+    // Nothing is in flight, so every TMDS buffer is in one of the queues
+    uint32_t *buf;
+    while (queue_try_remove_u32(&inst->q_tmds_valid, &buf)) {
+        free(buf);
+    }
+    while (queue_try_remove_u32(&inst->q_tmds_free, &buf)) {
+        free(buf);
+    }
+    while (queue_try_remove_u32(&inst->q_colour_valid, &buf))
+        ;
+    while (queue_try_remove_u32(&inst->q_colour_free, &buf))
+        ;
+
+    inst->timing = timing;
+    inst->timing_next = NULL;
+    if (inst->vertical_repeat_next) {
+        inst->vertical_repeat = inst->vertical_repeat_next;
+        inst->vertical_repeat_next = 0;
+    }
+    inst->late_scanline_ctr = 0;
+    dvi_timing_state_init(&inst->timing_state);
+
+    dvi_alloc_tmds_buffers(inst);
+    if (inst->data_island_is_enabled) {
+        dvi_enable_data_island(inst);
+    } else {
+        dvi_setup_dma_lists(inst);
+    }
+
+    set_AVI_info_frame(&inst->avi_info_frame, UNDERSCAN, RGB, ITU601, PIC_ASPECT_RATIO_4_3, SAME_AS_PAR, FULL, timing->video_code);
+    dvi_update_audio_rates(inst);
+}
+
 static inline void __dvi_func_x(_dvi_prepare_scanline_8bpp)(struct dvi_inst *inst, uint32_t *scanbuf) {
     uint32_t *tmdsbuf = NULL;
     queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
     uint pixwidth = inst->timing->h_active_pixels;
     uint words_per_channel = pixwidth / DVI_SYMBOLS_PER_WORD;
     // Scanline buffers are half-resolution; the functions take the number of *input* pixels as parameter.
-    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB );
-    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB);
-    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB  );
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB,  0);
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB, 1);
+    tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB,   2);
     queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
 }
 
@@ -184,9 +277,9 @@ static inline void __dvi_func_x(_dvi_prepare_scanline_16bpp)(struct dvi_inst *in
     queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
     uint pixwidth = inst->timing->h_active_pixels;
     uint words_per_channel = pixwidth / DVI_SYMBOLS_PER_WORD;
-    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
-    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
-    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB  );
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB,  0);
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB, 1);
+    tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB,   2);
     queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
 }
 
@@ -197,10 +290,12 @@ void __dvi_func(dvi_scanbuf_main_8bpp)(struct dvi_inst *inst) {
     while (1) {
         uint32_t *scanbuf = NULL;
         queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            return;
+        }
         _dvi_prepare_scanline_8bpp(inst, scanbuf);
         queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
     }
-    __builtin_unreachable();
 }
 
 // Ugh copy/paste but it lets us garbage collect the TMDS stuff that is not being used from .scratch_x
@@ -208,17 +303,76 @@ void __dvi_func(dvi_scanbuf_main_16bpp)(struct dvi_inst *inst) {
     while (1) {
         uint32_t *scanbuf = NULL;
         queue_remove_blocking_u32(&inst->q_colour_valid, &scanbuf);
+        if (!scanbuf) {
+            return;
+        }
         _dvi_prepare_scanline_16bpp(inst, scanbuf);
         queue_add_blocking_u32(&inst->q_colour_free, &scanbuf);
     }
-    __builtin_unreachable();
+}
+
+// Version where each record in q_colour_valid is a whole frame, h_active_pixels / 2
+// pixels per line and a line for every vertical_repeat DVI lines. Lines are found by
+// pointer arithmetic, and the frame is passed back on q_colour_free once encoded.
+// The worker starts a frame a couple of lines before the IRQ does, so a timing or
+// repeat switched to at the start of that frame is already used.
+static inline uint _dvi_frame_height(struct dvi_inst *inst) {
+    const struct dvi_timing *timing = inst->timing_next ? inst->timing_next : inst->timing;
+    uint repeat = inst->vertical_repeat_next ? inst->vertical_repeat_next : inst->vertical_repeat;
+    return timing->v_active_lines / repeat;
+}
+
+void __dvi_func(dvi_framebuf_main_8bpp)(struct dvi_inst *inst) {
+    while (1) {
+        uint8_t *framebuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &framebuf);
+        if (!framebuf) {
+            return;
+        }
+        uint width = inst->timing->h_active_pixels / 2;
+        uint height = _dvi_frame_height(inst);
+        for (uint y = 0; y < height; ++y) {
+            _dvi_prepare_scanline_8bpp(inst, (uint32_t*)&framebuf[y * width]);
+        }
+        queue_add_blocking_u32(&inst->q_colour_free, &framebuf);
+    }
+}
+
+void __dvi_func(dvi_framebuf_main_16bpp)(struct dvi_inst *inst) {
+    while (1) {
+        uint16_t *framebuf = NULL;
+        queue_remove_blocking_u32(&inst->q_colour_valid, &framebuf);
+        if (!framebuf) {
+            return;
+        }
+        uint width = inst->timing->h_active_pixels / 2;
+        uint height = _dvi_frame_height(inst);
+        for (uint y = 0; y < height; ++y) {
+            _dvi_prepare_scanline_16bpp(inst, (uint32_t*)&framebuf[y * width]);
+        }
+        queue_add_blocking_u32(&inst->q_colour_free, &framebuf);
+    }
 }
 
 static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
+#if DVI_IRQ_STATS
+    uint32_t t0 = systick_hw->cvr;
+#endif
     // Every fourth interrupt marks the start of the horizontal active region. We
     // now have until the end of this region to generate DMA blocklist for next
     // scanline.
     dvi_timing_state_advance(inst->timing, &inst->timing_state);
+
+    // Only the vertical timing differs, so this can happen on any line. Do it
+    // when a new frame starts.
+    if (inst->timing_next && inst->timing_state.v_state == DVI_STATE_FRONT_PORCH && inst->timing_state.v_ctr == 0) {
+        inst->timing = inst->timing_next;
+        inst->timing_next = NULL;
+    }
+    if (inst->vertical_repeat_next && inst->timing_state.v_state == DVI_STATE_FRONT_PORCH && inst->timing_state.v_ctr == 0) {
+        inst->vertical_repeat = inst->vertical_repeat_next;
+        inst->vertical_repeat_next = 0;
+    }
     
     // Make sure all three channels have definitely loaded their last block
     // (should be within a few cycles of one another)
@@ -246,6 +400,10 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
     switch (inst->timing_state.v_state) {
         case DVI_STATE_ACTIVE:
         {
+            // Scanline and whether this is the last time it is shown
+            uint repeat = inst->vertical_repeat;
+            uint scanline = inst->timing_state.v_ctr / repeat;
+            bool last_repeat = inst->timing_state.v_ctr - scanline * repeat == repeat - 1;
             bool is_blank_line = false;
             if (inst->timing_state.v_ctr < inst->blank_settings.top || 
                 inst->timing_state.v_ctr >= (inst->timing->v_active_lines - inst->blank_settings.bottom)) {
@@ -253,14 +411,14 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
                 is_blank_line = true;
             } else {
                 if (queue_try_peek_u32(&inst->q_tmds_valid, &tmdsbuf)) {
-                    if (inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1) {
+                    if (last_repeat) {
                         queue_remove_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
                         inst->tmds_buf_release[0] = tmdsbuf;
                     }
                 } else {
                     // No valid scanline was ready (generates solid red scanline)
                     tmdsbuf = NULL;
-                    if (inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1) {
+                    if (last_repeat) {
                         ++inst->late_scanline_ctr;
                     }
                 }
@@ -279,8 +437,8 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
                 dma_list_selected = &inst->dma_list_error;
             }
             
-            if (inst->scanline_callback && inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1) {
-                inst->scanline_callback(inst->timing_state.v_ctr / DVI_VERTICAL_REPEAT);
+            if (inst->scanline_callback && last_repeat) {
+                inst->scanline_callback(scanline);
             }
         }
         break;
@@ -295,9 +453,24 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
     }
     _dvi_load_dma_op(inst->dma_cfg, dma_list_selected);
 
+#if DVI_IRQ_STATS
+    uint32_t t1 = systick_hw->cvr;
+#endif
     if (inst->data_island_is_enabled) {
         dvi_update_data_packet(inst);
     }
+#if DVI_IRQ_STATS
+    // SysTick counts down, 24 bits
+    uint32_t t2 = systick_hw->cvr;
+    inst->irq_max = MAX(inst->irq_max, (t0 - t2) & 0x00ffffff);
+    inst->data_packet_max = MAX(inst->data_packet_max, (t1 - t2) & 0x00ffffff);
+    if (inst->timing_state.v_state == DVI_STATE_SYNC && inst->timing_state.v_ctr == 0) {
+        inst->irq_cycles = inst->irq_max;
+        inst->data_packet_cycles = inst->data_packet_max;
+        inst->irq_max = 0;
+        inst->data_packet_max = 0;
+    }
+#endif
 }
 
 static void __dvi_func(dvi_dma0_irq)() {
@@ -319,6 +492,9 @@ void dvi_audio_init(struct dvi_inst *inst) {
     inst->audio_freq = 0;
     inst->samples_per_frame = 0;
     inst->samples_per_line16 = 0;
+    inst->samples_per_line16_adjust = 0;
+    inst->audio_frame_repeat = 1;
+    inst->audio_frame_repeat_pos = 0;
     inst->left_audio_sample_count = 0;
     inst->audio_sample_pos = 0;
     inst->audio_frame_count = 0;
@@ -378,11 +554,7 @@ void dvi_set_audio_freq(struct dvi_inst *inst, int audio_freq, int cts, int n) {
     inst->audio_freq = audio_freq;
     set_audio_clock_regeneration(&inst->audio_clock_regeneration, cts, n);
     set_audio_info_frame(&inst->audio_info_frame, audio_freq);
-    uint pixelClock =   dvi_timing_get_pixel_clock(inst->timing);
-    uint nPixPerFrame = dvi_timing_get_pixels_per_frame(inst->timing);
-    uint nPixPerLine =  dvi_timing_get_pixels_per_line(inst->timing);
-    inst->samples_per_frame  = (uint64_t)(audio_freq) * nPixPerFrame / pixelClock;
-    inst->samples_per_line16 = (uint64_t)(audio_freq) * nPixPerLine * 65536 / pixelClock;
+    dvi_update_audio_rates(inst);
     dvi_enable_data_island(inst);
 
     // printf("nPixPerFrame: %d\n", nPixPerFrame);
@@ -395,11 +567,15 @@ void dvi_update_audio_freq(struct dvi_inst *inst, int audio_freq, int cts, int n
     inst->audio_freq = audio_freq;
     set_audio_clock_regeneration(&inst->audio_clock_regeneration, cts, n);
     set_audio_info_frame(&inst->audio_info_frame, audio_freq);
-    uint pixelClock =   dvi_timing_get_pixel_clock(inst->timing);
-    uint nPixPerFrame = dvi_timing_get_pixels_per_frame(inst->timing);
-    uint nPixPerLine =  dvi_timing_get_pixels_per_line(inst->timing);
-    inst->samples_per_frame  = (uint64_t)(audio_freq) * nPixPerFrame / pixelClock;
-    inst->samples_per_line16 = (uint64_t)(audio_freq) * nPixPerLine * 65536 / pixelClock;
+    dvi_update_audio_rates(inst);
+}
+
+// Send every frame of the audio DMA ring repeat times, so a source below the
+// rates HDMI allows goes out at repeat times its rate. audio_freq is that
+// output rate. Only for the DMA ring of dvi_audio_sample_dma_set_chan().
+void dvi_set_audio_frame_repeat(struct dvi_inst *inst, int repeat) {
+    inst->audio_frame_repeat = MAX(repeat, 1);
+    inst->audio_frame_repeat_pos = 0;
 }
 
 void dvi_wait_for_valid_line(struct dvi_inst *inst) {
@@ -412,7 +588,7 @@ bool __dvi_func(dvi_update_data_packet_)(struct dvi_inst *inst, data_packet_t *p
         return false;
     }
 
-    inst->audio_sample_pos += inst->samples_per_line16;
+    inst->audio_sample_pos += inst->samples_per_line16 + inst->samples_per_line16_adjust;
     if (inst->timing_state.v_state == DVI_STATE_FRONT_PORCH) {
         if (inst->timing_state.v_ctr == 0) {
             if (inst->dvi_frame_count & 1) {
@@ -441,6 +617,30 @@ bool __dvi_func(dvi_update_data_packet_)(struct dvi_inst *inst, data_packet_t *p
 
         // Utilize the get_read_size to calculate how many words we can read (should always be 4 in practice)
         int read_size = get_read_size(&inst->audio_ring, inst->audio_ring.write == 0);
+        int repeat = inst->audio_frame_repeat;
+        if (repeat > 1) {
+            // Each ring frame goes out repeat times, audio_frame_repeat_pos of
+            // the one at the read pointer have been sent
+            int n = MAX(0, MIN(4, MIN(sample_pos_16, read_size * repeat - inst->audio_frame_repeat_pos)));
+            inst->audio_sample_pos -= n << 16;
+            if (n) {
+                audio_sample_t samples[4];
+                audio_sample_t *audio_sample_ptr = get_read_pointer(&inst->audio_ring);
+                int used = 0;
+                for (int i = 0; i < n; ++i) {
+                    samples[i] = audio_sample_ptr[used];
+                    if (++inst->audio_frame_repeat_pos == repeat) {
+                        inst->audio_frame_repeat_pos = 0;
+                        used++;
+                    }
+                }
+                inst->audio_frame_count = set_audio_sample(packet, samples, n, inst->audio_frame_count);
+                increase_read_pointer(&inst->audio_ring, used);
+
+                return true;
+            }
+            return false;
+        }
         // int read_size = 4;
         int n = MAX(0, MIN(4, MIN(sample_pos_16, read_size)));
         inst->audio_sample_pos -= n << 16;
@@ -20,6 +20,12 @@ struct dvi_inst {
 	const struct dvi_timing *timing;
 	struct dvi_lane_dma_cfg dma_cfg[N_TMDS_LANES];
 	struct dvi_timing_state timing_state;
+	// Switched to at the start of the next frame, see dvi_set_vertical_timing()
+	const struct dvi_timing *volatile timing_next;
+	// Lines each scanline is shown for, DVI_VERTICAL_REPEAT unless changed
+	// with dvi_set_vertical_repeat(). The next one is 0 when there's no change.
+	uint vertical_repeat;
+	volatile uint vertical_repeat_next;
 	struct dvi_serialiser_cfg ser_cfg;
     dvi_blank_t blank_settings;
 	// Called in the DMA IRQ once per scanline -- careful with the run time!
@@ -59,6 +65,11 @@ struct dvi_inst {
     int audio_freq;
     int samples_per_frame;
     int samples_per_line16;
+    // Added to samples_per_line16 every line, to hold an audio DMA ring in step
+    int samples_per_line16_adjust;
+    // Times each frame of the audio DMA ring is sent, for rates too low for HDMI
+    int audio_frame_repeat;
+    int audio_frame_repeat_pos;
     
     bool data_island_is_enabled;
     bool scanline_is_enabled;
@@ -73,6 +84,14 @@ struct dvi_inst {
     int left_audio_sample_count;
     int audio_sample_pos;
     int audio_frame_count;
+
+#if DVI_IRQ_STATS
+    // Slowest in the last frame, and so far in this one, in cycles
+    uint32_t irq_cycles;
+    uint32_t data_packet_cycles;
+    uint32_t irq_max;
+    uint32_t data_packet_max;
+#endif
 };
 
 // Reports DVI status 1: active 0: inactive
@@ -97,16 +116,36 @@ void dvi_start(struct dvi_inst *inst);
 //Stops DVI pairs generations
 void dvi_stop(struct dvi_inst *inst);
 
+// Switch to a timing that only differs in the vertical direction, i.e. the
+// same bit clock and horizontal timing, without stopping. Takes effect at the
+// start of the next frame; blocks until then if DVI is running.
+void dvi_set_vertical_timing(struct dvi_inst *inst, const struct dvi_timing *timing);
+
+// Show each scanline for repeat lines instead of DVI_VERTICAL_REPEAT, e.g. 1
+// for full vertical resolution. Takes effect at the start of the next frame,
+// doesn't block. The scanline callback is then called with line numbers up to
+// v_active_lines / repeat.
+void dvi_set_vertical_repeat(struct dvi_inst *inst, uint repeat);
+
+// Switch to any timing. DVI must be stopped, the IRQs unregistered and the
+// TMDS encode worker returned. Reallocates the TMDS buffers, rebuilds the DMA
+// lists and starts over from the first frame. Queued scanlines are dropped.
+// clk_sys has to be changed by the caller.
+void dvi_set_timing(struct dvi_inst *inst, const struct dvi_timing *timing);
+
 //Waits for a valid line
 void dvi_wait_for_valid_line(struct dvi_inst *inst);
 
-// TMDS encode worker function: core enters and doesn't leave, but still
-// responds to IRQs. Repeatedly pop a scanline buffer from q_colour_valid,
-// TMDS encode it, and pass it to the tmds valid queue.
+// TMDS encode worker function: core enters and doesn't leave until a NULL
+// scanline is queued, but still responds to IRQs. Repeatedly pop a scanline
+// buffer from q_colour_valid, TMDS encode it, and pass it to the tmds valid
+// queue.
 void dvi_scanbuf_main_8bpp(struct dvi_inst *inst);
 void dvi_scanbuf_main_16bpp(struct dvi_inst *inst);
 
-// Same as above, but each q_colour_valid entry is a framebuffer
+// Same as above, but each q_colour_valid entry is a framebuffer, passed back on
+// q_colour_free once all of its lines are encoded. Nothing has to be queued per
+// scanline, so the scanline callback can stay out of the way.
 void dvi_framebuf_main_8bpp(struct dvi_inst *inst);
 void dvi_framebuf_main_16bpp(struct dvi_inst *inst);
 
@@ -118,6 +157,7 @@ void dvi_audio_sample_buffer_set(struct dvi_inst *inst, audio_sample_t *buffer,
 void dvi_audio_sample_dma_set_chan(struct dvi_inst *inst, int chan_a, audio_sample_t *buf_a, int chan_b, audio_sample_t *buf_b, int size);
 void dvi_set_audio_freq(struct dvi_inst *inst, int audio_freq, int cts, int n);
 void dvi_update_audio_freq(struct dvi_inst *inst, int audio_freq, int cts, int n);
+void dvi_set_audio_frame_repeat(struct dvi_inst *inst, int repeat);
 bool dvi_update_data_packet_(struct dvi_inst *inst, data_packet_t *packet);
 void inline dvi_update_data_packet(struct dvi_inst *inst) {
     data_packet_t packet;
@@ -134,4 +174,15 @@ inline void dvi_set_scanline(struct dvi_inst *inst, bool value) {
 inline dvi_blank_t *dvi_get_blank_settings(struct dvi_inst *inst) {
     return &inst->blank_settings;
 }
+
+// Output line relative to the first active line, negative in vertical blanking
+inline int dvi_get_line(struct dvi_inst *inst) {
+    return dvi_timing_state_get_line(inst->timing, &inst->timing_state);
+}
+
+// Lengthen (or shorten, if negative) the next vertical front porch. Shifts the
+// phase of the output frame without changing the timing of any other frame.
+inline void dvi_set_front_porch_adjust(struct dvi_inst *inst, int lines) {
+    inst->timing_state.v_front_porch_adjust = lines;
+}
 #endif
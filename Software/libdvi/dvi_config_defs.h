@@ -40,6 +40,14 @@
 #define DVI_MONOCHROME_TMDS 0
 #endif
 
+// If 1, time the DMA IRQ handler, and the data island update at its end, with
+// SysTick. The application has to have SysTick running at clk_sys on the IRQ
+// core. The slowest of each in the last frame are kept in irq_cycles and
+// data_packet_cycles of the dvi_inst.
+#ifndef DVI_IRQ_STATS
+#define DVI_IRQ_STATS 0
+#endif
+
 // By default, we assume each 32-bit word written to a PIO FIFO contains 2x
 // 10-bit TMDS symbols, concatenated into the lower 20 bits, least-significant
 // first. This is convenient if you are generating two or more pixels at once,
@@ -133,6 +141,24 @@
 #define TMDS_ENCODE_UNROLL 1
 #endif
 
+// If 1, the pixel-doubling encoders look up each colour channel in its own
+// copy of the TMDS table, in RAM instead of const, so a colour curve can be
+// applied per channel with tmds_table_set_levels(). Costs another 512 bytes
+// of scratch X, 768 for the three tables. The full-resolution encoders are
+// not affected.
+//
+// Scratch X is 4 kB and also holds the core 1 stack, 2 kB by default
+// (PICO_CORE1_STACK_SIZE), so the code and data in it get 2 kB. The linker
+// fails with "region SCRATCH_X overflowed" when they don't fit. A pixel
+// doubled build puts 868 bytes there, the tables and one pair of encode loops
+// (100 bytes for 16bpp, 96 for 8bpp), which leaves over 1 kB for the
+// __dvi_func_x functions of dvi.c if they aren't inlined. The full-resolution
+// encoders and their table take 1824 bytes on their own, so a build using
+// them must not reference these tables.
+#ifndef TMDS_TABLE_PER_CHANNEL
+#define TMDS_TABLE_PER_CHANNEL 0
+#endif
+
 // If 1, don't save/restore the interpolators on full-resolution TMDS encode.
 // Speed hack. The TMDS code uses both interpolators, for each of the 3 data
 // channels, so this define avoids 6 save/restores per scanline.
@@ -25,9 +25,46 @@ const struct dvi_timing __dvi_const(dvi_timing_640x480p_60hz) = {
 	.v_back_porch      = 33,
 	.v_active_lines    = 480,
 
+	.bit_clk_khz       = 252000,
+	.video_code        = _640x480P60
+};
+
+// 576 lines at 50 Hz for PAL sources. Not a CEA mode, but it's VGA with the
+// vertical timing stretched to 630 lines, so the clk_sys and every DMA list
+// stay the same and it can be switched to on the fly
+const struct dvi_timing __dvi_const(dvi_timing_640x576p_50hz) = {
+	.h_sync_polarity   = false,
+	.h_front_porch     = 16,
+	.h_sync_width      = 96,
+	.h_back_porch      = 48,
+	.h_active_pixels   = 640,
+
+	.v_sync_polarity   = false,
+	.v_front_porch     = 5,
+	.v_sync_width      = 5,
+	.v_back_porch      = 44,
+	.v_active_lines    = 576,
+
 	.bit_clk_khz       = 252000
 };
 
+// VESA 640x480 at 72 Hz, 315 MHz clk_sys
+const struct dvi_timing __dvi_const(dvi_timing_640x480p_72hz) = {
+	.h_sync_polarity   = false,
+	.h_front_porch     = 24,
+	.h_sync_width      = 40,
+	.h_back_porch      = 128,
+	.h_active_pixels   = 640,
+
+	.v_sync_polarity   = false,
+	.v_front_porch     = 9,
+	.v_sync_width      = 3,
+	.v_back_porch      = 28,
+	.v_active_lines    = 480,
+
+	.bit_clk_khz       = 315000
+};
+
 // SVGA -- completely by-the-book but requires 400 MHz clk_sys
 const struct dvi_timing __dvi_const(dvi_timing_800x600p_60hz) = {
 	.h_sync_polarity   = false,
@@ -231,19 +268,42 @@ static uint32_t __dvi_const(video_gaurdband_syms)[3] = {
 void dvi_timing_state_init(struct dvi_timing_state *t) {
 	t->v_ctr = 0;
 	t->v_state = DVI_STATE_FRONT_PORCH;
+	t->v_front_porch_adjust = 0;
 };
 
 void __dvi_func(dvi_timing_state_advance)(const struct dvi_timing *t, struct dvi_timing_state *s) {
 		s->v_ctr++;
-		if ((s->v_state == DVI_STATE_FRONT_PORCH && s->v_ctr == t->v_front_porch) || 
+		// The front porch is compared with >= since the adjustment may shrink it
+		// below the current line
+		if ((s->v_state == DVI_STATE_FRONT_PORCH && (int)s->v_ctr >= (int)t->v_front_porch + s->v_front_porch_adjust) ||
 		    (s->v_state == DVI_STATE_SYNC && s->v_ctr == t->v_sync_width) ||
 		    (s->v_state == DVI_STATE_BACK_PORCH && s->v_ctr == t->v_back_porch) ||
 		    (s->v_state == DVI_STATE_ACTIVE && s->v_ctr == t->v_active_lines)) {
+			if (s->v_state == DVI_STATE_FRONT_PORCH) {
+				s->v_front_porch_adjust = 0;
+			}
 			s->v_state = (s->v_state + 1) % DVI_STATE_COUNT;
 			s->v_ctr = 0;
 		}
 }
 
+// Current line relative to the first active line, i.e. negative during
+// vertical blanking. May be read from the other core, in which case it can be
+// off by a state if it races with the DMA IRQ.
+int __dvi_func(dvi_timing_state_get_line)(const struct dvi_timing *t, const struct dvi_timing_state *s) {
+	uint v_ctr = s->v_ctr;
+	switch (s->v_state) {
+		case DVI_STATE_FRONT_PORCH:
+			return (int)v_ctr - (int)(t->v_front_porch + t->v_sync_width + t->v_back_porch) - s->v_front_porch_adjust;
+		case DVI_STATE_SYNC:
+			return (int)v_ctr - (int)(t->v_sync_width + t->v_back_porch);
+		case DVI_STATE_BACK_PORCH:
+			return (int)v_ctr - (int)t->v_back_porch;
+		default:
+			return (int)v_ctr;
+	}
+}
+
 void dvi_scanline_dma_list_init(struct dvi_scanline_dma_list *dma_list) {
 	*dma_list = (struct dvi_scanline_dma_list){};	
 }
@@ -418,4 +478,16 @@ uint32_t dvi_timing_get_pixels_per_frame(const struct dvi_timing *t) {
 
 uint32_t dvi_timing_get_pixels_per_line(const struct dvi_timing *t) {
     return t->h_front_porch + t->h_sync_width + t->h_back_porch + t->h_active_pixels;
+}
+
+// Timings that only differ in the vertical direction share clk_sys and every
+// DMA list
+bool dvi_timing_same_horizontal(const struct dvi_timing *a, const struct dvi_timing *b) {
+    return a->bit_clk_khz == b->bit_clk_khz &&
+        a->h_sync_polarity == b->h_sync_polarity &&
+        a->h_front_porch == b->h_front_porch &&
+        a->h_sync_width == b->h_sync_width &&
+        a->h_back_porch == b->h_back_porch &&
+        a->h_active_pixels == b->h_active_pixels &&
+        a->v_sync_polarity == b->v_sync_polarity;
 }
\ No newline at end of file
@@ -20,6 +20,10 @@ struct dvi_timing {
 	uint v_active_lines;
 
 	uint bit_clk_khz;
+
+	// CEA-861 video identification code sent in the AVI InfoFrame, 0 if the
+	// mode isn't a CEA mode
+	uint video_code;
 };
 
 enum dvi_line_state {
@@ -63,6 +67,9 @@ typedef struct dvi_blank {
 struct dvi_timing_state {
 	uint v_ctr;
 	enum dvi_line_state v_state;
+	// Lines added to (or removed from, if negative) the next vertical front
+	// porch. Cleared when the front porch ends, so it only applies once.
+	volatile int v_front_porch_adjust;
 };
 
 // This should map directly to DMA register layout, but more convenient types
@@ -107,6 +114,8 @@ struct dvi_lane_dma_cfg {
 extern const uint32_t dvi_ctrl_syms[4];
 
 extern const struct dvi_timing dvi_timing_640x480p_60hz;
+extern const struct dvi_timing dvi_timing_640x480p_72hz;
+extern const struct dvi_timing dvi_timing_640x576p_50hz;
 extern const struct dvi_timing dvi_timing_800x480p_60hz;
 extern const struct dvi_timing dvi_timing_800x600p_60hz;
 extern const struct dvi_timing dvi_timing_960x540p_60hz;
@@ -119,6 +128,8 @@ void dvi_timing_state_init(struct dvi_timing_state *t);
 
 void dvi_timing_state_advance(const struct dvi_timing *t, struct dvi_timing_state *s);
 
+int dvi_timing_state_get_line(const struct dvi_timing *t, const struct dvi_timing_state *s);
+
 void dvi_scanline_dma_list_init(struct dvi_scanline_dma_list *dma_list);
 
 void dvi_setup_scanline_for_vblank(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
@@ -138,4 +149,5 @@ void dvi_update_scanline_data_dma(const struct dvi_timing *t, const uint32_t *tm
 inline uint32_t dvi_timing_get_pixel_clock(const struct dvi_timing *t) { return t->bit_clk_khz * 100; }
 uint32_t dvi_timing_get_pixels_per_frame(const struct dvi_timing *t);
 uint32_t dvi_timing_get_pixels_per_line(const struct dvi_timing *t);
+bool dvi_timing_same_horizontal(const struct dvi_timing *a, const struct dvi_timing *b);
 #endif
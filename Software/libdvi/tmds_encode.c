@@ -3,9 +3,27 @@
 #include "hardware/gpio.h"
 #include "hardware/sync.h"
 
+#if TMDS_TABLE_PER_CHANNEL
+// One table per TMDS channel (blue, green, red), identity until
+// tmds_table_set_levels() is called
+static uint32_t __scratch_x("tmds_table") tmds_table[3][64] = {
+	{
+#include "tmds_table.h"
+	},
+	{
+#include "tmds_table.h"
+	},
+	{
+#include "tmds_table.h"
+	},
+};
+#define TMDS_TABLE(channel) tmds_table[channel]
+#else
 static const uint32_t __scratch_x("tmds_table") tmds_table[] = {
 #include "tmds_table.h"
 };
+#define TMDS_TABLE(channel) tmds_table
+#endif
 
 // Fullres table is bandwidth-critical, so gets one copy for each scratch
 // memory. There is a third copy which can go in flash, because it's just used
@@ -62,12 +80,19 @@ static int __not_in_flash_func(configure_interp_for_addrgen)(interp_hw_t *interp
 
 // Extract up to 6 bits from a buffer of 16 bit pixels, and produce a buffer
 // of TMDS symbols from this colour channel. Number of pixels must be even,
-// pixel buffer must be word-aligned.
+// pixel buffer must be word-aligned. The TMDS channel (0 blue, 1 green, 2 red)
+// picks the table with TMDS_TABLE_PER_CHANNEL.
+
+void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, uint tmds_channel) {
+	tmds_encode_data_channel_16bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, TMDS_TABLE(tmds_channel), 6);
+}
 
-void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+// As above, looking up up to lut_index_width bits of the channel in a table
+// of your own, e.g. 7 bits in a 128 entry table from tmds_table_from_levels().
+void __not_in_flash_func(tmds_encode_data_channel_16bpp_lut)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut, uint lut_index_width) {
 	interp_hw_save_t interp0_save;
 	interp_save(interp0_hw, &interp0_save);
-	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 16, 6, tmds_table);
+	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 16, lut_index_width, lut);
 	if (require_lshift)
 		tmds_encode_loop_16bpp_leftshift(pixbuf, symbuf, n_pix, require_lshift);
 	else
@@ -76,15 +101,21 @@ void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf,
 }
 
 // As above, but 8 bits per pixel, multiple of 4 pixels, and still word-aligned.
-void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, uint tmds_channel) {
+	tmds_encode_data_channel_8bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, TMDS_TABLE(tmds_channel), 6);
+}
+
+// As above, looking up up to lut_index_width bits of the channel in a table
+// of your own, e.g. a whole 8 bit palette index in a 256 entry table.
+void __not_in_flash_func(tmds_encode_data_channel_8bpp_lut)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut, uint lut_index_width) {
 	interp_hw_save_t interp0_save, interp1_save;
 	interp_save(interp0_hw, &interp0_save);
 	interp_save(interp1_hw, &interp1_save);
 	// Note that for 8bpp, some left shift is always required for pixel 0 (any
 	// channel), which destroys some MSBs of pixel 3. To get around this, pixel
 	// data sent to interp1 is *not left-shifted*
-	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 8, 6, tmds_table);
-	int lshift_upper = configure_interp_for_addrgen(interp1_hw, channel_msb, channel_lsb, 16, 8, 6, tmds_table);
+	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 8, lut_index_width, lut);
+	int lshift_upper = configure_interp_for_addrgen(interp1_hw, channel_msb, channel_lsb, 16, 8, lut_index_width, lut);
 	assert(!lshift_upper); (void)lshift_upper;
 	if (require_lshift || (DVI_SYMBOLS_PER_WORD==1))
 		tmds_encode_loop_8bpp_leftshift(pixbuf, symbuf, n_pix, require_lshift);
@@ -94,6 +125,14 @@ void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf,
 	interp_restore(interp1_hw, &interp1_save);
 }
 
+#if TMDS_TABLE_PER_CHANNEL
+// Rebuild the table of one TMDS channel (0 blue, 1 green, 2 red) from 64
+// levels, see tmds_table_from_levels()
+void tmds_table_set_levels(uint tmds_channel, const uint8_t *levels) {
+	tmds_table_from_levels(tmds_table[tmds_channel], levels, 64);
+}
+#endif
+
 // ----------------------------------------------------------------------------
 // Code for full-resolution TMDS encode (barely possible, utterly impractical):
 
@@ -5,12 +5,20 @@
 #include "dvi_config_defs.h"
 
 // Functions from tmds_encode.c
-void tmds_encode_data_channel_16bpp(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb);
-void tmds_encode_data_channel_8bpp(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb);
+void tmds_encode_data_channel_16bpp(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, uint tmds_channel);
+void tmds_encode_data_channel_16bpp_lut(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut, uint lut_index_width);
+void tmds_encode_data_channel_8bpp(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, uint tmds_channel);
+void tmds_encode_data_channel_8bpp_lut(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut, uint lut_index_width);
 void tmds_encode_data_channel_fullres_16bpp(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb);
 void tmds_setup_palette_symbols(const uint16_t *palette, uint32_t *symbuf, size_t n_palette);
 void tmds_setup_palette24_symbols(const uint32_t *palette, uint32_t *symbuf, size_t n_palette);
 void tmds_encode_palette_data(const uint32_t *pixbuf, const uint32_t *tmds_palette, uint32_t *symbuf, size_t n_pix, uint32_t palette_bits);
+#if TMDS_TABLE_PER_CHANNEL
+void tmds_table_set_levels(uint tmds_channel, const uint8_t *levels);
+#endif
+
+// Functions from tmds_table_gen.c
+void tmds_table_from_levels(uint32_t *lut, const uint8_t *levels, uint n_levels);
 
 // Functions from tmds_encode.S
 
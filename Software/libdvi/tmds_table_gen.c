@@ -0,0 +1,63 @@
+#include <assert.h>
+#include "tmds_encode.h"
+
+// Pixel-doubling TMDS tables built at run time, for output levels other than
+// the identity of tmds_table.h. Nothing here touches the hardware, so the
+// host tools build it too, see host/tmdscheck.c.
+
+// Same as TMDSEncode in tmds_table_gen.py, running disparity included
+
+static int tmds_byte_imbalance(uint32_t x) {
+	return 2 * __builtin_popcount(x & 0xff) - 8;
+}
+
+static uint32_t tmds_encode_data(uint32_t d, int *imbalance) {
+	uint32_t q_m = d & 0x1;
+	int n1 = __builtin_popcount(d);
+	if (n1 > 4 || (n1 == 4 && !(d & 0x1))) {
+		for (int i = 0; i < 7; ++i)
+			q_m |= (~((q_m >> i) ^ (d >> (i + 1))) & 0x1) << (i + 1);
+	}
+	else {
+		for (int i = 0; i < 7; ++i)
+			q_m |= (((q_m >> i) ^ (d >> (i + 1))) & 0x1) << (i + 1);
+		q_m |= 0x100;
+	}
+
+	const uint32_t inversion_mask = 0x2ff;
+	int q_m_imbalance = tmds_byte_imbalance(q_m);
+	if (*imbalance == 0 || q_m_imbalance == 0) {
+		if (q_m & 0x100) {
+			*imbalance += q_m_imbalance;
+			return q_m;
+		}
+		*imbalance -= q_m_imbalance;
+		return q_m ^ inversion_mask;
+	}
+	else if ((*imbalance > 0) == (q_m_imbalance > 0)) {
+		*imbalance += (int)((q_m & 0x100) >> 7) - q_m_imbalance;
+		return q_m ^ inversion_mask;
+	}
+	else {
+		*imbalance += q_m_imbalance - (int)((~q_m & 0x100) >> 7);
+		return q_m;
+	}
+}
+
+// Build a pixel-doubling table from n_levels output levels, one for each
+// table index. Like tmds_table_gen.py, an even level x is sent as x followed
+// by x + 1 so the pair is DC balanced, which means the LSB of each level is
+// ignored. 64 levels of i * 4 give back tmds_table.h, 128 levels of i * 2 use
+// every level the pairs can reach. Entries are written one word at a time, so
+// a table can be rebuilt while the other core encodes with it, a line may
+// come out half old and half new.
+void tmds_table_from_levels(uint32_t *lut, const uint8_t *levels, uint n_levels) {
+	for (uint i = 0; i < n_levels; ++i) {
+		uint32_t x = levels[i] & 0xfe;
+		int imbalance = 0;
+		uint32_t sym0 = tmds_encode_data(x, &imbalance);
+		uint32_t sym1 = tmds_encode_data(x + 1, &imbalance);
+		assert(imbalance == 0);
+		lut[i] = sym0 | (sym1 << 10);
+	}
+}
@@ -1,5 +1,7 @@
 #!/usr/bin/env python3
 
+import sys
+
 # The key fact is that, if x is even, and the encoder currently has a running
 # imbalance of 0, encoding x followed by x + 1 produces a symbol pair with a
 # net balance of 0.
@@ -82,13 +84,15 @@ enc = TMDSEncode()
 
 
 ###
-# Pixel-doubled table:
+# Pixel-doubled table, tmds_table.h, with "tmds_table_gen.py doubled":
 
-# for i in range(0, 256, 4):
-# 	sym0 = enc.encode(i, 0, 1)
-# 	sym1 = enc.encode(i ^ 1, 0, 1)
-# 	assert(enc.imbalance == 0)
-# 	print(f"0x{sym0 | (sym1 << 10):05x}u,")
+if sys.argv[1:] == ["doubled"]:
+	for i in range(0, 256, 4):
+		sym0 = enc.encode(i, 0, 1)
+		sym1 = enc.encode(i ^ 1, 0, 1)
+		assert(enc.imbalance == 0)
+		print(f"0x{sym0 | (sym1 << 10):05x}u,")
+	sys.exit(0)
 
 ###
 # Fullres 1bpp table: (each entry is 2 words, 4 pixels)